@@ -28,7 +28,8 @@ a.findAlignmentCandidatesLowHash1(
     minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
     minBucketSize = int(config['MinHash']['minBucketSize']),
     maxBucketSize = int(config['MinHash']['maxBucketSize']),
-    minFrequency = int(config['MinHash']['minFrequency']))
+    minFrequency = int(config['MinHash']['minFrequency']),
+    checkpointDirectory = config['MinHash'].get('checkpointDirectory', ''))
 # a.writeAlignmentCandidates()
 
 
@@ -11,9 +11,6 @@
 using namespace shasta;
 using namespace Align4;
 
-// Seqan.
-#include <seqan/align.h>
-
 // Boost libraries.
 #include <boost/pending/disjoint_sets.hpp>
 
@@ -348,16 +345,16 @@ void Aligner::writeCheckerboard(
                 (cellDistanceFromRight(iXY)  < maxDistanceFromBoundary) or
                 (cellDistanceFromBottom(iXY) < maxDistanceFromBoundary);
             */
-            const Cell* cell = findCell(iXY);
+            const uint32_t cellId = findCell(iXY);
             const bool isEvenCell = (((iX + iY) % 2) == 0);
 
             int r = 0;
             int g = 0;
             int b = 0;
-            if(cell) {
-                if(cell->isActive()) {
+            if(cellId != invalidCellId) {
+                if(isActive(cellId)) {
                     g = 255;
-                } else if(cell->isForwardAccessible) {
+                } else if(isForwardAccessible[cellId]) {
                     b = 255;
                 } else {
                     r = 128;
@@ -382,15 +379,16 @@ void Aligner::createCells(
     uint64_t maxDistanceFromBoundary)
 {
     // Start with nothing.
-    cells.clear();
-    cells.resize(alignmentMatrix.size());
+    cellRowBegin.clear();
+    cellX.clear();
+    cellY.clear();
 
     // Loop over iY values.
     for(uint32_t iY=0; iY<alignmentMatrix.size(); iY++) {
+        cellRowBegin.push_back(cellCount());
 
-        // Access the vectors for this value of iY.
+        // Access the vector for this value of iY.
         const auto& iYAlignmentMatrix = alignmentMatrix[iY];
-        vector< pair<uint32_t, Cell> >& iYCells = cells[iY];
 
         // Each vector in the alignment matrix is sorted by iX, so we can scan it,
         // creating a new cell each time we encounter a new value of iX
@@ -418,20 +416,30 @@ void Aligner::createCells(
                 continue;
             }
 
-            // Construct the cell.
-            const Coordinates iXY(iX, iY);
-            Cell cell;
-            cell.isNearLeftOrTop =
-                (cellDistanceFromLeft(iXY) < maxDistanceFromBoundary) or
-                (cellDistanceFromTop(iXY)  < maxDistanceFromBoundary);
-            cell.isNearRightOrBottom =
-                (cellDistanceFromRight(iXY)  < maxDistanceFromBoundary) or
-                (cellDistanceFromBottom(iXY) < maxDistanceFromBoundary);
-
             // Store this cell.
-            iYCells.push_back(make_pair(iX, cell));
+            cellX.push_back(iX);
+            cellY.push_back(iY);
         }
+    }
+    cellRowBegin.push_back(cellCount());
+
+
 
+    // Set the flags.
+    isNearLeftOrTop.clear(cellCount());
+    isNearRightOrBottom.clear(cellCount());
+    isForwardAccessible.clear(cellCount());
+    isBackwardAccessible.clear(cellCount());
+    for(uint32_t cellId=0; cellId<cellCount(); cellId++) {
+        const Coordinates iXY(cellX[cellId], cellY[cellId]);
+        if( (cellDistanceFromLeft(iXY) < maxDistanceFromBoundary) or
+            (cellDistanceFromTop(iXY)  < maxDistanceFromBoundary)) {
+            isNearLeftOrTop.set(cellId);
+        }
+        if( (cellDistanceFromRight(iXY)  < maxDistanceFromBoundary) or
+            (cellDistanceFromBottom(iXY) < maxDistanceFromBoundary)) {
+            isNearRightOrBottom.set(cellId);
+        }
     }
 }
 
@@ -443,13 +451,10 @@ void Aligner::writeCellsCsv(
     uint64_t cellCount = 0;
     ofstream csv(fileName);
     csv << "iX,iY,minX,maxX,minY,maxY,sizeX,sizeY\n";
-    for(uint32_t iY=0; iY<cells.size(); iY++) {
-        for(const auto& p: cells[iY]) {
-            const uint32_t iX = p.first;
-            csv << iX << ",";
-            csv << iY << "\n";
-            ++cellCount;
-        }
+    for(uint32_t cellId=0; cellId<this->cellCount(); cellId++) {
+        csv << cellX[cellId] << ",";
+        csv << cellY[cellId] << "\n";
+        ++cellCount;
     }
     cout << "There are " << cellCount << " cells." << endl;
 }
@@ -484,10 +489,10 @@ void Aligner::writeCellsPng(
     }
 
     // Write the cells.
-    for(uint32_t iY=0; iY<cells.size(); iY++) {
-        for(const auto& p: cells[iY]) {
-            const uint32_t iX = p.first;
-            const Cell& cell = p.second;
+    for(uint32_t cellId=0; cellId<cellCount(); cellId++) {
+        {
+            const uint32_t iX = cellX[cellId];
+            const uint32_t iY = cellY[cellId];
             SHASTA_ASSERT(iX < sizeXY);
             SHASTA_ASSERT(iY < sizeXY);
             const uint32_t iMin = ( iX    * deltaX)  / markersPerPixel;
@@ -498,9 +503,9 @@ void Aligner::writeCellsPng(
             int r = 0;
             int g = 0;
             int b = 0;
-            if(cell.isActive()) {
+            if(isActive(cellId)) {
                 g = 255;
-            } else if(cell.isForwardAccessible) {
+            } else if(isForwardAccessible[cellId]) {
                 b = 255;
            } else {
                 r = 128;
@@ -627,52 +632,47 @@ uint32_t Aligner::cellDistanceFromBottom(const Coordinates& iXY) const
 
 
 
-// Find a cell with given (iX,iY).
-Aligner::Cell* Aligner::findCell(const Coordinates& iXY)
+// Find the id of the cell with given (iX,iY),
+// or invalidCellId if there is no such cell.
+uint32_t Aligner::findCell(const Coordinates& iXY) const
 {
     const uint32_t iX = iXY.first;
     const uint32_t iY = iXY.second;
-    if(iY >= cells.size()) {
-        return 0;
+    if(iY + 1 >= cellRowBegin.size()) {
+        return invalidCellId;
     }
-    vector< pair<uint32_t, Cell> >& v = cells[iY];
 
     // Look for a cell with this iX.
-    auto it = std::lower_bound(v.begin(), v.end(),
-        make_pair(iX, Cell()),
-        OrderPairsByFirstOnly<uint32_t, Cell>());
-    if(it == v.end()) {
-        return 0;
-    }
-    if(it->first != iX) {
-        return 0;
+    const auto begin = cellX.begin() + cellRowBegin[iY];
+    const auto end = cellX.begin() + cellRowBegin[iY + 1];
+    const auto it = std::lower_bound(begin, end, iX);
+    if(it == end or *it != iX) {
+        return invalidCellId;
     }
-    return &(it->second);
+    return uint32_t(it - cellX.begin());
 }
 
 
 
-// const version of the above
-const Aligner::Cell* Aligner::findCell(const Coordinates& iXY) const
+// Find the ids of the cells with iX and iX+1 in row iY.
+// Each of the two returned ids can be invalidCellId.
+array<uint32_t, 2> Aligner::findCellPair(uint32_t iX, uint32_t iY) const
 {
-    const uint32_t iX = iXY.first;
-    const uint32_t iY = iXY.second;
-    if(iY >= cells.size()) {
-        return 0;
+    array<uint32_t, 2> cellIds = {invalidCellId, invalidCellId};
+    if(iY + 1 >= cellRowBegin.size()) {
+        return cellIds;
     }
-    const vector< pair<uint32_t, Cell> >& v = cells[iY];
-
-    // Look for a cell with this iX.
-    auto it = std::lower_bound(v.begin(), v.end(),
-        make_pair(iX, Cell()),
-        OrderPairsByFirstOnly<uint32_t, Cell>());
-    if(it == v.end()) {
-        return 0;
+    const auto begin = cellX.begin() + cellRowBegin[iY];
+    const auto end = cellX.begin() + cellRowBegin[iY + 1];
+    auto it = std::lower_bound(begin, end, iX);
+    if(it != end and *it == iX) {
+        cellIds[0] = uint32_t(it - cellX.begin());
+        ++it;
     }
-    if(it->first != iX) {
-        return 0;
+    if(it != end and *it == iX + 1) {
+        cellIds[1] = uint32_t(it - cellX.begin());
     }
-    return &(it->second);
+    return cellIds;
 }
 
 
@@ -681,51 +681,36 @@ const Aligner::Cell* Aligner::findCell(const Coordinates& iXY) const
 // We use DFS instead of BFS for better locality of memory access.
 void Aligner::forwardSearch()
 {
-    uint64_t n = 0;
-
-    // Initialize the stack of undiscovered iXY.
-    std::stack<Coordinates> s;
-    for(uint32_t iY=0; iY<cells.size(); iY++) {
-        vector< pair<uint32_t, Cell> >& v = cells[iY];
-        for(auto& p: v) {
-            Cell& cell = p.second;
-            if(cell.isNearLeftOrTop) {
-                cell.isForwardAccessible = 1;
-                ++n;
-                const uint32_t iX = p.first;
-                s.push(Coordinates(iX, iY));
-            }
+    // Initialize the stack of undiscovered cells.
+    vector<uint32_t> s;
+    for(uint32_t cellId=0; cellId<cellCount(); cellId++) {
+        if(isNearLeftOrTop[cellId]) {
+            isForwardAccessible.set(cellId);
+            s.push_back(cellId);
         }
     }
 
     // DFS.
-    vector<Coordinates> children;
     while(not s.empty()) {
-        const Coordinates& iXY0 = s.top();
-        const uint32_t iX0 = iXY0.first;
-        const uint32_t iY0 = iXY0.second;
-        s.pop();
+        const uint32_t cellId0 = s.back();
+        s.pop_back();
+        const uint32_t iX0 = cellX[cellId0];
+        const uint32_t iY0 = cellY[cellId0];
 
-        // Loop over possible children.
+        // Loop over possible children (iX0, iY1) and (iX0+1, iY1).
         for(int32_t dY=-1; dY<=1; dY++) {
             const int32_t iY1Signed = int32_t(iY0) + dY;
             if(iY1Signed < 0) {
                 continue;
             }
-            const uint32_t iY1 = uint32_t(iY1Signed);
-            for(uint32_t dX=0; dX<=1; dX++) {
-                const uint32_t iX1 = iX0 + dX;
-                const Coordinates iXY1(iX1, iY1);
-                Cell* cell1 = findCell(iXY1);
-                if(cell1 and not cell1->isForwardAccessible) {
-                    cell1->isForwardAccessible = 1;
-                    ++n;
-                    s.push(iXY1);
+            for(const uint32_t cellId1: findCellPair(iX0, uint32_t(iY1Signed))) {
+                if(cellId1 != invalidCellId and not isForwardAccessible[cellId1]) {
+                    isForwardAccessible.set(cellId1);
+                    s.push_back(cellId1);
                 }
             }
         }
     }
-    // cout << "Forward search found " << n << " cells." << endl;
 }
 
 
@@ -733,138 +718,120 @@ void Aligner::forwardSearch()
 // Backward DFS in cell space, starting from cells near the
 // right/bottom that are also forward accessible from the left/top.
 // We use DFS instead of BFS for better locality of memory access.
+// This also stores the ids of the active cells.
 void Aligner::backwardSearch()
 {
-    uint64_t n = 0;
-
-    // Initialize the stack of undiscovered iXY.
-    std::stack<Coordinates> s;
-    for(uint32_t iY=0; iY<cells.size(); iY++) {
-        vector< pair<uint32_t, Cell> >& v = cells[iY];
-        for(auto& p: v) {
-            Cell& cell = p.second;
-            if(cell.isNearRightOrBottom and cell.isForwardAccessible) {
-                cell.isBackwardAccessible = 1;
-                ++n;
-                const uint32_t iX = p.first;
-                s.push(Coordinates(iX, iY));
-            }
+    activeCellIds.clear();
+
+    // Initialize the stack of undiscovered cells.
+    vector<uint32_t> s;
+    for(uint32_t cellId=0; cellId<cellCount(); cellId++) {
+        if(isNearRightOrBottom[cellId] and isForwardAccessible[cellId]) {
+            isBackwardAccessible.set(cellId);
+            s.push_back(cellId);
         }
     }
 
     // DFS.
-    vector<Coordinates> children;
     while(not s.empty()) {
-        const Coordinates& iXY0 = s.top();
-        const uint32_t iX0 = iXY0.first;
-        const uint32_t iY0 = iXY0.second;
-        s.pop();
+        const uint32_t cellId0 = s.back();
+        s.pop_back();
+        if(isForwardAccessible[cellId0]) {
+            activeCellIds.push_back(cellId0);
+        }
+        const uint32_t iX0 = cellX[cellId0];
+        const uint32_t iY0 = cellY[cellId0];
 
-        // Loop over possible parents.
+        // Loop over possible parents (iX0-1, iY1) and (iX0, iY1).
+        // If iX0 is 0, only (iX0, iY1) exists.
         for(int32_t dY=-1; dY<=1; dY++) {
             const int32_t iY1Signed = int32_t(iY0) + dY;
             if(iY1Signed < 0) {
                 continue;
             }
-            const uint32_t iY1 = uint32_t(iY1Signed);
-            for(int32_t dX=-1; dX<=0; dX++) {
-                const int32_t iX1Signed = int32_t(iX0) + dX;
-                if(iX1Signed < 0) {
-                    continue;
-                }
-                const uint32_t iX1 = uint32_t(iX1Signed);
-                const Coordinates iXY1(iX1, iY1);
-                Cell* cell1 = findCell(iXY1);
-                if(cell1 and not cell1->isBackwardAccessible) {
-                    cell1->isBackwardAccessible = 1;
-                    ++n;
-                    s.push(iXY1);
+            array<uint32_t, 2> parentCellIds;
+            if(iX0 == 0) {
+                parentCellIds = {findCellPair(0, uint32_t(iY1Signed))[0], invalidCellId};
+            } else {
+                parentCellIds = findCellPair(iX0 - 1, uint32_t(iY1Signed));
+            }
+            for(const uint32_t cellId1: parentCellIds) {
+                if(cellId1 != invalidCellId and not isBackwardAccessible[cellId1]) {
+                    isBackwardAccessible.set(cellId1);
+                    s.push_back(cellId1);
                 }
             }
         }
     }
-    // cout << "Backward search found " << n << " cells." << endl;
+    sort(activeCellIds.begin(), activeCellIds.end());
 }
 
 
 
 // Group active cells in connected component.
+// Two active cells are neighbors if they differ by at most 1 in iX and in iY.
 void Aligner::findActiveCellsConnectedComponents()
 {
-    // Gather all the active cells.
-    // Store a contiguously numbered id for each of them.
-    // The id will be used for the connected component computation below.
-    uint32_t nextCellId = 0;
-    std::unordered_map<Coordinates, uint32_t, HashTuple<Coordinates> > activeCells;
-    for(uint32_t iY=0; iY<cells.size(); iY++) {
-        const vector< pair<uint32_t, Cell> >& iYCells = cells[iY];
-        for(const pair<uint32_t, Cell>& p: iYCells) {
-            const Cell& cell = p.second;
-            if(cell.isActive()) {
-                const uint32_t iX = p.first;
-                activeCells.insert(make_pair(Coordinates(iX, iY), nextCellId++));
-            }
-        }
-    }
-    const uint32_t activeCellCount = nextCellId;
-
-
-
-    // Compute the connected components.
+    // Compute the connected components, using indexes into activeCellIds
+    // for the disjoint sets.
+    // Each pair of neighbors is found from the cell with the greater (iY, iX),
+    // looking at the cells with iX-1 and iX in the same row
+    // and at the cells with iX-1, iX, iX+1 in the previous row.
+    // Because cell ids are in (iY, iX) order, the index of a neighbor
+    // in activeCellIds can be found with a binary search.
+    const uint32_t activeCellCount = uint32_t(activeCellIds.size());
     vector<uint32_t> rank(activeCellCount);
     vector<uint32_t> parent(activeCellCount);
-    boost::disjoint_sets<uint32_t*, uint32_t*> disjointSets(&rank[0], &parent[0]);
+    boost::disjoint_sets<uint32_t*, uint32_t*> disjointSets(rank.data(), parent.data());
     for(uint32_t i=0; i<activeCellCount; i++) {
         disjointSets.make_set(i);
     }
-    for(const auto& p: activeCells) {
-        const Coordinates& iXY0 = p.first;
-        const uint32_t iX0 = iXY0.first;
-        const uint32_t iY0 = iXY0.second;
-        const uint32_t cellId0 = p.second;
-
-        // Loop over possible neighbors.
-        for(int32_t dY=-1; dY<=1; dY++) {
-            const int32_t iY1Signed = int32_t(iY0) + dY;
-            if(iY1Signed < 0) {
-                continue;
-            }
-            const uint32_t iY1 = uint32_t(iY1Signed);
-            for(int32_t dX=-1; dX<=1; dX++) {
-                if((dX == 0) and (dY == 0)) {
-                    continue;
-                }
-                const int32_t iX1Signed = int32_t(iX0) + dX;
-                if(iX1Signed < 0) {
-                    continue;
-                }
-                const uint32_t iX1 = uint32_t(iX1Signed);
-                const auto it = activeCells.find(Coordinates(iX1, iY1));
-                if(it == activeCells.end()) {
-                    continue;
-                }
-                const uint32_t cellId1 = it->second;
-                disjointSets.union_set(cellId0, cellId1);
+    const auto activeBegin = activeCellIds.begin();
+    const auto activeEnd = activeCellIds.end();
+    for(uint32_t i0=0; i0<activeCellCount; i0++) {
+        const uint32_t cellId0 = activeCellIds[i0];
+        const uint32_t iX0 = cellX[cellId0];
+        const uint32_t iY0 = cellY[cellId0];
+
+        // Same row.
+        if(i0 > 0) {
+            const uint32_t cellId1 = activeCellIds[i0 - 1];
+            if(cellY[cellId1] == iY0 and cellX[cellId1] + 1 == iX0) {
+                disjointSets.union_set(i0, i0 - 1);
             }
         }
+
+        // Previous row.
+        if(iY0 == 0) {
+            continue;
+        }
+        const uint32_t iXBegin = (iX0 == 0) ? 0 : iX0 - 1;
+        const uint32_t rowBegin = cellRowBegin[iY0 - 1];
+        const uint32_t rowEnd = cellRowBegin[iY0];
+        const uint32_t cellIdBegin = uint32_t(std::lower_bound(
+            cellX.begin() + rowBegin, cellX.begin() + rowEnd, iXBegin) - cellX.begin());
+        auto it = std::lower_bound(activeBegin, activeEnd, cellIdBegin);
+        for(; it!=activeEnd and *it<rowEnd and cellX[*it]<=iX0+1; ++it) {
+            disjointSets.union_set(i0, uint32_t(it - activeBegin));
+        }
     }
 
 
+
     // Gather the cells in each connected component.
-    std::map<uint32_t, vector<Coordinates> > connectedComponents;
-    for(const auto& p: activeCells) {
-        const Coordinates& iXY = p.first;
-        const uint32_t cellId = p.second;
-        const uint32_t componentId = disjointSets.find_set(cellId);
-        connectedComponents[componentId].push_back(iXY);
-    }
-    // cout << "Found " << connectedComponents.size() << " connected components of sizes:";
+    // Components are numbered in order of their first cell.
     activeCellsConnectedComponents.clear();
-    for(const auto& p: connectedComponents) {
-        // cout << " " << p.second.size();
-        activeCellsConnectedComponents.push_back(p.second);
+    vector<uint32_t> componentIndex(activeCellCount, invalidCellId);
+    for(uint32_t i=0; i<activeCellCount; i++) {
+        const uint32_t cellId = activeCellIds[i];
+        const uint32_t root = disjointSets.find_set(i);
+        if(componentIndex[root] == invalidCellId) {
+            componentIndex[root] = uint32_t(activeCellsConnectedComponents.size());
+            activeCellsConnectedComponents.emplace_back();
+        }
+        activeCellsConnectedComponents[componentIndex[root]].push_back(
+            Coordinates(cellX[cellId], cellY[cellId]));
     }
-    // cout << endl;
 }
 
 
@@ -990,6 +957,19 @@ void Aligner::computeBandedAlignments(
 
 
 // Compute a banded alignment with a given band.
+// The band is the range of diagonals x-y allowed.
+// This is a global alignment with free end gaps on both sequences
+// and linear gaps, the same as computed by SeqAn with
+// AlignConfig<true, true, true, true> and LinearGaps.
+// The dynamic programming matrix is stored by rows of constant y,
+// and in each row only the cells in the band are stored,
+// indexed by k = x - y - bandMin.
+// For each row, the diagonal and vertical moves only depend
+// on the previous row, so they are computed in a loop without
+// dependencies between iterations, which the compiler can vectorize.
+// The horizontal moves are then applied in a separate, short serial pass.
+// The traceback matrix uses one byte per cell in the band
+// and is allocated using the ByteAllocator.
 bool Aligner::computeBandedAlignment(
     const array<CompressedMarkers, 2>& compressedMarkers,
     int32_t bandMin,
@@ -998,74 +978,161 @@ bool Aligner::computeBandedAlignment(
     AlignmentInfo& alignmentInfo,
     bool debug) const
 {
-    // Some seqan types and constants we need.
-    using namespace seqan;
-    using TSequence = String<KmerId>;
-    using TStringSet = StringSet<TSequence>;
-    using TDepStringSet = StringSet< TSequence, Dependent<> >;
-    using TAlignGraph = Graph< seqan::Alignment<TDepStringSet> >;
-    const uint32_t seqanGapValue = 45;
-
     if(debug) {
         cout << timestamp << "Banded alignment computation begins." << endl;
     }
 
-    // Fill in the seqan sequences.
-    // Add 100 to kMerIds to prevent collision from the seqan gap value.
-    array<TSequence, 2> sequences;
-    for(uint64_t i=0; i<2; i++) {
-        for(const CompressedMarker& marker: compressedMarkers[i]) {
-            appendValue(sequences[i], marker.kmerId + 100);
+    // Clip the band to the diagonals that intersect the alignment matrix.
+    const int32_t n0 = int32_t(nx);
+    const int32_t n1 = int32_t(ny);
+    bandMin = max(bandMin, -n1);
+    bandMax = min(bandMax, n0);
+    if(bandMin > bandMax) {
+        cout << "Banded alignment computation failed." << endl;
+        return false;
+    }
+    const int32_t bandWidth = bandMax - bandMin + 1;
+
+    // Gather the KmerIds of the two sequences.
+    vector<KmerId, MemoryMapped::Allocator<KmerId> > x(nx, MemoryMapped::Allocator<KmerId>(byteAllocator));
+    vector<KmerId, MemoryMapped::Allocator<KmerId> > y(ny, MemoryMapped::Allocator<KmerId>(byteAllocator));
+    for(uint32_t i=0; i<nx; i++) {
+        x[i] = compressedMarkers[0][i].kmerId;
+    }
+    for(uint32_t j=0; j<ny; j++) {
+        y[j] = compressedMarkers[1][j].kmerId;
+    }
+
+    // Scores for the previous and current row.
+    // One extra entry at the end so we can always access k+1
+    // in the previous row.
+    const int32_t minusInfinity = std::numeric_limits<int32_t>::min() / 2;
+    vector<int32_t, MemoryMapped::Allocator<int32_t> > previousRow(
+        bandWidth + 1, minusInfinity, MemoryMapped::Allocator<int32_t>(byteAllocator));
+    vector<int32_t, MemoryMapped::Allocator<int32_t> > currentRow(
+        bandWidth + 1, minusInfinity, MemoryMapped::Allocator<int32_t>(byteAllocator));
+    int32_t* previous = previousRow.data();
+    int32_t* current = currentRow.data();
+
+    // The traceback matrix, indexed by [y*bandWidth + k].
+    const uint8_t start = 0;
+    const uint8_t diagonal = 1;
+    const uint8_t up = 2;       // From (x, y-1).
+    const uint8_t left = 3;     // From (x-1, y).
+    vector<uint8_t, MemoryMapped::Allocator<uint8_t> > traceback(
+        (uint64_t(ny) + 1) * uint64_t(bandWidth), start, MemoryMapped::Allocator<uint8_t>(byteAllocator));
+
+    // Keep track of the best cell on the last row or last column,
+    // where the alignment can end with free end gaps.
+    int32_t bestScore = minusInfinity;
+    int32_t bestX = -1;
+    int32_t bestY = -1;
+
+    // Loop over rows.
+    for(int32_t j=0; j<=n1; j++) {
+
+        // The range of k for cells in this row that are inside the matrix.
+        const int32_t kBegin = max(0, -(j + bandMin));
+        const int32_t kEnd = min(bandWidth, n0 - j - bandMin + 1);
+        fill(current, current + bandWidth + 1, minusInfinity);
+        uint8_t* rowTraceback = traceback.data() + uint64_t(j) * uint64_t(bandWidth);
+
+        if(j == 0) {
+
+            // Free leading gaps: the alignment can start anywhere on the first row.
+            for(int32_t k=kBegin; k<kEnd; k++) {
+                current[k] = 0;
+            }
+
+        } else if(kBegin < kEnd) {
+            const KmerId yKmerId = y[j - 1];
+
+            // If the first cell of this row is on the first column,
+            // the alignment can start there (free leading gaps).
+            int32_t kFirst = kBegin;
+            if(j + bandMin + kBegin == 0) {
+                current[kBegin] = 0;
+                rowTraceback[kBegin] = start;
+                ++kFirst;
+            }
+
+            // Diagonal and vertical moves.
+            // These only depend on the previous row.
+            const KmerId* xPointer = x.data() + (j + bandMin - 1);
+            for(int32_t k=kFirst; k<kEnd; k++) {
+                const int32_t diagonalScore = previous[k] +
+                    ((xPointer[k] == yKmerId) ? matchScore : mismatchScore);
+                const int32_t upScore = previous[k + 1] + gapScore;
+                const bool isDiagonal = (diagonalScore >= upScore);
+                current[k] = isDiagonal ? diagonalScore : upScore;
+                rowTraceback[k] = isDiagonal ? diagonal : up;
+            }
+
+            // Horizontal moves.
+            for(int32_t k=kBegin+1; k<kEnd; k++) {
+                const int32_t leftScore = current[k - 1] + gapScore;
+                if(leftScore > current[k]) {
+                    current[k] = leftScore;
+                    rowTraceback[k] = left;
+                }
+            }
+        }
+
+        // Free trailing gaps: the alignment can end on the last column
+        // or on the last row.
+        if(kBegin < kEnd) {
+            if(j == n1) {
+                for(int32_t k=kBegin; k<kEnd; k++) {
+                    if(current[k] > bestScore) {
+                        bestScore = current[k];
+                        bestX = j + bandMin + k;
+                        bestY = j;
+                    }
+                }
+            } else if(j + bandMin + kEnd - 1 == n0) {
+                const int32_t k = kEnd - 1;
+                if(current[k] > bestScore) {
+                    bestScore = current[k];
+                    bestX = n0;
+                    bestY = j;
+                }
+            }
         }
+
+        swap(previous, current);
     }
 
-    TStringSet sequencesSet;
-    appendValue(sequencesSet, sequences[0]);
-    appendValue(sequencesSet, sequences[1]);
-
-    // Compute the banded alignment.
-    TAlignGraph graph(sequencesSet);
-    const int score = globalAlignment(
-        graph,
-        Score<int, Simple>(matchScore, mismatchScore, gapScore),
-        AlignConfig<true, true, true, true>(),
-        bandMin, bandMax,
-        LinearGaps());
-    if(score == seqan::MinValue<int>::VALUE) {
-        cout << "SeqAn banded alignment computation failed." << endl;
+    if(bestScore == minusInfinity) {
+        cout << "Banded alignment computation failed." << endl;
         return false;
     } else if(debug) {
-        cout << "Alignment score is " << score << endl;
+        cout << "Alignment score is " << bestScore << endl;
     }
 
-    TSequence align;
-    convertAlignment(graph, align);
-    const int totalAlignmentLength = int(seqan::length(align));
-    SHASTA_ASSERT((totalAlignmentLength % 2) == 0);    // Because we are aligning two sequences.
-    const int alignmentLength = totalAlignmentLength / 2;
-    if(debug) {
-        cout << "Alignment length " << alignmentLength << endl;
-    }
 
 
-    // Fill in the marker alignment.
+    // Traceback, storing the aligned markers in reverse order.
     alignment.clear();
-    uint32_t ordinal0 = 0;
-    uint32_t ordinal1 = 0;
-    for(int i=0;
-        i<alignmentLength and ordinal0<nx and ordinal1<ny; i++) {
-        if( align[i] != seqanGapValue and
-            align[i + alignmentLength] != seqanGapValue and
-            compressedMarkers[0][ordinal0].kmerId == compressedMarkers[1][ordinal1].kmerId) {
-            alignment.ordinals.push_back(array<uint32_t, 2>{ordinal0, ordinal1});
-        }
-        if(align[i] != seqanGapValue) {
-            ++ordinal0;
-        }
-        if(align[i + alignmentLength] != seqanGapValue) {
-            ++ordinal1;
+    int32_t i = bestX;
+    int32_t j = bestY;
+    while(i > 0 and j > 0) {
+        const uint8_t move = traceback[uint64_t(j) * uint64_t(bandWidth) + uint64_t(i - j - bandMin)];
+        if(move == start) {
+            break;
+        } else if(move == diagonal) {
+            --i;
+            --j;
+            if(x[i] == y[j]) {
+                alignment.ordinals.push_back(array<uint32_t, 2>{uint32_t(i), uint32_t(j)});
+            }
+        } else if(move == up) {
+            --j;
+        } else {
+            SHASTA_ASSERT(move == left);
+            --i;
         }
     }
+    reverse(alignment.ordinals.begin(), alignment.ordinals.end());
 
     // Create the AlignmentInfo.
     alignmentInfo.create(alignment, nx, ny);
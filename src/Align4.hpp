@@ -185,26 +185,49 @@ private:
 
 
 
-    // Cells in (X,Y) space.
-    // Stored similarly to alignmentMatrix above: for each iY,
-    // we store pairs (iX, Cell) sorted by iX.
-    class Cell {
+    // Cells in (X,Y) space, stored in a flat compressed sparse row layout by iY.
+    // The cells with a given iY have ids cellRowBegin[iY]
+    // through cellRowBegin[iY+1]-1, in order of increasing iX.
+    // The cell flags are stored as dense bitsets indexed by cell id.
+    vector<uint32_t> cellRowBegin;
+    vector<uint32_t> cellX;     // Indexed by cell id.
+    vector<uint32_t> cellY;     // Indexed by cell id.
+    static const uint32_t invalidCellId = std::numeric_limits<uint32_t>::max();
+    uint32_t cellCount() const
+    {
+        return uint32_t(cellX.size());
+    }
+
+    class CellBitset {
     public:
-        uint8_t isNearLeftOrTop         : 1;
-        uint8_t isNearRightOrBottom     : 1;
-        uint8_t isForwardAccessible     : 1;
-        uint8_t isBackwardAccessible    : 1;
-        Cell()
+        void clear(uint64_t n)
+        {
+            words.assign((n + 63) / 64, 0);
+        }
+        bool operator[](uint32_t i) const
         {
-            *reinterpret_cast<uint8_t*>(this) = 0;
+            return (words[i >> 6] >> (i & 63)) & 1;
         }
-        bool isActive() const
+        void set(uint32_t i)
         {
-            return (isForwardAccessible == 1) and (isBackwardAccessible == 1);
+            words[i >> 6] |= (1ULL << (i & 63));
         }
+    private:
+        vector<uint64_t> words;
     };
-    static_assert(sizeof(Cell)==1, "Unexpected size of Align5::Aligner::Cell.");
-    vector< vector< pair<uint32_t, Cell> > > cells;
+    CellBitset isNearLeftOrTop;
+    CellBitset isNearRightOrBottom;
+    CellBitset isForwardAccessible;
+    CellBitset isBackwardAccessible;
+    bool isActive(uint32_t cellId) const
+    {
+        return isForwardAccessible[cellId] and isBackwardAccessible[cellId];
+    }
+
+    // The ids of the active cells, sorted.
+    // This is filled in by backwardSearch.
+    vector<uint32_t> activeCellIds;
+
     void createCells(
         uint64_t minEntryCountPerCell,
         uint64_t maxDistanceFromBoundary);
@@ -231,9 +254,9 @@ private:
     // is partially or entirely below that boundary.
     uint32_t cellDistanceFromBottom(const Coordinates& iXY) const;
 
-    // Find a cell with given (iX,iY).
-    Cell* findCell(const Coordinates& iXY);
-    const Cell* findCell(const Coordinates& iXY) const;
+    // Find the id of the cell with given (iX,iY),
+    // or invalidCellId if there is no such cell.
+    uint32_t findCell(const Coordinates& iXY) const;
 
 
 
@@ -265,9 +288,15 @@ private:
     SignedCoordinates getxy(Coordinates XY) const;
 
     // Searches in cell space.
+    // These only visit cells that are reachable from the starting cells,
+    // which is typically a small fraction of all cells.
     void forwardSearch();
     void backwardSearch();
 
+    // Find the ids of the cells with iX and iX+1 in row iY.
+    // Each of the two returned ids can be invalidCellId.
+    array<uint32_t, 2> findCellPair(uint32_t iX, uint32_t iY) const;
+
 
 
     // Group active cells in connected component.
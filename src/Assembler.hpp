@@ -13,6 +13,7 @@
 #include "MultithreadedObject.hpp"
 #include "ReadGraph.hpp"
 #include "ReadId.hpp"
+#include "SparseKmerTable.hpp"
 #include "shastaTypes.hpp"
 
 // Standard library.
@@ -38,6 +39,7 @@ namespace shasta {
     class ConsensusCaller;
     class Histogram2;
     class InducedAlignment;
+    class KmerCounter;
     class LocalAssemblyGraph;
     class LocalAlignmentCandidateGraph;
     class LocalAlignmentGraph;
@@ -52,6 +54,7 @@ namespace shasta {
     class OrientedReadPair;
     class Reads;
     class ReferenceOverlapMap;
+    template<class T> class ExternalSortRuns;
 
 
     namespace MemoryMapped {
@@ -180,6 +183,10 @@ public:
     inline string peakMemoryUsageForSummaryStats() {
         return peakMemoryUsage > 0 ? to_string(peakMemoryUsage) : "Not determined.";
     }
+
+    // If set, the marker k-mers are stored in the sparse k-mer table
+    // and the dense k-mer table is not created.
+    bool useSparseKmerTable = false;
 };
 
 
@@ -217,6 +224,7 @@ public:
         const string& fileName,
         uint64_t minReadLength,
         bool noCache,
+        uint64_t streamingChunkSize,
         size_t threadCount);
 
     // Create a histogram of read lengths.
@@ -227,6 +235,7 @@ public:
     // See the beginning of Marker.hpp for more information.
     void findMarkers(size_t threadCount);
     void accessMarkers();
+    void createMarkerIdSampledToc();
     void writeMarkers(ReadId, Strand, const string& fileName);
     vector<KmerId> getMarkers(ReadId, Strand);
     void writeMarkerFrequency();
@@ -300,6 +309,13 @@ public:
         double peakFinderMinAreaFraction,
         uint64_t peakFinderAreaStartIndex,
 
+        // If not zero, the marker graph vertices are created out of core,
+        // using sorted runs on disk. This many gigabytes bound the
+        // sort and merge buffers only. The disjoint set table,
+        // the markers, and the marker graph vertices remain resident.
+        // Experimental.
+        uint64_t externalSortBufferGigabytes,
+
         // Number of threads. If zero, a number of threads equal to
         // the number of virtual processors is used.
         size_t threadCount
@@ -348,11 +364,37 @@ public:
     // strand symmetric when this ends.
     // To achieve this, we always process the two edges
     // in a reverse complemented pair together.
+    // The searches for edges with the same coverage run in parallel,
+    // with results identical to processing the edges sequentially.
     void transitiveReduction(
         size_t lowCoverageThreshold,
         size_t highCoverageThreshold,
         size_t maxDistance,
-        size_t edgeMarkerSkipThreshold);
+        size_t edgeMarkerSkipThreshold,
+        size_t threadCount);
+private:
+    class TransitiveReductionBfsData;
+    bool transitiveReductionBfs(
+        MarkerGraph::EdgeId,
+        uint64_t maxDistance,
+        TransitiveReductionBfsData&,
+        vector<MarkerGraph::EdgeId>* usedEdges) const;
+    void transitiveReductionThreadFunction(size_t threadId);
+    class TransitiveReductionData {
+    public:
+        uint64_t maxDistance;
+
+        // The edges being processed speculatively in parallel,
+        // in the order in which they are processed sequentially.
+        const MarkerGraph::EdgeId* windowEdges;
+
+        // For each edge in the window, a flag set if the speculative
+        // search found a path, and the edges used by the speculative search.
+        vector<uint8_t> found;
+        vector< vector<MarkerGraph::EdgeId> > usedEdges;
+    };
+    TransitiveReductionData transitiveReductionData;
+public:
 
 
 
@@ -442,6 +484,27 @@ private:
     MemoryMapped::Vector<KmerInfo> kmerTable;
     void checkKmersAreOpen() const;
 
+    // The sparse k-mer table only stores the marker k-mers.
+    // It is used instead of the dense k-mer table
+    // if assemblerInfo->useSparseKmerTable is set.
+    // In that case, the KmerId stored in a marker is the index
+    // of its k-mer in the sparse k-mer table.
+    SparseKmerTable sparseKmerTable;
+
+    // Functions that work with either the dense or the sparse k-mer table.
+    bool isMarkerKmer(KmerId) const;
+    uint32_t getKmerHash(KmerId) const;
+    void getMarkerKmerIds(vector<KmerId>&) const;
+    void countRleKmers(uint64_t& totalRleKmerCount, uint64_t& markerRleKmerCount) const;
+
+    // Return the k-mer corresponding to the KmerId stored in a marker.
+    Kmer64 getKmer(KmerId) const;
+
+    // Return the sparse k-mer table if it is in use, or 0 otherwise.
+    // This is passed to code outside the Assembler that needs
+    // to get the k-mers of markers. See getMarkerKmer.
+    const SparseKmerTable* getSparseKmerTable() const;
+
 public:
     void accessKmers();
     void writeKmers(const string& fileName) const;
@@ -569,10 +632,72 @@ private:
 public:
     void readKmersFromFile(uint64_t k, const string& fileName);
 
+
+
+    // Versions of randomlySelectKmers, selectKmersBasedOnFrequency,
+    // and readKmersFromFile that store the marker k-mers
+    // in the sparse k-mer table. Memory usage is proportional
+    // to the number of marker k-mers rather than to 4^k,
+    // and k can be up to maxSparseKmerLength.
+    // randomlySelectKmersSparse and selectKmersBasedOnFrequencySparse
+    // only consider k-mers that occur in the reads.
+    void randomlySelectKmersSparse(
+        size_t k,
+        double probability,
+        int seed,
+        size_t threadCount);
+    void selectKmersBasedOnFrequencySparse(
+        size_t k,
+        double markerDensity,
+        int seed,
+        double enrichmentThreshold,
+        size_t threadCount);
+    void readKmersFromFileSparse(uint64_t k, const string& fileName);
+
 private:
     void computeKmerFrequency(size_t threadId);
     void initializeKmerTable();
 
+    // Used to count k-mer occurrences in selectKmersBasedOnFrequency,
+    // selectKmers2, and selectKmers4.
+    shared_ptr<KmerCounter> kmerCounter;
+
+    void createSparseKmerTable(size_t k, vector<KmerId64>& markerKmerIds);
+
+    // Data and thread functions used by randomlySelectKmersSparse
+    // and selectKmersBasedOnFrequencySparse.
+    // Frequencies are only computed for a random pool of candidate k-mers,
+    // stored in a temporary sparse k-mer table.
+    class SelectKmersSparseData {
+    public:
+
+        // Used by collectSparseKmers.
+        // A k-mer is collected if the hash of the smaller of the KmerId64
+        // of the k-mer and of its reverse complement is at most hashThreshold.
+        uint64_t hashThreshold;
+        uint64_t seed;
+        vector<KmerId64> collectedKmerIds;
+
+        SparseKmerTable candidates;
+
+        // The number of occurrences of each candidate k-mer in reads,
+        // indexed by the index of the candidate in the candidates table.
+        // Only occurrences on strand 0 are counted.
+        MemoryMapped::Vector<uint64_t> occurrenceCount;
+
+        // The total number of k-mer positions in all reads.
+        uint64_t kmerPositionCount;
+    };
+    SelectKmersSparseData selectKmersSparseData;
+    void collectSparseKmers(
+        uint64_t k,
+        double fraction,
+        int seed,
+        size_t threadCount,
+        vector<KmerId64>&);
+    void collectSparseKmersThreadFunction(size_t threadId);
+    void computeSparseKmerFrequency(size_t threadId);
+
 
 
     // The markers on all oriented reads. Indexed by OrientedReadId::getValue().
@@ -599,12 +724,14 @@ private:
 
     // Inverse of the above: given a global marker id,
     // return its OrientedReadId and ordinal.
-    // This requires a binary search in the markers toc.
-    // This could be avoided, at the cost of storing
-    // an additional 4 bytes per marker.
+    // If the sampled markers toc is available,
+    // this only searches the few oriented reads that overlap
+    // the block containing the MarkerId (see findMarkerId.hpp).
+    // Otherwise, it requires a binary search in the entire markers toc.
 public:
     pair<OrientedReadId, uint32_t> findMarkerId(MarkerId) const;
 private:
+    MemoryMapped::Vector<OrientedReadId::Int> markerIdSampledToc;
 
 
 
@@ -704,6 +831,8 @@ public:
         size_t minBucketSize,           // The minimum size for a bucket to be used.
         size_t maxBucketSize,           // The maximum size for a bucket to be used.
         size_t minFrequency,            // Minimum number of lowHash hits for a pair to become a candidate.
+        bool hashAllIterationsInOnePass,// Compute the low hashes for all iterations in a single pass.
+        const string& checkpointDirectory, // If not empty, store common features in a checkpoint there.
         size_t threadCount
     );
     void markAlignmentCandidatesAllPairs();
@@ -970,24 +1099,40 @@ private:
     // The alignment table stores the AlignmentData that each oriented read is involved in.
     // Stores, for each OrientedReadId, a vector of indexes into the alignmentData vector.
     // Indexed by OrientedReadId::getValue(),
-    MemoryMapped::VectorOfVectors<uint32_t, uint32_t> alignmentTable;
-    void computeAlignmentTable();
+    // The indexes are 64 bits, so the number of alignments is not limited to 2^32.
+    MemoryMapped::VectorOfVectors<uint64_t, uint64_t> alignmentTable;
+    void computeAlignmentTable(size_t threadCount);
+    void computeAlignmentTableThreadFunction1(size_t threadId);
+    void computeAlignmentTableThreadFunction2(size_t threadId);
+    void computeAlignmentTableThreadFunction3(size_t threadId);
 
 
 
     // Private functions and data used by computeAlignments.
     void computeAlignmentsThreadFunction(size_t threadId);
+
+    // Cheap screening of an alignment candidate, used before computing
+    // the alignment if alignOptions.diagonalScreenBandWidth is not zero.
+    // Pairs of common markers are binned by diagonal (ordinal0 - ordinal1)
+    // and the candidate passes the screen if two adjacent bins
+    // of width bandWidth contain at least minAlignedMarkerCount pairs.
+    // The histogram vector is passed in to avoid memory allocation.
+    static bool passesDiagonalScreen(
+        const array<span< const pair<KmerId, uint32_t> >, 2>& orientedReadSortedMarkers,
+        uint64_t bandWidth,
+        uint64_t minAlignedMarkerCount,
+        vector<uint64_t>& histogram);
+
     class ComputeAlignmentsData {
     public:
 
         // Not owned.
         const AlignOptions* alignOptions = 0;
 
-        // The AlignmentInfo found by each thread.
-        vector< vector<AlignmentData> > threadAlignmentData;
-
-        // Compressed alignments corresponding to the AlignmentInfo found by each thread.
-        vector< shared_ptr< MemoryMapped::VectorOfVectors<char, uint64_t> > > threadCompressedAlignments;
+        // The number of alignment candidates accepted and rejected
+        // by the diagonal screen in each thread.
+        vector<uint64_t> threadScreenAcceptedCount;
+        vector<uint64_t> threadScreenRejectedCount;
     };
     ComputeAlignmentsData computeAlignmentsData;
 
@@ -1234,6 +1379,25 @@ private:
     void createMarkerGraphVerticesThreadFunction45(int);
     void createMarkerGraphVerticesThreadFunction6(size_t threadId);
     void createMarkerGraphVerticesThreadFunction7(size_t threadId);
+    void createMarkerGraphVerticesThreadFunction8(size_t threadId);
+    void createMarkerGraphVerticesThreadFunction9(size_t threadId);
+    void createMarkerGraphVerticesThreadFunction10(size_t threadId);
+    void createMarkerGraphVerticesThreadFunction11(size_t threadId);
+    uint64_t createMarkerGraphVerticesRenumber(uint64_t n, uint64_t batchSize, size_t threadCount);
+    uint64_t createMarkerGraphVerticesSelectMinCoverage(
+        const vector<uint64_t>& histogram,
+        uint64_t minCoverage,
+        double peakFinderMinAreaFraction,
+        uint64_t peakFinderAreaStartIndex);
+    bool createMarkerGraphVerticesIsBadDisjointSet(span<const MarkerId>) const;
+    void createMarkerGraphVerticesExternal(
+        uint64_t minCoverage,
+        uint64_t maxCoverage,
+        double peakFinderMinAreaFraction,
+        uint64_t peakFinderAreaStartIndex,
+        uint64_t sortBufferBytes,
+        size_t threadCount);
+    void createMarkerGraphVerticesThreadFunction12(size_t threadId);
     void createMarkerGraphVerticesDebug1(uint64_t stage);
     class CreateMarkerGraphVerticesData {
     public:
@@ -1262,6 +1426,26 @@ private:
         // Flag disjoint sets that contain more than one marker on the same oriented read.
         MemoryMapped::Vector<bool> isBadDisjointSet;
 
+        // The first entry of data.disjointSetTable processed
+        // by the current round of createMarkerGraphVerticesThreadFunction21.
+        uint64_t compactionBegin;
+
+        // Used by createMarkerGraphVerticesRenumber.
+        // If renumberUsingBadFlags is false, disjoint sets are kept
+        // if their size is in [renumberMinCoverage, renumberMaxCoverage].
+        // Otherwise, they are kept if they are not flagged in isBadDisjointSet.
+        bool renumberUsingBadFlags;
+        uint64_t renumberMinCoverage;
+        uint64_t renumberMaxCoverage;
+        uint64_t renumberBatchSize;
+        vector<uint64_t> renumberBatchOffsets;
+
+        // Used by createMarkerGraphVerticesExternal.
+        // Each run contains pairs (disjoint set, marker) sorted by disjoint set,
+        // then by marker, for a contiguous range of markers.
+        uint64_t externalRunMarkerCount;
+        shared_ptr< ExternalSortRuns< pair<MarkerGraph::VertexId, MarkerId> > > externalRuns;
+
     };
     CreateMarkerGraphVerticesData createMarkerGraphVerticesData;
 
@@ -1374,6 +1558,7 @@ private:
     void createMarkerGraphEdgesThreadFunction0(size_t threadId);
     void createMarkerGraphEdgesThreadFunction1(size_t threadId);
     void createMarkerGraphEdgesThreadFunction2(size_t threadId);
+    void createMarkerGraphEdgesThreadFunction3(size_t threadId);
     void createMarkerGraphEdgesThreadFunction12(size_t threadId, size_t pass);
     void createMarkerGraphEdgesBySourceAndTarget(size_t threadCount);
     class CreateMarkerGraphEdgesData {
@@ -1794,6 +1979,7 @@ private:
     void computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
         MarkerGraphEdgeId,
         uint32_t markerGraphEdgeLengthThresholdForConsensus,
+        double edgeConsensusMajorityFraction,
         const std::unique_ptr<spoa::AlignmentEngine>& spoaAlignmentEngine,
         const std::unique_ptr<spoa::Graph>& spoaAlignmentGraph,
         vector<Base>& sequence,
@@ -1998,6 +2184,11 @@ public:
         // This controls when we give up trying to compute consensus for long edges.
         uint32_t markerGraphEdgeLengthThresholdForConsensus,
 
+        // If the most frequent intervening sequence of an edge is present in at least
+        // this fraction of its marker intervals, it is used as consensus without spoa.
+        // With 1, this only happens when all intervening sequences are identical.
+        double edgeConsensusMajorityFraction,
+
         // Request storing detailed coverage information in binary format.
         bool storeCoverageData,
 
@@ -2012,6 +2203,7 @@ private:
         // The arguments to assembleMarkerGraphEdges, stored here so
         // they are accessible to the threads.
         uint32_t markerGraphEdgeLengthThresholdForConsensus;
+        double edgeConsensusMajorityFraction;
         bool storeCoverageData;
         bool assembleAllEdges;
 
@@ -2060,15 +2252,32 @@ public:
 
 
     // Assemble sequence for all edges of the assembly graph.
+    // If computeEdgeConsensus is set, consensus for the marker graph edges
+    // of each assembly graph edge is computed on the fly,
+    // using markerGraphEdgeLengthThresholdForConsensus and
+    // edgeConsensusMajorityFraction (see assembleMarkerGraphEdges).
+    // In that case assembleMarkerGraphEdges does not need to be called,
+    // but consensus for marker graph edges is not stored
+    // and will not be available in the http server.
     void assemble(
         size_t threadCount,
-        uint32_t storeCoverageDataCsvLengthThreshold);
+        uint32_t storeCoverageDataCsvLengthThreshold,
+        bool computeEdgeConsensus,
+        uint32_t markerGraphEdgeLengthThresholdForConsensus,
+        double edgeConsensusMajorityFraction);
     void accessAssemblyGraphSequences();
     void computeAssemblyStatistics();
 private:
     class AssembleData {
     public:
         uint32_t storeCoverageDataCsvLengthThreshold;
+        bool computeEdgeConsensus;
+        uint32_t markerGraphEdgeLengthThresholdForConsensus;
+        double edgeConsensusMajorityFraction;
+
+        // The assembly graph edges to be assembled, in order of
+        // decreasing number of marker graph edges, for better load balancing.
+        vector<AssemblyGraphEdgeId> edgesToBeAssembled;
 
         // The results created by each thread.
         // All indexed by threadId.
@@ -2101,8 +2310,9 @@ public:
 
     // Write the assembly graph in GFA 1.0 format defined here:
     // https://github.com/GFA-spec/GFA-spec/blob/master/GFA1.md
-    void writeGfa1(const string& fileName);
-    void writeGfa1BothStrands(const string& fileName);
+    // If the file name ends in ".gz", the output is bgzip-compressed.
+    void writeGfa1(const string& fileName, size_t threadCount);
+    void writeGfa1BothStrands(const string& fileName, size_t threadCount);
     void writeGfa1BothStrandsNoSequence(const string& fileName);
 private:
     // Construct the CIGAR string given two vectors of repeat counts.
@@ -2116,7 +2326,8 @@ private:
 public:
 
     // Write assembled sequences in FASTA format.
-    void writeFasta(const string& fileName);
+    // If the file name ends in ".gz", the output is bgzip-compressed.
+    void writeFasta(const string& fileName, size_t threadCount);
 
 
 
@@ -233,8 +233,9 @@ void Assembler::computeAlignments(
         threadCount = std::thread::hardware_concurrency();
     }
 
-    // For alignment method 4, compute sorted markers.
-    if(alignOptions.alignMethod == 4) {
+    // For alignment method 4 and for the diagonal screen, compute sorted markers.
+    const bool useScreen = (alignOptions.diagonalScreenBandWidth > 0);
+    if(alignOptions.alignMethod == 4 or useScreen) {
         cout << timestamp << "Computing sorted markers." << endl;
         computeSortedMarkers(threadCount);
     }
@@ -250,50 +251,43 @@ void Assembler::computeAlignments(
 
 
     // Compute the alignments.
-    data.threadAlignmentData.resize(threadCount);
-    data.threadCompressedAlignments.resize(threadCount);
-    
+    // Each thread stores the good alignments it finds directly
+    // in alignmentData and compressedAlignments.
+    alignmentData.createNew(largeDataName("AlignmentData"), largeDataPageSize);
+    compressedAlignments.createNew(largeDataName("CompressedAlignments"), largeDataPageSize);
+    data.threadScreenAcceptedCount.assign(threadCount, 0);
+    data.threadScreenRejectedCount.assign(threadCount, 0);
+
     performanceLog << timestamp << "Alignment computation begins." << endl;
     setupLoadBalancing(alignmentCandidates.candidates.size(), batchSize);
     runThreads(&Assembler::computeAlignmentsThreadFunction, threadCount);
     performanceLog << timestamp << "Alignment computation completed." << endl;
-
-    // Store the alignments found by each thread.
-    performanceLog << timestamp << "Storing the alignment found by each thread." << endl;
-    alignmentData.createNew(largeDataName("AlignmentData"), largeDataPageSize);
-    compressedAlignments.createNew(largeDataName("CompressedAlignments"), largeDataPageSize);
-    
-    for(size_t threadId=0; threadId<threadCount; threadId++) {
-        const vector<AlignmentData>& threadAlignmentData = data.threadAlignmentData[threadId];
-        for(const AlignmentData& ad: threadAlignmentData) {
-            alignmentData.push_back(ad);
+    if(useScreen) {
+        uint64_t acceptedCount = 0;
+        uint64_t rejectedCount = 0;
+        for(size_t threadId=0; threadId<threadCount; threadId++) {
+            acceptedCount += data.threadScreenAcceptedCount[threadId];
+            rejectedCount += data.threadScreenRejectedCount[threadId];
         }
-
-        const auto threadCompressedAlignments = data.threadCompressedAlignments[threadId];
-        const auto size = threadCompressedAlignments->size();
-        for(size_t i=0; i<size; i++) {
-            compressedAlignments.appendVector(
-                (*threadCompressedAlignments)[i].begin(),
-                (*threadCompressedAlignments)[i].end()
-            );
-        }
-
-        // Clean up thread storage.
-        data.threadCompressedAlignments[threadId]->remove();
+        performanceLog << "Diagonal screen with band width " <<
+            alignOptions.diagonalScreenBandWidth << " accepted " << acceptedCount <<
+            " and rejected " << rejectedCount << " alignment candidates." << endl;
+        cout << "The diagonal screen rejected " << rejectedCount <<
+            " of " << acceptedCount + rejectedCount << " alignment candidates." << endl;
     }
 
     // Release unused allocated memory.
     alignmentData.unreserve();
     compressedAlignments.unreserve();
 
-    // For alignment method 4, remove the sorted markers.
-    if(alignOptions.alignMethod == 4) {
+    // Remove the sorted markers, if we computed them.
+    if(alignOptions.alignMethod == 4 or useScreen) {
         sortedMarkers.remove();
     }
 
     cout << "Found and stored " << alignmentData.size() << " good alignments." << endl;
     performanceLog << timestamp << "Creating alignment table." << endl;
-    computeAlignmentTable();
+    computeAlignmentTable(threadCount);
 
     const auto tEnd = steady_clock::now();
     const double tTotal = seconds(tEnd - tBegin);
@@ -331,6 +325,10 @@ void Assembler::computeAlignmentsThreadFunction(size_t threadId)
     const int bandExtend = data.alignOptions->bandExtend;
     const int maxBand = data.alignOptions->maxBand;
     const bool suppressContainments = data.alignOptions->suppressContainments;
+    const uint64_t diagonalScreenBandWidth = data.alignOptions->diagonalScreenBandWidth;
+    vector<uint64_t> diagonalHistogram;
+    uint64_t& screenAcceptedCount = data.threadScreenAcceptedCount[threadId];
+    uint64_t& screenRejectedCount = data.threadScreenRejectedCount[threadId];
 
 
     // Align4-specific items.
@@ -355,15 +353,11 @@ void Assembler::computeAlignmentsThreadFunction(size_t threadId)
             largeDataPageSize, 2ULL * 1024 * 1024 * 1024);
     }
 
-    vector<AlignmentData>& threadAlignmentData = data.threadAlignmentData[threadId];
-    
-    shared_ptr< MemoryMapped::VectorOfVectors<char, uint64_t> > thisThreadCompressedAlignmentsPointer =
-        make_shared< MemoryMapped::VectorOfVectors<char, uint64_t> >();
-    data.threadCompressedAlignments[threadId] = thisThreadCompressedAlignmentsPointer;
-    auto& thisThreadCompressedAlignments = *thisThreadCompressedAlignmentsPointer;
-    thisThreadCompressedAlignments.createNew(
-        largeDataName("tmp-ThreadGlobalCompressedAlignments-" + to_string(threadId)),
-        largeDataPageSize);
+    // The good alignments found in the current batch.
+    // At the end of each batch they are appended to alignmentData
+    // and compressedAlignments, which is their final storage.
+    vector<AlignmentData> batchAlignmentData;
+    vector<string> batchCompressedAlignments;
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
@@ -381,6 +375,19 @@ void Assembler::computeAlignmentsThreadFunction(size_t threadId)
             orientedReadIds[0] = OrientedReadId(candidate.readIds[0], 0);
             orientedReadIds[1] = OrientedReadId(candidate.readIds[1], candidate.isSameStrand ? 0 : 1);
 
+            // If requested, screen this candidate before computing its alignment.
+            if(diagonalScreenBandWidth > 0) {
+                array<span< const pair<KmerId, uint32_t> >, 2> orientedReadSortedMarkers;
+                orientedReadSortedMarkers[0] = std::as_const(sortedMarkers)[orientedReadIds[0].getValue()];
+                orientedReadSortedMarkers[1] = std::as_const(sortedMarkers)[orientedReadIds[1].getValue()];
+                if(passesDiagonalScreen(orientedReadSortedMarkers,
+                    diagonalScreenBandWidth, minAlignedMarkerCount, diagonalHistogram)) {
+                    ++screenAcceptedCount;
+                } else {
+                    ++screenRejectedCount;
+                    continue;
+                }
+            }
 
 
             // Compute the alignment.
@@ -473,15 +480,26 @@ void Assembler::computeAlignmentsThreadFunction(size_t threadId)
 
             // If getting here, this is a good alignment.
             // cout << orientedReadIds[0] << " " << orientedReadIds[1] << " good." << endl;
-            threadAlignmentData.push_back(AlignmentData(candidate, alignmentInfo));
+            batchAlignmentData.push_back(AlignmentData(candidate, alignmentInfo));
 
-            // Store the alignment in compressed form.
+            // Also keep the alignment in compressed form.
             shasta::compress(alignment, compressedAlignment);
-            thisThreadCompressedAlignments.appendVector(
-                compressedAlignment.c_str(),
-                compressedAlignment.c_str() + compressedAlignment.size()
-            );
+            batchCompressedAlignments.push_back(compressedAlignment);
+        }
+
+        // Store the good alignments found in this batch.
+        // A batch takes much longer to compute than to store,
+        // so contention for the mutex is negligible.
+        if(not batchAlignmentData.empty()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(uint64_t j=0; j<batchAlignmentData.size(); j++) {
+                alignmentData.push_back(batchAlignmentData[j]);
+                const string& s = batchCompressedAlignments[j];
+                compressedAlignments.appendVector(s.begin(), s.end());
+            }
         }
+        batchAlignmentData.clear();
+        batchCompressedAlignments.clear();
     }
 
     if(alignmentMethod == 4) {
@@ -490,8 +508,85 @@ void Assembler::computeAlignmentsThreadFunction(size_t threadId)
             byteAllocator.getMaxAllocatedByteCount() << "/" <<
             2ULL * 1024 * 1024 * 1024 << endl;
     }
+}
+
+
+
+// Cheap screening of an alignment candidate, used before computing
+// the alignment if alignOptions.diagonalScreenBandWidth is not zero.
+// This does a joint loop over the markers of the two oriented reads
+// sorted by KmerId and bins the pairs of common markers
+// by diagonal (ordinal0 - ordinal1).
+// Each aligned marker of an alignment corresponds to one of these pairs.
+// If no two adjacent bins contain at least minAlignedMarkerCount pairs,
+// it is unlikely that an alignment with at least minAlignedMarkerCount
+// markers exists. This is only a heuristic, because
+// an alignment can drift across more than two bins.
+bool Assembler::passesDiagonalScreen(
+    const array<span< const pair<KmerId, uint32_t> >, 2>& orientedReadSortedMarkers,
+    uint64_t bandWidth,
+    uint64_t minAlignedMarkerCount,
+    vector<uint64_t>& histogram)
+{
+    const auto begin0 = orientedReadSortedMarkers[0].begin();
+    const auto begin1 = orientedReadSortedMarkers[1].begin();
+    const auto end0 = orientedReadSortedMarkers[0].end();
+    const auto end1 = orientedReadSortedMarkers[1].end();
+
+    // If one of the reads has too few markers, there is nothing to check.
+    const uint64_t n0 = orientedReadSortedMarkers[0].size();
+    const uint64_t n1 = orientedReadSortedMarkers[1].size();
+    if(min(n0, n1) < minAlignedMarkerCount) {
+        return false;
+    }
 
-    thisThreadCompressedAlignments.unreserve();
+    // The diagonal of a pair (ordinal0, ordinal1) is shifted by n1-1
+    // to make it non-negative.
+    histogram.assign((n0 + n1 - 1) / bandWidth + 2, 0);
+
+    // Joint loop over the sorted markers, looking for common markers.
+    auto it0 = begin0;
+    auto it1 = begin1;
+    while(it0!=end0 && it1!=end1) {
+        if(it0->first < it1->first) {
+            ++it0;
+        } else if(it1->first < it0->first) {
+            ++it1;
+        } else {
+
+            // We found a common KmerId. Find the streak of this KmerId
+            // in each of the two oriented reads.
+            const KmerId kmerId = it0->first;
+            auto it0End = it0;
+            auto it1End = it1;
+            while(it0End!=end0 && it0End->first == kmerId) {
+                ++it0End;
+            }
+            while(it1End!=end1 && it1End->first == kmerId) {
+                ++it1End;
+            }
+
+            // Loop over pairs in the streaks.
+            for(auto jt0=it0; jt0!=it0End; ++jt0) {
+                const uint64_t shiftedOrdinal0 = jt0->second + n1 - 1;
+                for(auto jt1=it1; jt1!=it1End; ++jt1) {
+                    ++histogram[(shiftedOrdinal0 - jt1->second) / bandWidth];
+                }
+            }
+
+            // Continue the joint loop over KmerId's.
+            it0 = it0End;
+            it1 = it1End;
+        }
+    }
+
+    // Look for two adjacent bins with enough pairs.
+    for(uint64_t i=1; i<histogram.size(); i++) {
+        if(histogram[i-1] + histogram[i] >= minAlignedMarkerCount) {
+            return true;
+        }
+    }
+    return false;
 }
 
 
@@ -505,52 +600,96 @@ void Assembler::accessCompressedAlignments()
 
 
 // Compute alignmentTable from alignmentData.
-// This could be made multithreaded if it becomes a bottleneck.
-void Assembler::computeAlignmentTable()
+void Assembler::computeAlignmentTable(size_t threadCount)
 {
-    alignmentTable.createNew(largeDataName("AlignmentTable"), largeDataPageSize);
-    alignmentTable.beginPass1(ReadId(2 * reads->readCount()));
-    for(const AlignmentData& ad: alignmentData) {
-        const auto& readIds = ad.readIds;
-        OrientedReadId orientedReadId0(readIds[0], 0);
-        OrientedReadId orientedReadId1(readIds[1], ad.isSameStrand ? 0 : 1);
-        alignmentTable.incrementCount(orientedReadId0.getValue());
-        alignmentTable.incrementCount(orientedReadId1.getValue());
-        orientedReadId0.flipStrand();
-        orientedReadId1.flipStrand();
-        alignmentTable.incrementCount(orientedReadId0.getValue());
-        alignmentTable.incrementCount(orientedReadId1.getValue());
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
     }
+
+    alignmentTable.createNew(largeDataName("AlignmentTable"), largeDataPageSize);
+    alignmentTable.beginPass1(2 * reads->readCount());
+    const uint64_t alignmentBatchSize = 100000;
+    setupLoadBalancing(alignmentData.size(), alignmentBatchSize);
+    runThreads(&Assembler::computeAlignmentTableThreadFunction1, threadCount);
     alignmentTable.beginPass2();
-    for(uint32_t i=0; i<alignmentData.size(); i++) {
-        const AlignmentData& ad = alignmentData[i];
-        const auto& readIds = ad.readIds;
-        OrientedReadId orientedReadId0(readIds[0], 0);
-        OrientedReadId orientedReadId1(readIds[1], ad.isSameStrand ? 0 : 1);
-        alignmentTable.store(orientedReadId0.getValue(), i);
-        alignmentTable.store(orientedReadId1.getValue(), i);
-        orientedReadId0.flipStrand();
-        orientedReadId1.flipStrand();
-        alignmentTable.store(orientedReadId0.getValue(), i);
-        alignmentTable.store(orientedReadId1.getValue(), i);
-    }
+    setupLoadBalancing(alignmentData.size(), alignmentBatchSize);
+    runThreads(&Assembler::computeAlignmentTableThreadFunction2, threadCount);
     alignmentTable.endPass2();
 
+    // Sort each section of the alignment table by OrientedReadId.
+    // This also makes the result independent of the order
+    // in which the threads stored the alignment indexes.
+    const uint64_t orientedReadBatchSize = 1000;
+    setupLoadBalancing(alignmentTable.size(), orientedReadBatchSize);
+    runThreads(&Assembler::computeAlignmentTableThreadFunction3, threadCount);
+
+    alignmentTable.unreserve();
+}
+
 
 
-    // Sort each section of the alignment table by OrientedReadId.
-    vector< pair<OrientedReadId, uint32_t> > v;
-    for(ReadId readId0=0; readId0<reads->readCount(); readId0++) {
-        for(Strand strand0=0; strand0<2; strand0++) {
-            const OrientedReadId orientedReadId0(readId0, strand0);
+// Pass 1 of computeAlignmentTable: count the alignments
+// each oriented read is involved in.
+void Assembler::computeAlignmentTableThreadFunction1(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const AlignmentData& ad = alignmentData[i];
+            const auto& readIds = ad.readIds;
+            OrientedReadId orientedReadId0(readIds[0], 0);
+            OrientedReadId orientedReadId1(readIds[1], ad.isSameStrand ? 0 : 1);
+            alignmentTable.incrementCountMultithreaded(orientedReadId0.getValue());
+            alignmentTable.incrementCountMultithreaded(orientedReadId1.getValue());
+            orientedReadId0.flipStrand();
+            orientedReadId1.flipStrand();
+            alignmentTable.incrementCountMultithreaded(orientedReadId0.getValue());
+            alignmentTable.incrementCountMultithreaded(orientedReadId1.getValue());
+        }
+    }
+}
+
+
+
+// Pass 2 of computeAlignmentTable: store the alignment indexes.
+void Assembler::computeAlignmentTableThreadFunction2(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const AlignmentData& ad = alignmentData[i];
+            const auto& readIds = ad.readIds;
+            OrientedReadId orientedReadId0(readIds[0], 0);
+            OrientedReadId orientedReadId1(readIds[1], ad.isSameStrand ? 0 : 1);
+            alignmentTable.storeMultithreaded(orientedReadId0.getValue(), i);
+            alignmentTable.storeMultithreaded(orientedReadId1.getValue(), i);
+            orientedReadId0.flipStrand();
+            orientedReadId1.flipStrand();
+            alignmentTable.storeMultithreaded(orientedReadId0.getValue(), i);
+            alignmentTable.storeMultithreaded(orientedReadId1.getValue(), i);
+        }
+    }
+}
+
+
+
+// Sort each section of the alignment table by OrientedReadId.
+void Assembler::computeAlignmentTableThreadFunction3(size_t threadId)
+{
+    vector< pair<OrientedReadId, uint64_t> > v;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const OrientedReadId orientedReadId0 = OrientedReadId::fromValue(ReadId(i));
 
             // Access the section of the alignment table for this oriented read.
-            const span<uint32_t> alignmentTableSection =
-                alignmentTable[orientedReadId0.getValue()];
+            const span<uint64_t> alignmentTableSection = alignmentTable[i];
 
             // Store pairs(OrientedReadId, alignmentIndex).
             v.clear();
-            for(uint32_t alignmentIndex: alignmentTableSection) {
+            for(const uint64_t alignmentIndex: alignmentTableSection) {
                 const AlignmentData& alignment = alignmentData[alignmentIndex];
                 const OrientedReadId orientedReadId1 = alignment.getOther(orientedReadId0);
                 v.push_back(make_pair(orientedReadId1, alignmentIndex));
@@ -560,14 +699,11 @@ void Assembler::computeAlignmentTable()
             sort(v.begin(), v.end());
 
             // Store the sorted alignmentIndex.
-            for(size_t i=0; i<v.size(); i++) {
-                alignmentTableSection[i] = v[i].second;
+            for(size_t j=0; j<v.size(); j++) {
+                alignmentTableSection[j] = v[j].second;
             }
         }
     }
-
-    alignmentTable.unreserve();
-
 }
 
 
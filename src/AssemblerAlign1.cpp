@@ -88,10 +88,11 @@ void Assembler::alignOrientedReads1(
     bool replacementIsNeeded = false;
     const KmerId seqanGapValue = 45;
     KmerId replacementValue = seqanGapValue;
-    if(kmerTable[seqanGapValue].isMarker) {
+    if(isMarkerKmer(seqanGapValue)) {
         replacementIsNeeded = true;
-        for(uint64_t i=0; i<kmerTable.size(); i++) {
-            if(!kmerTable[i].isMarker) {
+        const uint64_t kmerCount = 1ULL << (2ULL * assemblerInfo->k);
+        for(uint64_t i=0; i<kmerCount; i++) {
+            if(!isMarkerKmer(KmerId(i))) {
                 replacementValue = KmerId(i);
                 break;
             }
@@ -72,7 +72,7 @@ void Assembler::alignOrientedReads3(
     for(uint64_t i=0; i<2; i++) {
         for(uint32_t ordinal=0; ordinal<uint32_t(allMarkers[i].size()); ordinal++) {
             const KmerId kmerId = allMarkers[i][ordinal].kmerId;
-             if(kmerTable[kmerId].hash < hashThreshold) {
+             if(getKmerHash(kmerId) < hashThreshold) {
                 downsampledMarkers[i].push_back(make_pair(ordinal, kmerId));
                 appendValue(downsampledSequences[i], kmerId + 100);
             }
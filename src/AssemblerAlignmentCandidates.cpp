@@ -72,7 +72,7 @@ bool Assembler::createLocalReferenceGraph(
             }
 
             // Search the AlignmentTable to see if this pair exists
-            for (const ReadId alignmentIndex: alignmentTable[orientedReadId0.getValue()]) {
+            for(const uint64_t alignmentIndex: alignmentTable[orientedReadId0.getValue()]) {
                 const AlignmentData& ad = alignmentData[alignmentIndex];
 
                 // Check if the pair matches the current candidate pair of interest
@@ -260,7 +260,7 @@ bool Assembler::createLocalAlignmentCandidateGraph(
             bool inReferenceAlignments = false;
 
             // Search the AlignmentTable to see if this pair exists
-            for(const ReadId alignmentIndex: alignmentTable[orientedReadId0.getValue()]) {
+            for(const uint64_t alignmentIndex: alignmentTable[orientedReadId0.getValue()]) {
                 const AlignmentData& ad = alignmentData[alignmentIndex];
 
                 // Check if the pair matches the current candidate pair of interest
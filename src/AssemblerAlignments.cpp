@@ -207,13 +207,13 @@ void Assembler::getStoredAlignments(
     // Access the alignment table portion for this oriented read.
     // It contains indexes into alignmentData and compressedAlignments
     // for alignments involving this oriented read.
-    const span<const uint32_t> alignmentIndexes = alignmentTable[orientedReadId0.getValue()];
+    const span<const uint64_t> alignmentIndexes = alignmentTable[orientedReadId0.getValue()];
 
 
 
     // Loop over alignments involving this oriented read.
     alignments.clear();
-    for(const uint32_t alignmentIndex: alignmentIndexes) {
+    for(const uint64_t alignmentIndex: alignmentIndexes) {
 
         // Access the stored information we have about this alignment.
         AlignmentData alignmentData = this->alignmentData[alignmentIndex];
@@ -280,13 +280,13 @@ void Assembler::getStoredAlignments(
     // Access the alignment table portion for this oriented read.
     // It contains indexes into alignmentData and compressedAlignments
     // for alignments involving this oriented read.
-    const span<const uint32_t> alignmentIds = alignmentTable[orientedReadId0.getValue()];
+    const span<const uint64_t> alignmentIds = alignmentTable[orientedReadId0.getValue()];
 
 
 
     // Loop over alignments involving this oriented read.
     alignments.clear();
-    for(const uint32_t alignmentId: alignmentIds) {
+    for(const uint64_t alignmentId: alignmentIds) {
         AlignmentData alignmentData = this->alignmentData[alignmentId];
 
         // The alignment is stored with its first read on strand 0.
@@ -358,7 +358,6 @@ void Assembler::findAlignedMarkers(
 
     // Loop over alignment involving this oriented read, as stored in the
     // alignment table.
-    Alignment alignment;
     const auto alignmentTable = this->alignmentTable[orientedReadId.getValue()];
     for(const auto alignmentId: alignmentTable) {
         const AlignmentData& ad = alignmentData[alignmentId];
@@ -374,11 +373,6 @@ void Assembler::findAlignedMarkers(
         OrientedReadId alignmentOrientedReadId1(ad.readIds[1],
             ad.isSameStrand ? 0 : 1);
 
-        // Access the alignment and decompress it.
-        const span<const char> compressedAlignment = compressedAlignments[alignmentId];
-        decompress(compressedAlignment, alignment);
-        SHASTA_ASSERT(alignment.ordinals.size() == ad.info.markerCount);
-
         // Swap the reads, if necessary.
         bool swapReads = false;
         if(alignmentOrientedReadId0.getReadId() != orientedReadId.getReadId()) {
@@ -397,19 +391,29 @@ void Assembler::findAlignedMarkers(
         const OrientedReadId orientedReadId1 = alignmentOrientedReadId1;
         const uint32_t markerCount1 = uint32_t(markers.size(orientedReadId1.getValue()));
 
-        for(const auto& ordinals: alignment.ordinals) {
-            uint32_t ordinal0 = ordinals[0];
-            uint32_t ordinal1 = ordinals[1];
-            if(swapReads) {
-                swap(ordinal0, ordinal1);
-            }
-            if(reverseComplement) {
-                ordinal0 = markerCount0 - 1 - ordinal0;
-                ordinal1 = markerCount1 - 1 - ordinal1;
-            }
-            if(ordinal0 == ordinal) {
+        // The ordinal we are looking for, expressed as an ordinal
+        // in the alignment as stored.
+        const uint32_t storedOrdinal = reverseComplement ? (markerCount0 - 1 - ordinal) : ordinal;
+        const uint64_t i0 = swapReads ? 1 : 0;
+
+        // Loop over the streaks of the compressed alignment, without decompressing it,
+        // looking for the streak that contains storedOrdinal.
+        const span<const char> compressedAlignment = compressedAlignments[alignmentId];
+        compressAlignment::StreakDecoder decoder(compressedAlignment);
+        compressAlignment::Streak streak;
+        uint64_t alignedMarkerCount = 0;
+        while(decoder.next(streak)) {
+            alignedMarkerCount += streak.n;
+            const array<uint32_t, 2> streakOrdinals = {streak.ordinal0, streak.ordinal1};
+            const uint32_t begin0 = streakOrdinals[i0];
+            if(storedOrdinal >= begin0 and storedOrdinal < begin0 + streak.n) {
+                uint32_t ordinal1 = streakOrdinals[1 - i0] + (storedOrdinal - begin0);
+                if(reverseComplement) {
+                    ordinal1 = markerCount1 - 1 - ordinal1;
+                }
                 alignedMarkers.push_back(make_pair(orientedReadId1, ordinal1));
             }
         }
+        SHASTA_ASSERT(alignedMarkerCount == ad.info.markerCount);
     }
 }
@@ -3,13 +3,18 @@
 #include "assembleMarkerGraphPath.hpp"
 #include "AssembledSegment.hpp"
 #include "deduplicate.hpp"
+#include "expandRunLengthSequence.hpp"
 #include "LocalAssemblyGraph.hpp"
 #include "orderPairs.hpp"
+#include "ParallelTextWriter.hpp"
 #include "performanceLog.hpp"
 #include "Reads.hpp"
 #include "timestamp.hpp"
 using namespace shasta;
 
+// Spoa.
+#include "spoa/spoa.hpp"
+
 // Boost libraries.
 #include <boost/graph/iteration_macros.hpp>
 #include <boost/pending/disjoint_sets.hpp>
@@ -644,9 +649,16 @@ void Assembler::writeAssemblyGraph(const string& fileName) const
 
 
 // Assemble sequence for all edges of the assembly graph.
+// If computeEdgeConsensus is set, consensus for the marker graph edges
+// of each assembly graph edge is computed on the fly, as the assembly
+// graph edge is assembled. This avoids storing consensus for
+// all marker graph edges in assembleMarkerGraphEdges.
 void Assembler::assemble(
     size_t threadCount,
-    uint32_t storeCoverageDataCsvLengthThreshold)
+    uint32_t storeCoverageDataCsvLengthThreshold,
+    bool computeEdgeConsensus,
+    uint32_t markerGraphEdgeLengthThresholdForConsensus,
+    double edgeConsensusMajorityFraction)
 {
     AssemblyGraph& assemblyGraph = *assemblyGraphPointer;
 
@@ -658,6 +670,10 @@ void Assembler::assemble(
     checkMarkerGraphEdgesIsOpen();
     SHASTA_ASSERT(assemblyGraph.edgeLists.isOpen());
     if(storeCoverageDataCsvLengthThreshold > 0) {
+        if(computeEdgeConsensus) {
+            throw runtime_error("Coverage data cannot be stored when consensus "
+                "for marker graph edges is computed during assembly.");
+        }
          SHASTA_ASSERT(markerGraph.vertexCoverageData.isOpen());
          SHASTA_ASSERT(markerGraph.edgeCoverageData.isOpen());
     }
@@ -671,6 +687,36 @@ void Assembler::assemble(
     // Allocate data structures to store assembly results for each thread.
     assembleData.allocate(threadCount);
     assembleData.storeCoverageDataCsvLengthThreshold = storeCoverageDataCsvLengthThreshold;
+    assembleData.computeEdgeConsensus = computeEdgeConsensus;
+    assembleData.markerGraphEdgeLengthThresholdForConsensus = markerGraphEdgeLengthThresholdForConsensus;
+    assembleData.edgeConsensusMajorityFraction = edgeConsensusMajorityFraction;
+
+    // If computing consensus for marker graph edges, the wasAssembled flags
+    // of marker graph edges are set as they are assembled.
+    if(computeEdgeConsensus) {
+        for(MarkerGraph::Edge& edge: markerGraph.edges) {
+            edge.wasAssembled = 0;
+        }
+    }
+
+    // Find the assembly graph edges to be assembled, and sort them
+    // by decreasing number of marker graph edges.
+    // This way the longest ones are assembled first,
+    // which improves load balancing.
+    vector< pair<AssemblyGraph::EdgeId, uint64_t> > edgesToBeAssembled;
+    for(AssemblyGraph::EdgeId edgeId=0; edgeId<assemblyGraph.edgeLists.size(); edgeId++) {
+        if(assemblyGraph.edges[edgeId].wasRemoved() ||
+            !assemblyGraph.isAssembledEdge(edgeId)) {
+            continue;
+        }
+        edgesToBeAssembled.push_back(make_pair(edgeId, assemblyGraph.edgeLists.size(edgeId)));
+    }
+    stable_sort(edgesToBeAssembled.begin(), edgesToBeAssembled.end(),
+        OrderPairsBySecondOnlyGreater<AssemblyGraph::EdgeId, uint64_t>());
+    assembleData.edgesToBeAssembled.clear();
+    for(const auto& p: edgesToBeAssembled) {
+        assembleData.edgesToBeAssembled.push_back(p.first);
+    }
 
     // Create the Coverage directory, if necessary.
     if(assembleData.storeCoverageDataCsvLengthThreshold > 0) {
@@ -683,7 +729,7 @@ void Assembler::assemble(
     // Do all the assemblies.
     cout << "Assembly begins for " << assemblyGraph.edgeLists.size() <<
         " edges of the assembly graph." << endl;
-    setupLoadBalancing(assemblyGraph.edgeLists.size(), 1);
+    setupLoadBalancing(assembleData.edgesToBeAssembled.size(), 1);
     runThreads(&Assembler::assembleThreadFunction, threadCount);
 
     // Find the pair(thread, index in thread) that the assembly for each edge is stored in.
@@ -766,20 +812,65 @@ void Assembler::assembleThreadFunction(size_t threadId)
 
     AssembledSegment assembledSegment;
 
+    // Work areas used when computing consensus for marker graph edges.
+    const bool computeEdgeConsensus = assembleData.computeEdgeConsensus;
+    vector<Base> sequence;
+    vector<uint32_t> repeatCountsUint32;
+    vector< vector< pair<Base, uint8_t> > > edgeConsensus;
+    vector<uint8_t> edgeConsensusOverlappingBaseCount;
+    ComputeMarkerGraphEdgeConsensusSequenceUsingSpoaDetail detail;
+    std::unique_ptr<spoa::AlignmentEngine> spoaAlignmentEngine;
+    std::unique_ptr<spoa::Graph> spoaAlignmentGraph;
+    if(computeEdgeConsensus) {
+        const spoa::AlignmentType alignmentType = spoa::AlignmentType::kNW;
+        const int8_t match = 1;
+        const int8_t mismatch = -1;
+        const int8_t gap = -1;
+        spoaAlignmentEngine = spoa::createAlignmentEngine(alignmentType, match, mismatch, gap);
+        spoaAlignmentGraph = spoa::createGraph();
+    }
+
     // Loop over batches allocated to this thread.
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
-        for(AssemblyGraph::EdgeId edgeId=begin; edgeId!=end; edgeId++) {
-            if(assemblyGraph.edges[edgeId].wasRemoved()) {
-                continue;
-            }
-            if(!assemblyGraph.isAssembledEdge(edgeId)) {
-                continue;
-            }
+        for(uint64_t i=begin; i!=end; i++) {
+            const AssemblyGraph::EdgeId edgeId = assembleData.edgesToBeAssembled[i];
             try {
-                assembleAssemblyGraphEdge(edgeId,
-                    assembleData.storeCoverageDataCsvLengthThreshold > 0,
-                    assembledSegment);
+                if(computeEdgeConsensus) {
+
+                    // Compute consensus for the marker graph edges of this assembly graph edge,
+                    // storing it as assembleMarkerGraphEdges would.
+                    const span<const MarkerGraph::EdgeId> markerGraphPath =
+                        makeSpanOfConst(assemblyGraph.edgeLists[edgeId]);
+                    edgeConsensus.resize(markerGraphPath.size());
+                    edgeConsensusOverlappingBaseCount.resize(markerGraphPath.size());
+                    for(uint64_t j=0; j<markerGraphPath.size(); j++) {
+                        const MarkerGraph::EdgeId markerGraphEdgeId = markerGraphPath[j];
+                        markerGraph.edges[markerGraphEdgeId].wasAssembled = 1;
+                        computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
+                            markerGraphEdgeId,
+                            assembleData.markerGraphEdgeLengthThresholdForConsensus,
+                            assembleData.edgeConsensusMajorityFraction,
+                            spoaAlignmentEngine, spoaAlignmentGraph,
+                            sequence, repeatCountsUint32, edgeConsensusOverlappingBaseCount[j],
+                            detail, 0);
+                        SHASTA_ASSERT(repeatCountsUint32.size() == sequence.size());
+                        edgeConsensus[j].clear();
+                        for(uint64_t position=0; position<sequence.size(); position++) {
+                            edgeConsensus[j].push_back(make_pair(sequence[position], uint8_t(repeatCountsUint32[position])));
+                        }
+                    }
+                    assembleMarkerGraphPath(
+                        assemblerInfo->readRepresentation, assemblerInfo->k, markers, getSparseKmerTable(),
+                        markerGraph, markerGraphPath,
+                        false, assembledSegment,
+                        &edgeConsensus, &edgeConsensusOverlappingBaseCount);
+
+                } else {
+                    assembleAssemblyGraphEdge(edgeId,
+                        assembleData.storeCoverageDataCsvLengthThreshold > 0,
+                        assembledSegment);
+                }
             } catch(const std::exception& e) {
                 std::lock_guard<std::mutex> lock(mutex);
                 cout << timestamp << "Thread " << threadId <<
@@ -834,6 +925,7 @@ void Assembler::AssembleData::allocate(size_t threadCount)
 void Assembler::AssembleData::free()
 {
     edges.clear();
+    edgesToBeAssembled.clear();
     for(auto& sequence: sequences) {
         sequence->remove();
     }
@@ -939,7 +1031,9 @@ void Assembler::computeAssemblyStatistics()
 
 // Write the assembly graph in GFA 1.0 format defined here:
 // https://github.com/GFA-spec/GFA-spec/blob/master/GFA1.md
-void Assembler::writeGfa1(const string& fileName)
+// Segments are formatted in parallel (see ParallelTextWriter).
+// If the file name ends in ".gz", the output is bgzip-compressed.
+void Assembler::writeGfa1(const string& fileName, size_t threadCount)
 {
     AssemblyGraph& assemblyGraph = *assemblyGraphPointer;
     using VertexId = AssemblyGraph::VertexId;
@@ -947,44 +1041,48 @@ void Assembler::writeGfa1(const string& fileName)
 
     performanceLog << timestamp << "writeGfa1 begins" << endl;
 
-    ofstream gfa(fileName);
+    ParallelTextWriter gfa(fileName, fileName.ends_with(".gz"));
 
     // Write the header line.
-    gfa << "H\tVN:Z:1.0\n";
+    gfa.write("H\tVN:Z:1.0\n");
 
     // Write a segment record for each edge.
-    for(EdgeId edgeId=0; edgeId<assemblyGraph.sequences.size(); edgeId++) {
-        if(assemblyGraph.edges[edgeId].wasRemoved()) {
-            continue;
-        }
-
-        // Only output one of each pair of reverse complemented edges.
-        if(!assemblyGraph.isAssembledEdge(edgeId)) {
-            continue;
-        }
+    gfa.writeItems(assemblyGraph.sequences.size(),
+        [&assemblyGraph](uint64_t edgeId)
+        {
+            return assemblyGraph.sequences[edgeId].baseCount;
+        },
+        [&assemblyGraph](uint64_t edgeId, string& text)
+        {
+            if(assemblyGraph.edges[edgeId].wasRemoved()) {
+                return;
+            }
 
-        const auto sequence = assemblyGraph.sequences[edgeId];
-        const auto repeatCounts = assemblyGraph.repeatCounts[edgeId];
-        SHASTA_ASSERT(sequence.baseCount == repeatCounts.size());
-        gfa << "S\t" << edgeId << "\t";
-
-        // Write the sequence.
-        for(size_t i=0; i<sequence.baseCount; i++) {
-            const Base b = sequence[i];
-            const uint8_t repeatCount = repeatCounts[i];
-            for(size_t k=0; k<repeatCount; k++) {
-                gfa << b;
+            // Only output one of each pair of reverse complemented edges.
+            if(!assemblyGraph.isAssembledEdge(edgeId)) {
+                return;
             }
-        }
 
-        // Write "number of reads" as average edge coverage
-        // times number of bases.
-        const uint32_t averageEdgeCoverage =
-            assemblyGraph.edges[edgeId].averageEdgeCoverage;
-        gfa << "\tRC:i:" << averageEdgeCoverage * sequence.baseCount;
+            const auto sequence = assemblyGraph.sequences[edgeId];
+            const auto repeatCounts = assemblyGraph.repeatCounts[edgeId];
+            SHASTA_ASSERT(sequence.baseCount == repeatCounts.size());
+            text += "S\t";
+            text += to_string(edgeId);
+            text += "\t";
+
+            // Write the sequence.
+            appendRunLengthExpandedSequence(sequence, makeSpanOfConst(repeatCounts), false, text);
 
-        gfa << "\n";
-    }
+            // Write "number of reads" as average edge coverage
+            // times number of bases.
+            const uint32_t averageEdgeCoverage =
+                assemblyGraph.edges[edgeId].averageEdgeCoverage;
+            text += "\tRC:i:";
+            text += to_string(averageEdgeCoverage * sequence.baseCount);
+
+            text += "\n";
+        },
+        threadCount);
 
 
     // Write GFA links.
@@ -1076,16 +1174,17 @@ void Assembler::writeGfa1(const string& fileName)
                 }
 
                 // Write out the link record for this edge.
-                gfa << "L\t" <<
-                    edge0Out << "\t" <<
-                    (reverse0 ? "-" : "+") << "\t" <<
-                    edge1Out << "\t" <<
-                    (reverse1 ? "-" : "+") << "\t" <<
-                    cigarString << "\n";
+                gfa.write("L\t" +
+                    to_string(edge0Out) + "\t" +
+                    (reverse0 ? "-" : "+") + "\t" +
+                    to_string(edge1Out) + "\t" +
+                    (reverse1 ? "-" : "+") + "\t" +
+                    cigarString + "\n");
             }
         }
 
     }
+    gfa.close();
     performanceLog << timestamp << "writeGfa1 ends" << endl;
 }
 
@@ -1094,7 +1193,9 @@ void Assembler::writeGfa1(const string& fileName)
 // Write the assembly graph in GFA 1.0 format defined here:
 // https://github.com/GFA-spec/GFA-spec/blob/master/GFA1.md
 // This version writes a GFA file containing both strands.
-void Assembler::writeGfa1BothStrands(const string& fileName)
+// Segments are formatted in parallel (see ParallelTextWriter).
+// If the file name ends in ".gz", the output is bgzip-compressed.
+void Assembler::writeGfa1BothStrands(const string& fileName, size_t threadCount)
 {
     AssemblyGraph& assemblyGraph = *assemblyGraphPointer;
     using VertexId = AssemblyGraph::VertexId;
@@ -1102,69 +1203,56 @@ void Assembler::writeGfa1BothStrands(const string& fileName)
 
     performanceLog << timestamp << "writeGfa1BothStrands begins" << endl;
 
-    ofstream gfa(fileName);
+    ParallelTextWriter gfa(fileName, fileName.ends_with(".gz"));
 
     // Write the header line.
-    gfa << "H\tVN:Z:1.0\n";
+    gfa.write("H\tVN:Z:1.0\n");
 
     // Write a segment record for each edge.
-    for(EdgeId edgeId=0; edgeId<assemblyGraph.sequences.size(); edgeId++) {
-        if(assemblyGraph.edges[edgeId].wasRemoved()) {
-            continue;
-        }
-
-        // Get the id of the reverse complemented edge.
-        const EdgeId edgeIdRc = assemblyGraph.reverseComplementEdge[edgeId];
+    gfa.writeItems(assemblyGraph.sequences.size(),
+        [&assemblyGraph](uint64_t edgeId)
+        {
+            return assemblyGraph.sequences[assemblyGraph.isAssembledEdge(edgeId) ?
+                edgeId : assemblyGraph.reverseComplementEdge[edgeId]].baseCount;
+        },
+        [&assemblyGraph](uint64_t edgeId, string& text)
+        {
+            if(assemblyGraph.edges[edgeId].wasRemoved()) {
+                return;
+            }
 
-        // Write the name to make it easy to keep track of reverse
-        // complemented edges.
-        gfa << "S\t" << edgeId << "\t";
+            // Get the id of the reverse complemented edge.
+            const EdgeId edgeIdRc = assemblyGraph.reverseComplementEdge[edgeId];
 
-        // Write the sequence.
-        size_t sequenceLength;
-        if(assemblyGraph.isAssembledEdge(edgeId)) {
+            // Write the name to make it easy to keep track of reverse
+            // complemented edges.
+            text += "S\t";
+            text += to_string(edgeId);
+            text += "\t";
 
-            // This edge was assembled. We can just write the stored sequence.
-            const auto sequence = assemblyGraph.sequences[edgeId];
-            const auto repeatCounts = assemblyGraph.repeatCounts[edgeId];
-            SHASTA_ASSERT(sequence.baseCount == repeatCounts.size());
-            sequenceLength = sequence.baseCount;
-            for(size_t i=0; i<sequence.baseCount; i++) {
-                const Base b = sequence[i];
-                const uint8_t repeatCount = repeatCounts[i];
-                for(size_t k=0; k<repeatCount; k++) {
-                    gfa << b;
-                }
-            }
-        } else {
-
-            // This edge was not assembled. We write out the reverse
+            // Write the sequence.
+            // If this edge was not assembled, we write out the reverse
             // complemented sequence of the reverse complemented edge.
-            SHASTA_ASSERT(assemblyGraph.isAssembledEdge(edgeIdRc));
-            const auto sequence = assemblyGraph.sequences[edgeIdRc];
-            const auto repeatCounts = assemblyGraph.repeatCounts[edgeIdRc];
-            SHASTA_ASSERT(sequence.baseCount == repeatCounts.size());
-            sequenceLength = sequence.baseCount;
-            for(size_t i=0; i<sequence.baseCount; i++) {
-                const size_t j = sequence.baseCount - 1 - i;
-                const Base b = sequence[j].complement();
-                const uint8_t repeatCount = repeatCounts[j];
-                for(size_t k=0; k<repeatCount; k++) {
-                    gfa << b;
-                }
+            const bool isAssembled = assemblyGraph.isAssembledEdge(edgeId);
+            if(not isAssembled) {
+                SHASTA_ASSERT(assemblyGraph.isAssembledEdge(edgeIdRc));
             }
-
-
-        }
-
-        // Write "number of reads" as average edge coverage
-        // times number of bases.
-        const uint32_t averageEdgeCoverage =
-            assemblyGraph.edges[edgeId].averageEdgeCoverage;
-        gfa << "\tRC:i:" << averageEdgeCoverage * sequenceLength;
-;
-        gfa << "\n";
-    }
+            const EdgeId assembledEdgeId = isAssembled ? edgeId : edgeIdRc;
+            const auto sequence = assemblyGraph.sequences[assembledEdgeId];
+            const auto repeatCounts = assemblyGraph.repeatCounts[assembledEdgeId];
+            SHASTA_ASSERT(sequence.baseCount == repeatCounts.size());
+            const size_t sequenceLength = sequence.baseCount;
+            appendRunLengthExpandedSequence(sequence, makeSpanOfConst(repeatCounts), not isAssembled, text);
+
+            // Write "number of reads" as average edge coverage
+            // times number of bases.
+            const uint32_t averageEdgeCoverage =
+                assemblyGraph.edges[edgeId].averageEdgeCoverage;
+            text += "\tRC:i:";
+            text += to_string(averageEdgeCoverage * sequenceLength);
+            text += "\n";
+        },
+        threadCount);
 
   
     // Write GFA links.
@@ -1239,13 +1327,14 @@ void Assembler::writeGfa1BothStrands(const string& fileName)
                 // Write out the link record for this edge.
                 // Note that in the double stranded version of GFA
                 // output all links are written with orientation ++.
-                gfa << "L\t" <<
-                    edge0 << "\t+\t" <<
-                    edge1 << "\t+\t" <<
-                    cigarString << "\n";
+                gfa.write("L\t" +
+                    to_string(edge0) + "\t+\t" +
+                    to_string(edge1) + "\t+\t" +
+                    cigarString + "\n");
             }
         }
     }
+    gfa.close();
 
     performanceLog << timestamp << "writeGfa1BothStrands ends" << endl;
 
@@ -1261,46 +1350,54 @@ void Assembler::writeGfa1BothStrandsNoSequence(const string& fileName)
 
 
 // Write assembled sequences in FASTA format.
-void Assembler::writeFasta(const string& fileName)
+// Sequences are formatted in parallel (see ParallelTextWriter).
+// If the file name ends in ".gz", the output is bgzip-compressed.
+void Assembler::writeFasta(const string& fileName, size_t threadCount)
 {
     AssemblyGraph& assemblyGraph = *assemblyGraphPointer;
-    using EdgeId = AssemblyGraph::EdgeId;
 
     performanceLog << timestamp << "writeFasta begins" << endl;
 
-    ofstream fasta(fileName);
+    ParallelTextWriter fasta(fileName, fileName.ends_with(".gz"));
 
     // Write a sequence for each edge of the assembly graph.
-    for(EdgeId edgeId=0; edgeId<assemblyGraph.sequences.size(); edgeId++) {
-        if(assemblyGraph.edges[edgeId].wasRemoved()) {
-            continue;
-        }
-
-        // Only output one of each pair of reverse complemented edges.
-        if(!assemblyGraph.isAssembledEdge(edgeId)) {
-            continue;
-        }
+    fasta.writeItems(assemblyGraph.sequences.size(),
+        [&assemblyGraph](uint64_t edgeId)
+        {
+            return assemblyGraph.sequences[edgeId].baseCount;
+        },
+        [&assemblyGraph](uint64_t edgeId, string& text)
+        {
+            if(assemblyGraph.edges[edgeId].wasRemoved()) {
+                return;
+            }
 
-        const auto sequence = assemblyGraph.sequences[edgeId];
-        const auto repeatCounts = assemblyGraph.repeatCounts[edgeId];
-        SHASTA_ASSERT(sequence.baseCount == repeatCounts.size());
+            // Only output one of each pair of reverse complemented edges.
+            if(!assemblyGraph.isAssembledEdge(edgeId)) {
+                return;
+            }
 
-        // Compute the length so we can write it in the header.
-        size_t length = 0;
-        for(const uint8_t repeatCount: repeatCounts) {
-            length += repeatCount;
-        }
+            const auto sequence = assemblyGraph.sequences[edgeId];
+            const auto repeatCounts = assemblyGraph.repeatCounts[edgeId];
+            SHASTA_ASSERT(sequence.baseCount == repeatCounts.size());
 
-        fasta << ">" << edgeId << " length " << length << "\n";
-        for(size_t i=0; i<sequence.baseCount; i++) {
-            const Base b = sequence[i];
-            const uint8_t repeatCount = repeatCounts[i];
-            for(size_t k=0; k<repeatCount; k++) {
-                fasta << b;
+            // Compute the length so we can write it in the header.
+            size_t length = 0;
+            for(const uint8_t repeatCount: repeatCounts) {
+                length += repeatCount;
             }
-        }
-        fasta << "\n";
-    }
+
+            text += ">";
+            text += to_string(edgeId);
+            text += " length ";
+            text += to_string(length);
+            text += "\n";
+            appendRunLengthExpandedSequence(sequence, makeSpanOfConst(repeatCounts), false, text);
+            text += "\n";
+        },
+        threadCount);
+    fasta.close();
+
     performanceLog << timestamp << "writeFasta ends" << endl;
 
 }
@@ -1785,7 +1882,8 @@ void Assembler::assembleAssemblyGraphEdge(
     AssembledSegment& assembledSegment)
 {
     assembleMarkerGraphPath(
-        assemblerInfo->readRepresentation, assemblerInfo->k, markers, markerGraph, markerGraphPath,
+        assemblerInfo->readRepresentation, assemblerInfo->k, markers, getSparseKmerTable(),
+        markerGraph, markerGraphPath,
         storeCoverageData, assembledSegment);
 }
 
@@ -34,6 +34,7 @@ void Assembler::createAssemblyGraph2(
         assemblerInfo->k,
         getReads().getFlags(),
         markers,
+        getSparseKmerTable(),
         markerGraph,
         pruneLength,
         mode2Options,
@@ -86,10 +86,10 @@ void Assembler::createReadGraphUsingPseudoPaths(
             const OrientedReadId orientedReadId(readId, 0);
 
             // Get the alignments it is involved in.
-            const span<uint32_t> alignmentIds = alignmentTable[orientedReadId.getValue()];
+            const span<uint64_t> alignmentIds = alignmentTable[orientedReadId.getValue()];
 
             // Loop over those alignments.
-            for(const uint32_t alignmentId: alignmentIds) {
+            for(const uint64_t alignmentId: alignmentIds) {
                 const AlignmentData& ad = alignmentData[alignmentId];
                 const auto& info = createReadGraphUsingPseudoPathsData.alignmentInfos[alignmentId];
                 const double score = double(info.strongMatchCount) -
@@ -119,11 +119,11 @@ void Assembler::createReadGraphUsingPseudoPaths(
         const OrientedReadId orientedReadId(readId, 0);
 
         // Get the alignments it is involved in.
-        const span<uint32_t> alignmentIds = alignmentTable[orientedReadId.getValue()];
+        const span<uint64_t> alignmentIds = alignmentTable[orientedReadId.getValue()];
 
         // Sort them by score = segmentMatchCount - mismatchSquareFactor * segmentMismatchCount^2
-        vector< pair<double, uint32_t> > table; // pair(score, alignmentId)
-        for(const uint32_t alignmentId: alignmentIds) {
+        vector< pair<double, uint64_t> > table; // pair(score, alignmentId)
+        for(const uint64_t alignmentId: alignmentIds) {
             const auto& info = createReadGraphUsingPseudoPathsData.alignmentInfos[alignmentId];
             const double score = double(info.strongMatchCount) -
                 mismatchSquareFactor * double(info.mismatchCount*info.mismatchCount);
@@ -131,7 +131,7 @@ void Assembler::createReadGraphUsingPseudoPaths(
                 table.push_back(make_pair(score, alignmentId));
             }
         }
-        sort(table.begin(), table.end(), OrderPairsByFirstOnlyGreater<double, uint32_t>());
+        sort(table.begin(), table.end(), OrderPairsByFirstOnlyGreater<double, uint64_t>());
 
         // Keep the best maxAlignmentCount.
         if(table.size() > maxAlignmentCount) {
@@ -1352,7 +1352,7 @@ void Assembler::exploreAlignment(
 
             const auto kmerId = marker0.kmerId;
             SHASTA_ASSERT(marker1.kmerId == kmerId);
-            const Kmer kmer(kmerId, assemblerInfo->k);
+            const Kmer64 kmer = getKmer(kmerId);
 
             const uint32_t rlePosition0 = marker0.position;
             const uint32_t rlePosition1 = marker1.position;
@@ -77,6 +77,7 @@ void Assembler::exploreMarkerGraph(
         assemblerInfo->assemblyMode,
         getReads(),
         markers,
+        getSparseKmerTable(),
         markerGraph.vertexTable,
         *consensusCaller);
     const auto createStartTime = steady_clock::now();
@@ -105,6 +106,9 @@ void Assembler::exploreMarkerGraph(
         html << "<p>Timeout for graph creation exceeded. Increase the timeout or reduce the maximum distance from the start vertex.";
         return;
     }
+    html << "<p>The local marker graph has " << num_vertices(graph) <<
+        " vertices and " << num_edges(graph) << " edges and was created in " <<
+        seconds(createFinishTime - createStartTime) << " s.";
 
     html <<
         "<script>\n"
@@ -863,7 +867,7 @@ void Assembler::exploreMarkerGraphVertex(const vector<string>& request, ostream&
     // Get the marker sequence.
     const KmerId kmerId = markers.begin()[markerIds[0]].kmerId;
     const size_t k = assemblerInfo->k;
-    const Kmer kmer(kmerId, k);
+    const Kmer64 kmer = getKmer(kmerId);
 
 
 
@@ -1290,6 +1294,7 @@ void Assembler::exploreMarkerGraphEdge(const vector<string>& request, ostream& h
     computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
         edgeId,
         markerGraphEdgeLengthThresholdForConsensus,
+        1.,
         spoaAlignmentEngine,
         spoaAlignmentGraph,
         spoaSequence,
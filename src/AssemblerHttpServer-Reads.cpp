@@ -660,7 +660,7 @@ void Assembler::exploreReadRle(
 
 
                 // Write the k-mer of this marker.
-                const Kmer kmer(marker.kmerId, k);
+                const Kmer64 kmer = getKmer(marker.kmerId);
                 html << "<a xlink:title='Marker " << ordinal <<
                     ", position " << marker.position <<
                     ", k-mer id " << marker.kmerId;
@@ -758,7 +758,7 @@ void Assembler::exploreReadRle(
         // Loop over all markers on this oriented read.
         for(uint32_t ordinal=0; ordinal<orientedReadMarkers.size(); ordinal++) {
             const CompressedMarker& marker = orientedReadMarkers[ordinal];
-            const Kmer kmer(marker.kmerId, k);
+            const Kmer64 kmer = getKmer(marker.kmerId);
             const uint32_t rlePosition = marker.position;
             const uint32_t rawPosition = rawPositions[rlePosition];
 
@@ -823,7 +823,7 @@ void Assembler::exploreReadRle(
         for(const auto& p: markerFrequencyTable) {
             const KmerId kmerId = p.first;
             const uint32_t frequency = p.second;
-            const Kmer kmer(kmerId, k);
+            const Kmer64 kmer = getKmer(kmerId);
             html << "<tr><td>";
             kmer.write(html, k);
             html << "<td>" << frequency;
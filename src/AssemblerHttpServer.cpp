@@ -900,14 +900,7 @@ void Assembler::writeAssemblySummaryBody(ostream& html)
     // Compute the number of run-length k-mers used as markers.
     uint64_t totalRleKmerCount = 0;
     uint64_t markerRleKmerCount = 0;
-    for(const auto& tableEntry: kmerTable) {
-        if(tableEntry.isRleKmer) {
-            ++totalRleKmerCount;
-            if(tableEntry.isMarker) {
-                ++markerRleKmerCount;
-            }
-        }
-    }
+    countRleKmers(totalRleKmerCount, markerRleKmerCount);
 
     const uint64_t totalDiscardedReadCount =
         assemblerInfo->discardedInvalidBaseReadCount +
@@ -1233,14 +1226,7 @@ void Assembler::writeAssemblySummaryJson(ostream& json)
     // Compute the number of run-length k-mers used as markers.
     uint64_t totalRleKmerCount = 0;
     uint64_t markerRleKmerCount = 0;
-    for(const auto& tableEntry: kmerTable) {
-        if(tableEntry.isRleKmer) {
-            ++totalRleKmerCount;
-            if(tableEntry.isMarker) {
-                ++markerRleKmerCount;
-            }
-        }
-    }
+    countRleKmers(totalRleKmerCount, markerRleKmerCount);
 
     const uint64_t totalDiscardedReadCount =
         assemblerInfo->discardedInvalidBaseReadCount +
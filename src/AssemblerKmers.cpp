@@ -1,5 +1,7 @@
 #include "Assembler.hpp"
 #include "deduplicate.hpp"
+#include "extractKmerIds.hpp"
+#include "KmerCounter.hpp"
 #include "MurmurHash2.hpp"
 #include "Reads.hpp"
 using namespace shasta;
@@ -10,6 +12,11 @@ using namespace shasta;
 
 void Assembler::accessKmers()
 {
+    if(assemblerInfo->useSparseKmerTable) {
+        sparseKmerTable.accessExistingReadOnly(largeDataName("SparseKmers"), assemblerInfo->k);
+        return;
+    }
+
     kmerTable.accessExistingReadOnly(largeDataName("Kmers"));
     if(kmerTable.size() != (1ULL<< (2*assemblerInfo->k))) {
         throw runtime_error("Size of k-mer vector is inconsistent with stored value of k.");
@@ -18,8 +25,124 @@ void Assembler::accessKmers()
 
 void Assembler::checkKmersAreOpen()const
 {
-    if(!kmerTable.isOpen) {
-        throw runtime_error("Kmers are not accessible.");
+    if(assemblerInfo->useSparseKmerTable) {
+        if(!sparseKmerTable.isOpen()) {
+            throw runtime_error("Kmers are not accessible.");
+        }
+    } else {
+        if(!kmerTable.isOpen) {
+            throw runtime_error("Kmers are not accessible.");
+        }
+    }
+}
+
+
+
+// When using the sparse k-mer table, KmerIds are indexes in the table,
+// so all valid KmerIds are markers.
+bool Assembler::isMarkerKmer(KmerId kmerId) const
+{
+    if(assemblerInfo->useSparseKmerTable) {
+        return kmerId < sparseKmerTable.size();
+    } else {
+        return kmerTable[kmerId].isMarker;
+    }
+}
+
+
+
+// Hash function of a KmerId, used for downsampling markers.
+// The sparse k-mer table does not store it, so we compute it
+// on the fly in the same way as initializeKmerTable does,
+// but using the KmerId64 of the k-mer and of its reverse complement.
+uint32_t Assembler::getKmerHash(KmerId kmerId) const
+{
+    if(assemblerInfo->useSparseKmerTable) {
+        const uint64_t n =
+            sparseKmerTable.getKmerId64(kmerId) +
+            sparseKmerTable.getKmerId64(sparseKmerTable.getReverseComplementIndex(kmerId));
+        return MurmurHash2(&n, sizeof(n), 13477);
+    } else {
+        return kmerTable[kmerId].hash;
+    }
+}
+
+
+
+Kmer64 Assembler::getKmer(KmerId kmerId) const
+{
+    return getMarkerKmer(kmerId, assemblerInfo->k, getSparseKmerTable());
+}
+
+
+
+const SparseKmerTable* Assembler::getSparseKmerTable() const
+{
+    if(assemblerInfo->useSparseKmerTable) {
+        checkKmersAreOpen();
+        return &sparseKmerTable;
+    } else {
+        return 0;
+    }
+}
+
+
+
+// Get the KmerIds of all marker k-mers, sorted.
+void Assembler::getMarkerKmerIds(vector<KmerId>& markerKmerIds) const
+{
+    checkKmersAreOpen();
+    markerKmerIds.clear();
+    if(assemblerInfo->useSparseKmerTable) {
+        markerKmerIds.resize(sparseKmerTable.size());
+        for(uint64_t kmerId=0; kmerId<markerKmerIds.size(); kmerId++) {
+            markerKmerIds[kmerId] = KmerId(kmerId);
+        }
+    } else {
+        for(uint64_t kmerId=0; kmerId<kmerTable.size(); kmerId++) {
+            if(kmerTable[kmerId].isMarker) {
+                markerKmerIds.push_back(KmerId(kmerId));
+            }
+        }
+    }
+}
+
+
+
+// Count the total number of RLE k-mers and
+// the number of RLE k-mers used as markers.
+void Assembler::countRleKmers(
+    uint64_t& totalRleKmerCount,
+    uint64_t& markerRleKmerCount) const
+{
+    totalRleKmerCount = 0;
+    markerRleKmerCount = 0;
+
+    if(assemblerInfo->useSparseKmerTable) {
+
+        // There are 4 choices for the first base
+        // and 3 choices for each of the following bases.
+        const uint64_t k = assemblerInfo->k;
+        totalRleKmerCount = 4;
+        for(uint64_t i=1; i<k; i++) {
+            totalRleKmerCount *= 3;
+        }
+        for(const KmerId64 kmerId: sparseKmerTable) {
+            if(isRleKmer(kmerId, k)) {
+                ++markerRleKmerCount;
+            }
+        }
+
+    } else {
+
+        for(const auto& tableEntry: kmerTable) {
+            if(tableEntry.isRleKmer) {
+                ++totalRleKmerCount;
+                if(tableEntry.isMarker) {
+                    ++markerRleKmerCount;
+                }
+            }
+        }
     }
 }
 
@@ -191,6 +314,24 @@ void Assembler::writeKmers(const string& fileName) const
 
     // Get the k-mer length.
     const size_t k = assemblerInfo->k;
+
+    // If using the sparse k-mer table, only write the marker k-mers.
+    // The KmerIds written are the ones used in markers,
+    // that is, indexes in the sparse k-mer table.
+    if(assemblerInfo->useSparseKmerTable) {
+        ofstream file(fileName);
+        file << "KmerId,Kmer,IsMarker,ReverseComplementedKmerId,ReverseComplementedKmer\n";
+        for(uint64_t kmerId=0; kmerId<sparseKmerTable.size(); kmerId++) {
+            const uint64_t reverseComplementedKmerId = sparseKmerTable.getReverseComplementIndex(kmerId);
+            file << kmerId << ",";
+            sparseKmerTable.getKmer(kmerId).write(file, k) << ",";
+            file << "1,";
+            file << reverseComplementedKmerId << ",";
+            sparseKmerTable.getKmer(reverseComplementedKmerId).write(file, k) << "\n";
+        }
+        return;
+    }
+
     const size_t kmerCount = 1ULL << (2ULL*k);
     SHASTA_ASSERT(kmerTable.size() == kmerCount);
 
@@ -254,8 +395,17 @@ void Assembler::selectKmersBasedOnFrequency(
     initializeKmerTable();
 
     // Compute the frequency of all k-mers in oriented reads.
+    MemoryMapped::Vector<uint64_t> frequency;
+    frequency.createNew(largeDataName("tmp-KmerFrequency"), largeDataPageSize);
+    kmerCounter = make_shared<KmerCounter>(k, frequency);
     setupLoadBalancing(reads->readCount(), 1000);
     runThreads(&Assembler::computeKmerFrequency, threadCount);
+    kmerCounter->addReverseComplementCounts(threadCount);
+    kmerCounter = 0;
+    for(uint64_t kmerId=0; kmerId!=kmerTable.size(); kmerId++) {
+        kmerTable[kmerId].frequency = frequency[kmerId];
+    }
+    frequency.remove();
 
     // Compute the total number of k-mer occurrences in reads
     // and the number of k-mers that can possibly occur.
@@ -411,15 +561,13 @@ void Assembler::selectKmersBasedOnFrequency(
 }
 
 
+// Count k-mers on strand 0 of each read.
+// Reverse complemented k-mers are accounted for
+// by KmerCounter::addReverseComplementCounts.
 void Assembler::computeKmerFrequency(size_t threadId)
 {
-    // Create a frequency vector for this thread.
-    MemoryMapped::Vector<uint64_t> frequency;
-    frequency.createNew(
-        largeDataName("tmp-KmerFrequency-" + to_string(threadId)),
-        largeDataPageSize);
-    frequency.resize(kmerTable.size());
-    fill(frequency.begin(), frequency.end(), 0);
+    KmerCounter::Buffer kmerCounterBuffer(*kmerCounter);
+    vector<KmerId> kmerIds;
 
 
 
@@ -431,55 +579,17 @@ void Assembler::computeKmerFrequency(size_t threadId)
         // Loop over all reads assigned to this batch.
         for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
 
-            // Access the sequence of this read.
-            const LongBaseSequenceView read = reads->getRead(readId);
-
+            // Get the KmerIds of all k-mers of this read
+            // and increment their frequencies.
             // If the read is pathologically short, it has no k-mers.
-            if(read.baseCount < k) {
-                continue;
-            }
-
-            // Loop over k-mers of this read.
-            Kmer kmer;
-            for(size_t position=0; position<k; position++) {
-                kmer.set(position, read[position]);
-            }
-            for(uint32_t position=0; /*The check is done later */; position++) {
-
-                // Get the k-mer id.
-                const KmerId kmerId = KmerId(kmer.id(k));
-
-                // Increment its frequency.
-                ++frequency[kmerId];
-
-                // Also increment the frequency of the reverse complemented k-mer.
-                ++frequency[kmerTable[kmerId].reverseComplementedKmerId];
-
-                // Check if we reached the end of the read.
-                if(position+k == read.baseCount) {
-                    break;
-                }
-
-                // Update the k-mer.
-                kmer.shiftLeft();
-                kmer.set(k-1, read[position+k]);
+            extractKmerIds(reads->getRead(readId), k, kmerIds);
+            for(const KmerId kmerId: kmerIds) {
+                kmerCounterBuffer.add(kmerId);
             }
         }
     }
 
-
-    // Update the frequency in the k-mer table.
-    {
-        std::lock_guard<std::mutex> lock(mutex);
-        for(uint64_t kmerId=0; kmerId!=frequency.size(); kmerId++) {
-            kmerTable[kmerId].frequency += frequency[kmerId];
-        }
-    }
-
-
-
-    // Remove the frequency vector for this thread.
-    frequency.remove();
+    kmerCounterBuffer.flush();
 }
 
 
@@ -625,16 +735,15 @@ void Assembler::selectKmers2(
         largeDataName("tmp-SelectKmers2-GlobalFrequency"),  largeDataPageSize);
     selectKmers2Data.overenrichedReadCount.createNew(
         largeDataName("tmp-SelectKmers2-OverenrichedReadCount"),  largeDataPageSize);
-    selectKmers2Data.globalFrequency.resize(kmerTable.size());
+    kmerCounter = make_shared<KmerCounter>(k, selectKmers2Data.globalFrequency);
     selectKmers2Data.overenrichedReadCount.resize(kmerTable.size());
-    fill(
-        selectKmers2Data.globalFrequency.begin(),
-        selectKmers2Data.globalFrequency.end(), 0);
     fill(
         selectKmers2Data.overenrichedReadCount.begin(),
         selectKmers2Data.overenrichedReadCount.end(), 0);
     setupLoadBalancing(reads->readCount(), 100);
     runThreads(&Assembler::selectKmers2ThreadFunction, threadCount);
+    kmerCounter->addReverseComplementCounts(threadCount);
+    kmerCounter = 0;
 
 
 
@@ -766,21 +875,15 @@ void Assembler::selectKmers2(
 
 void Assembler::selectKmers2ThreadFunction(size_t threadId)
 {
-    // Initialize globalFrequency for this thread.
-    MemoryMapped::Vector<uint64_t> globalFrequency;
-    globalFrequency.createNew(
-        largeDataName("tmp-SelectKmers2-GlobalFrequency-" + to_string(threadId)),
-        largeDataPageSize);
-    globalFrequency.resize(kmerTable.size());
-    fill(globalFrequency.begin(), globalFrequency.end(), 0);
-
-    // Initialize overenrichedReadCount for this thread.
-    MemoryMapped::Vector<ReadId> overenrichedReadCount;
-    overenrichedReadCount.createNew(
-        largeDataName("tmp-SelectKmers2-OverenrichedReadCount-" + to_string(threadId)),
-        largeDataPageSize);
-    overenrichedReadCount.resize(kmerTable.size());
-    fill(overenrichedReadCount.begin(), overenrichedReadCount.end(), 0);
+    // Global frequencies are accumulated via the KmerCounter
+    // for k-mers on strand 0 of each read.
+    // Reverse complemented k-mers are accounted for
+    // by KmerCounter::addReverseComplementCounts.
+    KmerCounter::Buffer kmerCounterBuffer(*kmerCounter);
+
+    // Over-enrichment is rare, so we update the global
+    // overenrichedReadCount atomically.
+    MemoryMapped::Vector<ReadId>& overenrichedReadCount = selectKmers2Data.overenrichedReadCount;
 
     // Vectors to hold KmerIds and their frequencies for a single read.
     vector<KmerId> readKmerIds;
@@ -832,10 +935,7 @@ void Assembler::selectKmers2ThreadFunction(size_t threadId)
                 readKmerIds.push_back(kmerId);
 
                 // Increment its global frequency.
-                ++globalFrequency[kmerId];
-
-                // Also increment the frequency of the reverse complemented k-mer.
-                ++globalFrequency[kmerTable[kmerId].reverseComplementedKmerId];
+                kmerCounterBuffer.add(kmerId);
 
                 // Check if we reached the end of the read.
                 if(position+k == read.baseCount) {
@@ -862,25 +962,14 @@ void Assembler::selectKmers2ThreadFunction(size_t threadId)
                 const KmerId kmerId = readKmerIds[i];
                 const uint32_t frequency = readKmerIdFrequencies[i];
                 if(frequency > frequencyThreshold) {
-                    ++overenrichedReadCount[kmerId];
-                    ++overenrichedReadCount[kmerTable[kmerId].reverseComplementedKmerId];
+                    __sync_fetch_and_add(&overenrichedReadCount[kmerId], 1);
+                    __sync_fetch_and_add(&overenrichedReadCount[kmerTable[kmerId].reverseComplementedKmerId], 1);
                 }
             }
         }
     }
 
-
-    // Add our globalFrequency and overenrichedReadCount
-    // to the values computer by the other threads.
-    {
-        std::lock_guard<std::mutex> lock(mutex);
-        for(uint64_t kmerId=0; kmerId!=globalFrequency.size(); kmerId++) {
-            selectKmers2Data.globalFrequency[kmerId] += globalFrequency[kmerId];
-            selectKmers2Data.overenrichedReadCount[kmerId] += overenrichedReadCount[kmerId];
-        }
-    }
-    globalFrequency.remove();
-    overenrichedReadCount.remove();
+    kmerCounterBuffer.flush();
 }
 
 
@@ -938,10 +1027,7 @@ void Assembler::selectKmers4(
     // Initialize the global frequency of all k-mers.
     selectKmers4Data.globalFrequency.createNew(
         largeDataName("tmp-SelectKmers4-GlobalFrequency"),  largeDataPageSize);
-    selectKmers4Data.globalFrequency.resize(kmerTable.size());
-    fill(
-        selectKmers4Data.globalFrequency.begin(),
-        selectKmers4Data.globalFrequency.end(), 0);
+    kmerCounter = make_shared<KmerCounter>(k, selectKmers4Data.globalFrequency);
 
 
     // Initialize the minimumDistance vector, which stores
@@ -958,6 +1044,8 @@ void Assembler::selectKmers4(
     // Compute the minimumDistance vector.
     setupLoadBalancing(reads->readCount(), 100);
     runThreads(&Assembler::selectKmers4ThreadFunction, threadCount);
+    kmerCounter->addReverseComplementCounts(threadCount);
+    kmerCounter = 0;
 
 
 
@@ -1134,14 +1222,12 @@ void Assembler::selectKmers4ThreadFunction(size_t threadId)
     // K-mer length.
     const size_t k = assemblerInfo->k;
 
-    // Initialize globalFrequency for this thread.
+    // Global frequencies are accumulated via the KmerCounter
+    // for k-mers on strand 0 of each read.
     // Having all threads accumulate atomically on the global frequency vector is too slow.
-    MemoryMapped::Vector<uint64_t> globalFrequency;
-    globalFrequency.createNew(
-        largeDataName("tmp-SelectKmers4-GlobalFrequency-" + to_string(threadId)),
-        largeDataPageSize);
-    globalFrequency.resize(kmerTable.size());
-    fill(globalFrequency.begin(), globalFrequency.end(), 0);
+    // Reverse complemented k-mers are accounted for
+    // by KmerCounter::addReverseComplementCounts.
+    KmerCounter::Buffer kmerCounterBuffer(*kmerCounter);
 
     // Vector to hold pairs(KmerId, RLE position) for one read.
     vector< pair<KmerId, uint32_t> > readKmers;
@@ -1174,8 +1260,7 @@ void Assembler::selectKmers4ThreadFunction(size_t threadId)
                 readKmers.push_back(make_pair(kmerId, position));
 
                 // Update the frequency of this k-mer.
-                ++globalFrequency[kmerId];
-                ++globalFrequency[kmerTable[kmerId].reverseComplementedKmerId];
+                kmerCounterBuffer.add(kmerId);
 
                 // Check if we reached the end of the read.
                 if(position+k == read.baseCount) {
@@ -1208,13 +1293,6 @@ void Assembler::selectKmers4ThreadFunction(size_t threadId)
         }
     }
 
-    // Add our globalFrequency to the values computed by the other threads.
-    {
-        std::lock_guard<std::mutex> lock(mutex);
-        for(uint64_t kmerId=0; kmerId!=globalFrequency.size(); kmerId++) {
-            selectKmers4Data.globalFrequency[kmerId] += globalFrequency[kmerId];
-        }
-    }
-    globalFrequency.remove();
+    kmerCounterBuffer.flush();
 }
 
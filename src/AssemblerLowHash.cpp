@@ -43,7 +43,6 @@ void Assembler::findAlignmentCandidatesLowHash0(
         maxBucketSize,
         minFrequency,
         threadCount,
-        kmerTable,
         getReads(),
         markers,
         alignmentCandidates.candidates,
@@ -142,6 +141,8 @@ void Assembler::findAlignmentCandidatesLowHash1(
     size_t minBucketSize,           // The minimum size for a bucket to be used.
     size_t maxBucketSize,           // The maximum size for a bucket to be used.
     size_t minFrequency,            // Minimum number of minHash hits for a pair to become a candidate.
+    bool hashAllIterationsInOnePass,// Compute the low hashes for all iterations in a single pass.
+    const string& checkpointDirectory, // If not empty, store common features in a checkpoint there.
     size_t threadCount)
 {
     // Check that we have what we need.
@@ -165,8 +166,10 @@ void Assembler::findAlignmentCandidatesLowHash1(
         minBucketSize,
         maxBucketSize,
         minFrequency,
+        hashAllIterationsInOnePass,
+        checkpointDirectory,
+        assemblerInfo->k,
         threadCount,
-        kmerTable,
         getReads(),
         markers,
         alignmentCandidates,
@@ -237,7 +240,7 @@ void Assembler::writeAlignmentCandidates(bool useReadName, bool verbose) const
             bool inReadGraph = false;
 
             // Search the AlignmentTable to see if this pair exists
-            for(const ReadId alignmentIndex: alignmentTable[orientedReadId0.getValue()]) {
+            for(const uint64_t alignmentIndex: alignmentTable[orientedReadId0.getValue()]) {
                 const AlignmentData& a = alignmentData[alignmentIndex];
 
                 // Check if the pair matches the current candidate pair of interest
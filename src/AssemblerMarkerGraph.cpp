@@ -6,9 +6,11 @@
 #include "compressAlignment.hpp"
 #include "Coverage.hpp"
 #include "dset64-gccAtomic.hpp"
+#include "ExternalSort.hpp"
 #include "PeakFinder.hpp"
 #include "performanceLog.hpp"
 #include "LocalMarkerGraph.hpp"
+#include "MurmurHash2.hpp"
 #include "Reads.hpp"
 #include "timestamp.hpp"
 using namespace shasta;
@@ -26,6 +28,7 @@ using namespace shasta;
 #include "chrono.hpp"
 #include <map>
 #include <queue>
+#include <unordered_set>
 
 
 
@@ -58,6 +61,11 @@ void Assembler::createMarkerGraphVertices(
     double peakFinderMinAreaFraction,
     uint64_t peakFinderAreaStartIndex,
 
+    // If not zero, the marker graph vertices are created out of core,
+    // using sorted runs on disk and at most this many gigabytes of memory
+    // after the disjoint set computation. Experimental.
+    uint64_t externalSortBufferGigabytes,
+
     // Number of threads. If zero, a number of threads equal to
     // the number of virtual processors is used.
     size_t threadCount
@@ -119,48 +127,46 @@ void Assembler::createMarkerGraphVertices(
     // Update the disjoint set data structure for each alignment
     // in the read graph.
     performanceLog << timestamp << "Disjoint set computation begins." << endl;
+    const auto tDisjointSetsBegin = steady_clock::now();
     size_t batchSize = 10000;
     setupLoadBalancing(readGraph.edges.size(), batchSize);
     runThreads(&Assembler::createMarkerGraphVerticesThreadFunction1, threadCount);
-    performanceLog << timestamp << "Disjoint set computation completed." << endl;
-
+    performanceLog << timestamp << "Disjoint set computation completed in " <<
+        seconds(steady_clock::now() - tDisjointSetsBegin) << " s." << endl;
 
 
-    // Find the disjoint set that each oriented marker was assigned to.
-    // Iterate till each marker has its set representative populated in the parent (lower 64 bits)
-    uint64_t pass = 1;
-    do {
-        (data.disjointSetsPointer)->parentUpdated = 0;
-        performanceLog << "    " << timestamp << " Iteration  " << pass << endl;
-        setupLoadBalancing(data.orientedMarkerCount, batchSize);
-        runThreads(&Assembler::createMarkerGraphVerticesThreadFunction2, threadCount);
-        performanceLog << "    " << timestamp << " Updated parent of - " << (data.disjointSetsPointer)->parentUpdated << " entries." << endl;
-        pass++;
-    } while ((data.disjointSetsPointer)->parentUpdated > 0 && pass <= 10);
-
-    if (pass > 10) {
-        // This should never happen. Even in a highly parallel environment (128 threads), convergence happens
-        // in 2 or 3 passes. It's definitely worth investigating if this ever happens.
-        string errorMsg = "DisjointSets parent information did not converge in " + to_string(pass) + " iterations.";
-        throw runtime_error(errorMsg);
-    }
-    
 
-    performanceLog << timestamp << "Verifying convergence of parent information." << endl;
+    // Find the disjoint set that each oriented marker was assigned to
+    // and store it in the parent (lower 64 bits) of each entry.
+    // All unions are complete, so set representatives no longer change
+    // and a single pass is guaranteed to be sufficient.
+    // See DisjointSets::linkToRepresentative.
+    performanceLog << timestamp << "Storing set representatives." << endl;
     setupLoadBalancing(data.orientedMarkerCount, batchSize);
-    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction21, threadCount);
-    performanceLog << timestamp << "Done verifying convergence of parent information." << endl;
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction2, threadCount);
+    performanceLog << timestamp << "Done storing set representatives." << endl;
 
 
     // data.disjointSetTable now has the correct set representative for entry N at location 2*N.
     // That's because DisjointSets stores parent information in the lower 64 bits of the 128 bits
     // it uses for each entry. Since we only care about these bits, we can compact data.disjointSetTable
     // and free up half the memory.
-    // This bit seems tricky to parallelize. It's not worth the effort as this is pretty fast as is.
+    // The compaction is done in place, in rounds. The first round processes
+    // entries [0, L) sequentially. Each following round processes entries [L, 2L)
+    // in parallel, then doubles L. This is safe because entries [L, 2L)
+    // are copied from entries at or above 2L, which were not yet overwritten,
+    // and only overwrite entries that were already copied.
     performanceLog << timestamp << "Compacting the Disjoint Set data-structure." << endl;
-    for(uint64_t i=0; i<data.orientedMarkerCount; i++) {
+    uint64_t compactionEnd = min(data.orientedMarkerCount, uint64_t(batchSize));
+    for(uint64_t i=0; i<compactionEnd; i++) {
         data.disjointSetTable[i] = data.disjointSetTable[2*i];
     }
+    while(compactionEnd < data.orientedMarkerCount) {
+        data.compactionBegin = compactionEnd;
+        compactionEnd = min(data.orientedMarkerCount, 2 * compactionEnd);
+        setupLoadBalancing(compactionEnd - data.compactionBegin, batchSize);
+        runThreads(&Assembler::createMarkerGraphVerticesThreadFunction21, threadCount);
+    }
     data.disjointSetTable.resize(data.orientedMarkerCount);
     data.disjointSetTable.unreserve();
     performanceLog << timestamp << "Done compacting the Disjoint Set data-structure." << endl;
@@ -177,6 +183,19 @@ void Assembler::createMarkerGraphVertices(
 
 
 
+    // If requested, create the vertices out of core.
+    if(externalSortBufferGigabytes > 0) {
+        createMarkerGraphVerticesExternal(minCoverage, maxCoverage,
+            peakFinderMinAreaFraction, peakFinderAreaStartIndex,
+            externalSortBufferGigabytes << 30, threadCount);
+        const double tTotal = seconds(steady_clock::now() - tBegin);
+        performanceLog << timestamp << "Computation of global marker graph vertices ";
+        performanceLog << "completed in " << tTotal << " s." << endl;
+        return;
+    }
+
+
+
     // Count the number of markers in each disjoint set
     // and store it in data.workArea.
     // We don't want to combine this with the previous block
@@ -207,7 +226,8 @@ void Assembler::createMarkerGraphVertices(
 
     // At this point, data.workArea contains the number of oriented markers in
     // each disjoint set.
-    // Compute a histogram of this distribution and write it to a csv file.
+    // Compute a histogram of this distribution and use it
+    // to select minCoverage, if necessary.
     {
         vector<uint64_t> histogram;
         for(MarkerGraph::VertexId i=0; i<data.orientedMarkerCount; i++) {
@@ -220,35 +240,8 @@ void Assembler::createMarkerGraphVertices(
             }
             ++histogram[markerCount];
         }
-
-        ofstream csv("DisjointSetsHistogram.csv");
-        csv << "Coverage,Frequency\n";
-        for(uint64_t coverage=0; coverage<histogram.size(); coverage++) {
-            const uint64_t frequency = histogram[coverage];
-            if(frequency) {
-                csv << coverage << "," << frequency << "\n";
-            }
-        }
-
-        if (minCoverage == 0) {
-            try {
-                shasta::PeakFinder p;
-                p.findPeaks(histogram);
-                minCoverage = p.findXCutoff(histogram, peakFinderMinAreaFraction, peakFinderAreaStartIndex);
-                cout << "Automatically selected value of MarkerGraph.minCoverage "
-                    "is " << minCoverage << endl;
-            }
-            catch (PeakFinderException& e){
-                minCoverage = 5;
-                cout <<
-                    "Unable to automatically select MarkerGraph.minCoverage. "
-                    "No significant cutoff found in disjoint sets size distribution. "
-                    "Observed peak has percent total area of " << e.observedPercentArea << endl <<
-                    "minPercentArea is " << e.minPercentArea << endl <<
-                    "See DisjointSetsHistogram.csv."
-                    "Using MarkerGraph.minCoverage = " << minCoverage << endl;
-            }
-        }
+        minCoverage = createMarkerGraphVerticesSelectMinCoverage(histogram,
+            minCoverage, peakFinderMinAreaFraction, peakFinderAreaStartIndex);
     }
     // Store the value of minCoverage actually used.
     assemblerInfo->markerGraphMinCoverageUsed = minCoverage;
@@ -262,21 +255,12 @@ void Assembler::createMarkerGraphVertices(
     // Note that this numbering is not yet the final vertex numbering,
     // as we will later remove "bad" vertices
     // (vertices with more than one marker on the same read).
-    // This block is recursive and cannot be multithreaded.
     performanceLog << timestamp << "Renumbering the disjoint sets." << endl;
-    MarkerGraph::VertexId newDisjointSetId = 0ULL;
-    for(MarkerGraph::VertexId oldDisjointSetId=0;
-        oldDisjointSetId<data.orientedMarkerCount; ++oldDisjointSetId) {
-        auto& w = data.workArea[oldDisjointSetId];
-        const MarkerGraph::VertexId markerCount = w;
-        if(markerCount<minCoverage || markerCount>maxCoverage) {
-            w = MarkerGraph::invalidVertexId;
-        } else {
-            w = newDisjointSetId;
-            ++newDisjointSetId;
-        }
-    }
-    const auto disjointSetCount = newDisjointSetId;
+    data.renumberUsingBadFlags = false;
+    data.renumberMinCoverage = minCoverage;
+    data.renumberMaxCoverage = maxCoverage;
+    const auto disjointSetCount = createMarkerGraphVerticesRenumber(
+        data.orientedMarkerCount, batchSize, threadCount);
     cout << "Kept " << disjointSetCount << " disjoint sets with coverage in the requested range." << endl;
 
 
@@ -292,15 +276,9 @@ void Assembler::createMarkerGraphVertices(
 
     // Reassign vertices to disjoint sets using this new numbering.
     // Vertices assigned to no disjoint set will store MarkerGraph::invalidVertexId.
-    // This could be multithreaded if necessary.
     performanceLog << timestamp << "Assigning vertices to renumbered disjoint sets." << endl;
-    for(MarkerGraph::VertexId markerId=0;
-        markerId<data.orientedMarkerCount; ++markerId) {
-        auto& d = data.disjointSetTable[markerId];
-        const auto oldId = d;
-        const auto newId = data.workArea[oldId];
-        d = newId;
-    }
+    setupLoadBalancing(data.orientedMarkerCount, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction10, threadCount);
     // We no longer need the workArea.
     data.workArea.remove();
 
@@ -396,18 +374,10 @@ void Assembler::createMarkerGraphVertices(
         largeDataName("tmp-WorkArea"),
         largeDataPageSize);
     data.workArea.reserveAndResize(disjointSetCount);
-    newDisjointSetId = 0ULL;
-    for(MarkerGraph::VertexId oldDisjointSetId=0;
-        oldDisjointSetId<disjointSetCount; ++oldDisjointSetId) {
-        auto& w = data.workArea[oldDisjointSetId];
-        if(data.isBadDisjointSet[oldDisjointSetId]) {
-            w = MarkerGraph::invalidVertexId;
-        } else {
-            w = newDisjointSetId;
-            ++newDisjointSetId;
-        }
-    }
-    SHASTA_ASSERT(newDisjointSetId + badDisjointSetCount == disjointSetCount);
+    data.renumberUsingBadFlags = true;
+    const uint64_t goodDisjointSetCount = createMarkerGraphVerticesRenumber(
+        disjointSetCount, batchSize, threadCount);
+    SHASTA_ASSERT(goodDisjointSetCount + badDisjointSetCount == disjointSetCount);
 
 
 
@@ -422,21 +392,13 @@ void Assembler::createMarkerGraphVertices(
 
     // Compute the final disjoint set number for each marker.
     // That becomes the vertex id assigned to that marker.
-    // This could be multithreaded.
     performanceLog << timestamp << "Assigning vertex ids to markers." << endl;
     markerGraph.vertexTable.createNew(
         largeDataName("MarkerGraphVertexTable"),
         largeDataPageSize);
     markerGraph.vertexTable.reserveAndResize(data.orientedMarkerCount);
-    for(MarkerGraph::VertexId markerId=0;
-        markerId<data.orientedMarkerCount; ++markerId) {
-        auto oldValue = data.disjointSetTable[markerId];
-        if(oldValue == MarkerGraph::invalidVertexId) {
-            markerGraph.vertexTable[markerId] = MarkerGraph::invalidCompressedVertexId;
-        } else {
-        	markerGraph.vertexTable[markerId] = data.workArea[oldValue];
-        }
-    }
+    setupLoadBalancing(data.orientedMarkerCount, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction11, threadCount);
 
     data.workArea.remove();
     data.disjointSetTable.remove();
@@ -524,7 +486,6 @@ void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
 
     array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
     AlignmentGraph graph;
-    Alignment alignment;
     AlignmentInfo alignmentInfo;
 
     auto& data = createMarkerGraphVerticesData;
@@ -580,27 +541,28 @@ void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
             // Sanity check.
             SHASTA_ASSERT(alignmentData[alignmentId].info.isInReadGraph);
 
-            // Decompress this alignment.
-            span<const char> compressedAlignment = storedAlignments[alignmentId];
-            shasta::decompress(compressedAlignment, alignment);
-
-
             // In the global marker graph, merge pairs
-            // of aligned markers.
-            for(const auto& p: alignment.ordinals) {
-                const uint32_t ordinal0 = p[0];
-                const uint32_t ordinal1 = p[1];
-                const MarkerId markerId0 = getMarkerId(orientedReadIds[0], ordinal0);
-                const MarkerId markerId1 = getMarkerId(orientedReadIds[1], ordinal1);
-                SHASTA_ASSERT(markers.begin()[markerId0].kmerId == markers.begin()[markerId1].kmerId);
-                disjointSetsPointer->unite(markerId0, markerId1);
-
-                // Also merge the reverse complemented markers.
-                // This guarantees that the marker graph remains invariant
-                // under strand swap.
-                disjointSetsPointer->unite(
-                    findReverseComplement(markerId0),
-                    findReverseComplement(markerId1));
+            // of aligned markers. We decode the compressed alignment
+            // one streak at a time. In a streak, the MarkerIds
+            // increase by one at each step, and the MarkerIds
+            // of the reverse complemented markers decrease by one.
+            span<const char> compressedAlignment = storedAlignments[alignmentId];
+            compressAlignment::StreakDecoder decoder(compressedAlignment);
+            compressAlignment::Streak streak;
+            while(decoder.next(streak)) {
+                const MarkerId markerId0 = getMarkerId(orientedReadIds[0], streak.ordinal0);
+                const MarkerId markerId1 = getMarkerId(orientedReadIds[1], streak.ordinal1);
+                const MarkerId markerId0Rc = getReverseComplementMarkerId(orientedReadIds[0], streak.ordinal0);
+                const MarkerId markerId1Rc = getReverseComplementMarkerId(orientedReadIds[1], streak.ordinal1);
+                for(uint32_t j=0; j<streak.n; j++) {
+                    SHASTA_ASSERT(markers.begin()[markerId0 + j].kmerId == markers.begin()[markerId1 + j].kmerId);
+                    disjointSetsPointer->unite(markerId0 + j, markerId1 + j);
+
+                    // Also merge the reverse complemented markers.
+                    // This guarantees that the marker graph remains invariant
+                    // under strand swap.
+                    disjointSetsPointer->unite(markerId0Rc - j, markerId1Rc - j);
+                }
             }
         }
     }
@@ -616,25 +578,26 @@ void Assembler::createMarkerGraphVerticesThreadFunction2(size_t threadId)
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
         for(MarkerId i=begin; i!=end; ++i) {
-            // Update parent information.
-            disjointSets.find(i, true);
+            // Store the set representative in the parent information.
+            disjointSets.linkToRepresentative(i);
         }
     }
 }
 
+
+
+// One round of the in-place compaction of data.disjointSetTable.
+// See createMarkerGraphVertices for details.
 void Assembler::createMarkerGraphVerticesThreadFunction21(size_t threadId)
 {
-    DisjointSets& disjointSets = *createMarkerGraphVerticesData.disjointSetsPointer;
-    const auto& disjointSetTable = createMarkerGraphVerticesData.disjointSetTable;
+    auto& data = createMarkerGraphVerticesData;
+    MarkerGraph::VertexId* disjointSetTable = data.disjointSetTable.begin();
+    const uint64_t offset = data.compactionBegin;
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
-        for(MarkerId i=begin; i!=end; ++i) {
-            // Verify that parent has been populated (I.e convergence happened after some iterations of
-            // createMarkerGraphVerticesThreadFunction2)
-            SHASTA_ASSERT(disjointSets.parent(i) == disjointSets.find(i));
-            // Verify that reinterpreting DisjointSets data as a vector of uint64_t will work as expected.
-            SHASTA_ASSERT(disjointSets.parent(i) == disjointSetTable[2*i]);
+        for(uint64_t i=offset+begin; i!=offset+end; ++i) {
+            disjointSetTable[i] = disjointSetTable[2*i];
         }
     }
 }
@@ -650,6 +613,11 @@ void Assembler::createMarkerGraphVerticesThreadFunction3(size_t threadId)
         for(MarkerId i=begin; i!=end; ++i) {
             const uint64_t disjointSetId = disjointSetTable[i];
 
+            // The set representative is its own representative.
+            // This verifies that createMarkerGraphVerticesThreadFunction2
+            // and the compaction of data.disjointSetTable worked as expected.
+            SHASTA_ASSERT(disjointSetTable[disjointSetId] == disjointSetId);
+
             // Increment the set size in a thread-safe way.
             __sync_fetch_and_add(&workArea[disjointSetId], 1ULL);
         }
@@ -698,53 +666,405 @@ void Assembler::createMarkerGraphVerticesThreadFunction7(size_t threadId)
 {
     const auto& disjointSetMarkers = createMarkerGraphVerticesData.disjointSetMarkers;
     auto& isBadDisjointSet = createMarkerGraphVerticesData.isBadDisjointSet;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(MarkerGraph::VertexId disjointSetId=begin; disjointSetId!=end; ++disjointSetId) {
+            const auto markers = disjointSetMarkers[disjointSetId];
+            isBadDisjointSet[disjointSetId] = createMarkerGraphVerticesIsBadDisjointSet(
+                span<const MarkerId>(markers.begin(), markers.end()));
+        }
+    }
+}
+
+
+
+// Return true if a disjoint set with the given markers,
+// sorted by MarkerId, is "bad". See createMarkerGraphVerticesThreadFunction7.
+bool Assembler::createMarkerGraphVerticesIsBadDisjointSet(span<const MarkerId> markers) const
+{
     const auto allowDuplicateMarkers = createMarkerGraphVerticesData.allowDuplicateMarkers;
     const auto minCoveragePerStrand = createMarkerGraphVerticesData.minCoveragePerStrand;
 
+    const size_t markerCount = markers.size();
+    SHASTA_ASSERT(markerCount > 0);
+    if(markerCount == 1) {
+        return 1 < minCoveragePerStrand;
+    }
+    array<uint64_t, 2> countByStrand = {0, 0};
+    for(size_t j=0; j<markerCount; j++) {
+        const MarkerId& markerId = markers[j];
+        OrientedReadId orientedReadId;
+        tie(orientedReadId, ignore) = findMarkerId(markerId);
+        ++countByStrand[orientedReadId.getStrand()];
+
+        if((not allowDuplicateMarkers) and j > 0) {
+            const MarkerId& previousMarkerId = markers[j-1];
+            OrientedReadId previousOrientedReadId;
+            tie(previousOrientedReadId, ignore) = findMarkerId(previousMarkerId);
+            if(orientedReadId.getReadId() == previousOrientedReadId.getReadId()) {
+                return true;
+            }
+        }
+    }
+
+    // If we did not flag it above due to more than one marker on the
+    // same oriented read, check it for sufficient coverage on each strand.
+    return
+        (countByStrand[0] < minCoveragePerStrand) or
+        (countByStrand[1] < minCoveragePerStrand);
+}
+
+
+
+// Parallel renumbering of disjoint sets [0, n), using data.workArea.
+// Disjoint sets that are kept (see data.renumberUsingBadFlags)
+// get consecutive new ids in order of their old ids,
+// and the others get MarkerGraph::invalidVertexId.
+// On return, data.workArea[oldId] contains the new id.
+// This is a parallel prefix sum:
+// - createMarkerGraphVerticesThreadFunction8 counts the disjoint sets
+//   that are kept in each batch.
+// - The counts are converted to the first new id of each batch.
+// - createMarkerGraphVerticesThreadFunction9 assigns the new ids.
+// Returns the number of disjoint sets that were kept.
+uint64_t Assembler::createMarkerGraphVerticesRenumber(
+    uint64_t n,
+    uint64_t batchSize,
+    size_t threadCount)
+{
+    auto& data = createMarkerGraphVerticesData;
+    data.renumberBatchSize = batchSize;
+    data.renumberBatchOffsets.clear();
+    data.renumberBatchOffsets.resize((n + batchSize - 1) / batchSize, 0);
+
+    setupLoadBalancing(n, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction8, threadCount);
+
+    uint64_t keptCount = 0;
+    for(uint64_t& offset: data.renumberBatchOffsets) {
+        const uint64_t batchKeptCount = offset;
+        offset = keptCount;
+        keptCount += batchKeptCount;
+    }
+
+    setupLoadBalancing(n, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction9, threadCount);
+
+    data.renumberBatchOffsets.clear();
+    data.renumberBatchOffsets.shrink_to_fit();
+    return keptCount;
+}
+
+
+
+// Renumbering of disjoint sets, pass 1.
+// Flag the disjoint sets that are not kept by storing
+// MarkerGraph::invalidVertexId in data.workArea,
+// and count the ones that are kept in each batch.
+void Assembler::createMarkerGraphVerticesThreadFunction8(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    MarkerGraph::VertexId* workArea = data.workArea.begin();
+
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
-        for(MarkerGraph::VertexId disjointSetId=begin; disjointSetId!=end; ++disjointSetId) {
-            auto markers = disjointSetMarkers[disjointSetId];
-            const size_t markerCount = markers.size();
-            SHASTA_ASSERT(markerCount > 0);
-            isBadDisjointSet[disjointSetId] = false;
-            if(markerCount == 1) {
-                if(1 < minCoveragePerStrand) {
-                    isBadDisjointSet[disjointSetId] = true;
-                }
-                continue;
+        uint64_t keptCount = 0;
+        for(MarkerGraph::VertexId i=begin; i!=end; ++i) {
+            bool keep;
+            if(data.renumberUsingBadFlags) {
+                keep = not data.isBadDisjointSet[i];
+            } else {
+                const MarkerGraph::VertexId markerCount = workArea[i];
+                keep = (markerCount >= data.renumberMinCoverage) and
+                    (markerCount <= data.renumberMaxCoverage);
             }
-            array<uint64_t, 2> countByStrand = {0, 0};
-            for(size_t j=0; j<markerCount; j++) {
-                const MarkerId& markerId = markers[j];
-                OrientedReadId orientedReadId;
-                tie(orientedReadId, ignore) = findMarkerId(markerId);
-                ++countByStrand[orientedReadId.getStrand()];
-
-                if((not allowDuplicateMarkers) and j > 0) {
-                    const MarkerId& previousMarkerId = markers[j-1];
-                    OrientedReadId previousOrientedReadId;
-                    tie(previousOrientedReadId, ignore) = findMarkerId(previousMarkerId);
-                    if(orientedReadId.getReadId() == previousOrientedReadId.getReadId()) {
-                        isBadDisjointSet[disjointSetId] = true;
-                        break;
-                    }
-                }
+            if(keep) {
+                workArea[i] = 0;
+                ++keptCount;
+            } else {
+                workArea[i] = MarkerGraph::invalidVertexId;
+            }
+        }
+        data.renumberBatchOffsets[begin / data.renumberBatchSize] = keptCount;
+    }
+}
+
+
+
+// Renumbering of disjoint sets, pass 2.
+// Assign the new ids, starting at the first new id of each batch.
+void Assembler::createMarkerGraphVerticesThreadFunction9(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    MarkerGraph::VertexId* workArea = data.workArea.begin();
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        MarkerGraph::VertexId newId = data.renumberBatchOffsets[begin / data.renumberBatchSize];
+        for(MarkerGraph::VertexId i=begin; i!=end; ++i) {
+            if(workArea[i] != MarkerGraph::invalidVertexId) {
+                workArea[i] = newId++;
+            }
+        }
+    }
+}
+
+
+
+// Reassign markers to disjoint sets using the first renumbering.
+void Assembler::createMarkerGraphVerticesThreadFunction10(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    MarkerGraph::VertexId* disjointSetTable = data.disjointSetTable.begin();
+    const MarkerGraph::VertexId* workArea = data.workArea.begin();
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(MarkerId markerId=begin; markerId!=end; ++markerId) {
+            MarkerGraph::VertexId& d = disjointSetTable[markerId];
+            d = workArea[d];
+        }
+    }
+}
+
+
+
+// Store the final vertex id of each marker in the vertex table.
+void Assembler::createMarkerGraphVerticesThreadFunction11(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    const MarkerGraph::VertexId* disjointSetTable = data.disjointSetTable.begin();
+    const MarkerGraph::VertexId* workArea = data.workArea.begin();
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(MarkerId markerId=begin; markerId!=end; ++markerId) {
+            const MarkerGraph::VertexId oldValue = disjointSetTable[markerId];
+            if(oldValue == MarkerGraph::invalidVertexId) {
+                markerGraph.vertexTable[markerId] = MarkerGraph::invalidCompressedVertexId;
+            } else {
+                markerGraph.vertexTable[markerId] = workArea[oldValue];
             }
+        }
+    }
+}
+
+
+
+// Out of core version of the second part of createMarkerGraphVertices,
+// used when externalSortBufferGigabytes is not zero.
+// On entry, data.disjointSetTable contains, for each oriented marker,
+// its set representative.
+// Pairs (disjoint set, marker) are sorted in runs that are written to disk,
+// then the runs are merged twice:
+// - The first merge computes the histogram of disjoint set sizes,
+//   used to select minCoverage if necessary.
+// - The second merge streams the markers of each disjoint set,
+//   already sorted, and stores the vertices directly in markerGraph.vertices()
+//   and markerGraph.vertexTable.
+// This creates the same vertices, with the same numbering, as the
+// in-memory code in createMarkerGraphVertices, and does not use
+// data.workArea, data.disjointSetMarkers, or data.isBadDisjointSet.
+// Memory used for the runs and merge buffers is bounded by
+// sortBufferBytes. The compacted disjoint set table,
+// the markers, and the marker graph vertices and vertexTable
+// are memory mapped and are not included in that bound.
+void Assembler::createMarkerGraphVerticesExternal(
+    uint64_t minCoverage,
+    uint64_t maxCoverage,
+    double peakFinderMinAreaFraction,
+    uint64_t peakFinderAreaStartIndex,
+    uint64_t sortBufferBytes,
+    size_t threadCount)
+{
+    using Pair = pair<MarkerGraph::VertexId, MarkerId>;
+    auto& data = createMarkerGraphVerticesData;
+
+    // Create the sorted runs. Each thread sorts one run at a time.
+    data.externalRunMarkerCount = max(uint64_t(1),
+        sortBufferBytes / (sizeof(Pair) * threadCount));
+    const uint64_t runCount =
+        (data.orientedMarkerCount + data.externalRunMarkerCount - 1) / data.externalRunMarkerCount;
+    performanceLog << timestamp << "Writing " << runCount <<
+        " sorted runs of markers in disjoint sets." << endl;
+    // The runs are written with the other binary data, unless those are
+    // in anonymous memory or on hugetlbfs, which does not support
+    // ordinary writes. In that case they go to the current directory.
+    const string runFileNamePrefix =
+        (largeDataFileNamePrefix.empty() or largeDataPageSize != 4096) ?
+        string("tmp-MarkerGraphVertices-Run-") :
+        largeDataName("tmp-MarkerGraphVertices-Run-");
+    data.externalRuns = make_shared< ExternalSortRuns<Pair> >(
+        runFileNamePrefix, runCount);
+    setupLoadBalancing(data.orientedMarkerCount, data.externalRunMarkerCount);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction12, threadCount);
+    data.disjointSetTable.remove();
+
 
-            // If we did not flag it above due to more than one marker on the
-            // same oriented read, check it for sufficient coverage on each strand.
-            if(not isBadDisjointSet[disjointSetId]) {
-                isBadDisjointSet[disjointSetId] =
-                    (countByStrand[0] < minCoveragePerStrand) or
-                    (countByStrand[1] < minCoveragePerStrand);
+
+    // Compute the histogram of disjoint set sizes
+    // and use it to select minCoverage, if necessary.
+    performanceLog << timestamp << "Computing disjoint set sizes." << endl;
+    {
+        vector<uint64_t> histogram;
+        MarkerGraph::VertexId currentDisjointSetId = MarkerGraph::invalidVertexId;
+        uint64_t markerCount = 0;
+        auto endDisjointSet = [&]() {
+            if(markerCount > 0) {
+                if(markerCount >= histogram.size()) {
+                    histogram.resize(markerCount+1, 0);
+                }
+                ++histogram[markerCount];
             }
+        };
+        data.externalRuns->merge(sortBufferBytes, [&](const Pair& p) {
+            if(p.first != currentDisjointSetId) {
+                endDisjointSet();
+                currentDisjointSetId = p.first;
+                markerCount = 0;
+            }
+            ++markerCount;
+        });
+        endDisjointSet();
+        minCoverage = createMarkerGraphVerticesSelectMinCoverage(histogram,
+            minCoverage, peakFinderMinAreaFraction, peakFinderAreaStartIndex);
+    }
+    assemblerInfo->markerGraphMinCoverageUsed = minCoverage;
+
+
+
+    // Create the vertices, keeping disjoint sets with size in
+    // [minCoverage, maxCoverage] that are not bad.
+    performanceLog << timestamp << "Creating marker graph vertices." << endl;
+    markerGraph.vertexTable.createNew(
+        largeDataName("MarkerGraphVertexTable"),
+        largeDataPageSize);
+    markerGraph.vertexTable.reserveAndResize(data.orientedMarkerCount);
+    fill(markerGraph.vertexTable.begin(), markerGraph.vertexTable.end(),
+        MarkerGraph::invalidCompressedVertexId);
+    markerGraph.constructVertices();
+    markerGraph.vertices().createNew(
+        largeDataName("MarkerGraphVertices"),
+        largeDataPageSize);
+    {
+        uint64_t keptCount = 0;
+        uint64_t badCount = 0;
+        MarkerGraph::VertexId currentDisjointSetId = MarkerGraph::invalidVertexId;
+        uint64_t markerCount = 0;
+
+        // The markers of the current disjoint set.
+        // We stop storing them when there are more than maxCoverage.
+        vector<MarkerId> disjointSetMarkers;
+
+        auto endDisjointSet = [&]() {
+            if(markerCount < minCoverage or markerCount > maxCoverage) {
+                return;
+            }
+            ++keptCount;
+            if(createMarkerGraphVerticesIsBadDisjointSet(
+                span<const MarkerId>(disjointSetMarkers.data(),
+                disjointSetMarkers.data() + disjointSetMarkers.size()))) {
+                ++badCount;
+                return;
+            }
+            const MarkerGraph::VertexId vertexId = markerGraph.vertices().size();
+            markerGraph.vertices().appendVector();
+            for(const MarkerId markerId: disjointSetMarkers) {
+                markerGraph.vertices().append(markerId);
+                markerGraph.vertexTable[markerId] = vertexId;
+            }
+        };
+        data.externalRuns->merge(sortBufferBytes, [&](const Pair& p) {
+            if(p.first != currentDisjointSetId) {
+                endDisjointSet();
+                currentDisjointSetId = p.first;
+                markerCount = 0;
+                disjointSetMarkers.clear();
+            }
+            ++markerCount;
+            if(markerCount <= maxCoverage) {
+                disjointSetMarkers.push_back(p.second);
+            }
+        });
+        endDisjointSet();
+        markerGraph.vertices().unreserve();
+
+        cout << "Kept " << keptCount << " disjoint sets with coverage in the requested range." << endl;
+        cout << "Found " << badCount << " disjoint sets "
+            "with more than one marker on a single oriented read "
+            "or with less than " << data.minCoveragePerStrand <<
+            " supporting oriented reads on each strand." << endl;
+    }
+    data.externalRuns = 0;
+}
+
+
+
+// Write one sorted run of pairs (disjoint set, marker)
+// for each batch of markers. See createMarkerGraphVerticesExternal.
+void Assembler::createMarkerGraphVerticesThreadFunction12(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    const MarkerGraph::VertexId* disjointSetTable = data.disjointSetTable.begin();
+
+    vector< pair<MarkerGraph::VertexId, MarkerId> > run;
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        run.clear();
+        for(MarkerId markerId=begin; markerId!=end; ++markerId) {
+            run.push_back(make_pair(disjointSetTable[markerId], markerId));
         }
+        sort(run.begin(), run.end());
+        data.externalRuns->writeRun(begin / data.externalRunMarkerCount, run);
     }
 }
 
 
 
+// Write the histogram of disjoint set sizes to DisjointSetsHistogram.csv.
+// If minCoverage is zero, use it to select minCoverage.
+// Returns the value of minCoverage to be used.
+uint64_t Assembler::createMarkerGraphVerticesSelectMinCoverage(
+    const vector<uint64_t>& histogram,
+    uint64_t minCoverage,
+    double peakFinderMinAreaFraction,
+    uint64_t peakFinderAreaStartIndex)
+{
+    ofstream csv("DisjointSetsHistogram.csv");
+    csv << "Coverage,Frequency\n";
+    for(uint64_t coverage=0; coverage<histogram.size(); coverage++) {
+        const uint64_t frequency = histogram[coverage];
+        if(frequency) {
+            csv << coverage << "," << frequency << "\n";
+        }
+    }
+
+    if (minCoverage == 0) {
+        try {
+            shasta::PeakFinder p;
+            p.findPeaks(histogram);
+            minCoverage = p.findXCutoff(histogram, peakFinderMinAreaFraction, peakFinderAreaStartIndex);
+            cout << "Automatically selected value of MarkerGraph.minCoverage "
+                "is " << minCoverage << endl;
+        }
+        catch (PeakFinderException& e){
+            minCoverage = 5;
+            cout <<
+                "Unable to automatically select MarkerGraph.minCoverage. "
+                "No significant cutoff found in disjoint sets size distribution. "
+                "Observed peak has percent total area of " << e.observedPercentArea << endl <<
+                "minPercentArea is " << e.minPercentArea << endl <<
+                "See DisjointSetsHistogram.csv."
+                "Using MarkerGraph.minCoverage = " << minCoverage << endl;
+        }
+    }
+
+    return minCoverage;
+}
+
+
+
 void Assembler::createMarkerGraphVerticesThreadFunction45(int value)
 {
     SHASTA_ASSERT(value==4 || value==5);
@@ -1628,8 +1948,17 @@ void Assembler::vertexCoverageStatisticsByKmerId() const
 
     const uint64_t k = assemblerInfo->k;
 
-    // For each KmerId, maintain a histogram by coverage.
-    vector< vector<uint64_t> > histogram(kmerTable.size());
+    // Gather the marker k-mers without repeated consecutive bases, sorted.
+    vector<KmerId> markerKmerIds;
+    getMarkerKmerIds(markerKmerIds);
+    markerKmerIds.erase(
+        std::remove_if(markerKmerIds.begin(), markerKmerIds.end(),
+            [this, k](KmerId kmerId) {return not isRleKmer(getKmer(kmerId), k);}),
+        markerKmerIds.end());
+
+    // For each of these k-mers, maintain a histogram by coverage.
+    // The histogram is indexed by the index of the k-mer in markerKmerIds.
+    vector< vector<uint64_t> > histogram(markerKmerIds.size());
 
     // Loop over all marker graph vertices.
     for(MarkerGraph::VertexId vertexId=0; vertexId!=markerGraph.vertexCount(); vertexId++) {
@@ -1645,8 +1974,12 @@ void Assembler::vertexCoverageStatisticsByKmerId() const
         const KmerId kmerId = compressedMarker.kmerId;
 
         // Increment the histogram.
-        SHASTA_ASSERT(kmerId < histogram.size());
-        vector<uint64_t>& h = histogram[kmerId];
+        // Markers with k-mers containing repeated consecutive bases are skipped.
+        const auto it = std::lower_bound(markerKmerIds.begin(), markerKmerIds.end(), kmerId);
+        if(it == markerKmerIds.end() or *it != kmerId) {
+            continue;
+        }
+        vector<uint64_t>& h = histogram[it - markerKmerIds.begin()];
         if(h.size() <= coverage) {
             h.resize(coverage + 1, 0ULL);
         }
@@ -1657,14 +1990,7 @@ void Assembler::vertexCoverageStatisticsByKmerId() const
 
     // Find the maximum histogram size for any k-mer.
     uint64_t hMaxSize = 0ULL;
-    for(uint64_t kmerId=0; kmerId<kmerTable.size(); kmerId++) {
-        if(not kmerTable[kmerId].isMarker) {
-            continue;
-        }
-        if(not kmerTable[kmerId].isRleKmer) {
-            continue;
-        }
-        const vector<uint64_t>& h = histogram[kmerId];
+    for(const vector<uint64_t>& h: histogram) {
         hMaxSize = max(hMaxSize, uint64_t(h.size()));
     }
 
@@ -1677,18 +2003,12 @@ void Assembler::vertexCoverageStatisticsByKmerId() const
         csv << coverage << ",";
     }
     csv << "\n";
-    for(uint64_t kmerId=0; kmerId<kmerTable.size(); kmerId++) {
-        if(not kmerTable[kmerId].isMarker) {
-            continue;
-        }
-        if(not kmerTable[kmerId].isRleKmer) {
-            continue;
-        }
-        const Kmer kmer(kmerId, k);
+    for(uint64_t i=0; i<markerKmerIds.size(); i++) {
+        const Kmer64 kmer = getKmer(markerKmerIds[i]);
 
         // Compute the total number of markers with this k-mer
         // that are associated with a vertex.
-        const vector<uint64_t>& h = histogram[kmerId];
+        const vector<uint64_t>& h = histogram[i];
         uint64_t totalMarkerCount = 0ULL;
         for(uint64_t coverage=1; coverage<hMaxSize; coverage++) {
             uint64_t vertexCount = 0;
@@ -1781,10 +2101,39 @@ bool Assembler::extractLocalMarkerGraph(
     // Some vectors used inside the BFS.
     // Define them here to reduce memory allocation activity.
     vector<MarkerInterval> markerIntervals;
+    vector<MarkerGraph::Neighbor> neighborsBuffer;
+
+    // Function that returns true if an edge should be used,
+    // as specified by the arguments.
+    auto edgeIsUsable = [&](MarkerGraph::EdgeId edgeId) {
+        const auto& edge = markerGraph.edges[edgeId];
+        if(markerGraph.edgeMarkerIntervals.size(edgeId) < minEdgeCoverage) {
+            return false;
+        }
+        if(edge.wasRemovedByTransitiveReduction && !useWeakEdges) {
+            return false;
+        }
+        if(edge.wasPruned && !usePrunedEdges) {
+            return false;
+        }
+        if(edge.isSuperBubbleEdge && !useSuperBubbleEdges) {
+            return false;
+        }
+        if(edge.isLowCoverageCrossEdge && !useLowCoverageCrossEdges) {
+            return false;
+        }
+        if(edge.wasRemovedWhileSplittingSecondaryEdges && !useRemovedSecondaryEdges) {
+            return false;
+        }
+        return true;
+    };
 
 
     // Do the BFS to generate the vertices.
     // Edges will be created later.
+    // The neighbors of each vertex are visited using markerGraph.outNeighbors
+    // and markerGraph.inNeighbors, so edges to vertices that are
+    // already in the local marker graph don't need to be accessed.
     std::queue<vertex_descriptor> q;
     if(distance > 0) {
         q.push(vStart);
@@ -1805,93 +2154,32 @@ bool Assembler::extractLocalMarkerGraph(
         const uint64_t distance0 = vertex0.distance;
         const uint64_t distance1 = distance0 + 1;
 
-        // Loop over the children.
-        const auto childEdges = markerGraph.edgesBySource[vertexId0];
-        for(uint64_t edgeId: childEdges) {
-            const auto& edge = markerGraph.edges[edgeId];
-
-            // Skip this edge if the arguments require it.
-            if(markerGraph.edgeMarkerIntervals[edgeId].size() < minEdgeCoverage) {
-                continue;
-            }
-            if(edge.wasRemovedByTransitiveReduction && !useWeakEdges) {
-                continue;
-            }
-            if(edge.wasPruned && !usePrunedEdges) {
-                continue;
-            }
-            if(edge.isSuperBubbleEdge && !useSuperBubbleEdges) {
-                continue;
-            }
-            if(edge.isLowCoverageCrossEdge && !useLowCoverageCrossEdges) {
-                continue;
-            }
-            if(edge.wasRemovedWhileSplittingSecondaryEdges && !useRemovedSecondaryEdges) {
-                continue;
-            }
-
-            const MarkerGraph::VertexId vertexId1 = edge.target;
-            SHASTA_ASSERT(edge.source == vertexId0);
-            SHASTA_ASSERT(vertexId1 < markerGraph.vertexCount());
-
-            // If vertex coverage is too low, skip it.
-            if(markerGraph.vertexCoverage(vertexId1) < minVertexCoverage) {
-                continue;
-            }
-
-            // Find the vertex corresponding to this child, creating it if necessary.
-            bool vertexExists;
-            vertex_descriptor v1;
-            tie(vertexExists, v1) = graph.findVertex(vertexId1);
-            if(!vertexExists) {
-                v1 = graph.addVertex(
-                    vertexId1, distance1, markerGraph.getVertexMarkerIds(vertexId1));
-                if(distance1 < distance) {
-                    q.push(v1);
+        // Loop over the children, then over the parents.
+        for(uint64_t direction=0; direction<2; direction++) {
+            const span<const MarkerGraph::Neighbor> neighbors = (direction == 0) ?
+                markerGraph.getOutNeighbors(vertexId0, neighborsBuffer) :
+                markerGraph.getInNeighbors(vertexId0, neighborsBuffer);
+            for(const MarkerGraph::Neighbor& neighbor: neighbors) {
+                const MarkerGraph::VertexId vertexId1 = neighbor.vertexId;
+                SHASTA_ASSERT(vertexId1 < markerGraph.vertexCount());
+
+                // If we already have this vertex, there is nothing to do.
+                if(graph.findVertex(vertexId1).first) {
+                    continue;
                 }
-            }
-        }
 
-        // Loop over the parents.
-        const auto parentEdges = markerGraph.edgesByTarget[vertexId0];
-        for(uint64_t edgeId: parentEdges) {
-            const auto& edge = markerGraph.edges[edgeId];
-
-            // Skip this edge if the arguments require it.
-            if(markerGraph.edgeMarkerIntervals[edgeId].size() < minEdgeCoverage) {
-                continue;
-            }
-            if(edge.wasRemovedByTransitiveReduction && !useWeakEdges) {
-                continue;
-            }
-            if(edge.wasPruned && !usePrunedEdges) {
-                continue;
-            }
-            if(edge.isSuperBubbleEdge && !useSuperBubbleEdges) {
-                continue;
-            }
-            if(edge.isLowCoverageCrossEdge && !useLowCoverageCrossEdges) {
-                continue;
-            }
-            if(edge.wasRemovedWhileSplittingSecondaryEdges && !useRemovedSecondaryEdges) {
-                continue;
-            }
-
-            const MarkerGraph::VertexId vertexId1 = edge.source;
-            SHASTA_ASSERT(edge.target == vertexId0);
-            SHASTA_ASSERT(vertexId1 < markerGraph.vertexCount());
+                // Skip this edge if the arguments require it.
+                if(not edgeIsUsable(neighbor.edgeId)) {
+                    continue;
+                }
 
-            // If vertex coverage is too low, skip it.
-            if(markerGraph.vertexCoverage(vertexId1) < minVertexCoverage) {
-                continue;
-            }
+                // If vertex coverage is too low, skip it.
+                if(markerGraph.vertexCoverage(vertexId1) < minVertexCoverage) {
+                    continue;
+                }
 
-            // Find the vertex corresponding to this child, creating it if necessary.
-            bool vertexExists;
-            vertex_descriptor v1;
-            tie(vertexExists, v1) = graph.findVertex(vertexId1);
-            if(!vertexExists) {
-                v1 = graph.addVertex(
+                // Create the vertex corresponding to this neighbor.
+                const vertex_descriptor v1 = graph.addVertex(
                     vertexId1, distance1, markerGraph.getVertexMarkerIds(vertexId1));
                 if(distance1 < distance) {
                     q.push(v1);
@@ -1907,46 +2195,27 @@ bool Assembler::extractLocalMarkerGraph(
         const LocalMarkerGraphVertex& vertex0 = graph[v0];
         const MarkerGraph::VertexId vertexId0 = vertex0.vertexId;
 
-        // Loop over the children that exist in the local marker graph
-        // and are also at maximum distance.
-        const auto childEdges = markerGraph.edgesBySource[vertexId0];
-        for(uint64_t edgeId: childEdges) {
-            const auto& edge = markerGraph.edges[edgeId];
-
-            // Skip this edge if the arguments require it.
-            if(markerGraph.edgeMarkerIntervals[edgeId].size() < minEdgeCoverage) {
-                continue;
-            }
-            if(edge.wasRemovedByTransitiveReduction && !useWeakEdges) {
-                continue;
-            }
-            if(edge.wasPruned && !usePrunedEdges) {
-                continue;
-            }
-            if(edge.isSuperBubbleEdge && !useSuperBubbleEdges) {
-                continue;
-            }
-            if(edge.isLowCoverageCrossEdge && !useLowCoverageCrossEdges) {
-                continue;
-            }
-            if(edge.wasRemovedWhileSplittingSecondaryEdges && !useRemovedSecondaryEdges) {
-                continue;
-            }
-
-            const MarkerGraph::VertexId vertexId1 = edge.target;
-            SHASTA_ASSERT(edge.source == vertexId0);
+        // Loop over the children that exist in the local marker graph.
+        for(const MarkerGraph::Neighbor& neighbor:
+            markerGraph.getOutNeighbors(vertexId0, neighborsBuffer)) {
+            const MarkerGraph::VertexId vertexId1 = neighbor.vertexId;
             SHASTA_ASSERT(vertexId1 < markerGraph.vertexCount());
 
             // See if we have a vertex for this global vertex id.
+            // If it does not exist in the local marker graph, skip.
             bool vertexExists;
             vertex_descriptor v1;
             tie(vertexExists, v1) = graph.findVertex(vertexId1);
-
-            // If it does not exist in the local marker graph, skip.
             if(!vertexExists) {
                 continue;
             }
 
+            // Skip this edge if the arguments require it.
+            const uint64_t edgeId = neighbor.edgeId;
+            if(not edgeIsUsable(edgeId)) {
+                continue;
+            }
+
             // Add the edge.
             edge_descriptor e;
             bool edgeWasAdded = false;
@@ -2010,6 +2279,7 @@ bool Assembler::extractLocalMarkerGraph(
         computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
             edge.edgeId,
             markerGraphEdgeLengthThresholdForConsensus,
+            1.,
             spoaAlignmentEngine,
             spoaAlignmentGraph,
             edge.consensusSequence,
@@ -2086,6 +2356,7 @@ void Assembler::createMarkerGraphEdges(size_t threadCount)
 
 
 
+// This also creates markerGraph.outNeighbors and markerGraph.inNeighbors.
 void Assembler::createMarkerGraphEdgesBySourceAndTarget(size_t threadCount)
 {
     markerGraph.edgesBySource.createNew(
@@ -2094,21 +2365,42 @@ void Assembler::createMarkerGraphEdgesBySourceAndTarget(size_t threadCount)
     markerGraph.edgesByTarget.createNew(
         largeDataName("GlobalMarkerGraphEdgesByTarget"),
         largeDataPageSize);
+    if(markerGraph.outNeighbors.isOpen()) {
+        markerGraph.outNeighbors.close();
+    }
+    if(markerGraph.inNeighbors.isOpen()) {
+        markerGraph.inNeighbors.close();
+    }
+    markerGraph.outNeighbors.createNew(
+        largeDataName("GlobalMarkerGraphOutNeighbors"),
+        largeDataPageSize);
+    markerGraph.inNeighbors.createNew(
+        largeDataName("GlobalMarkerGraphInNeighbors"),
+        largeDataPageSize);
 
     // cout << timestamp << "Create marker graph edges by source and target: pass 1 begins." << endl;
     markerGraph.edgesBySource.beginPass1(markerGraph.vertexCount());
     markerGraph.edgesByTarget.beginPass1(markerGraph.vertexCount());
+    markerGraph.outNeighbors.beginPass1(markerGraph.vertexCount());
+    markerGraph.inNeighbors.beginPass1(markerGraph.vertexCount());
     setupLoadBalancing(markerGraph.edges.size(), 100000);
     runThreads(&Assembler::createMarkerGraphEdgesThreadFunction1, threadCount);
 
     // cout << timestamp << "Create marker graph edges by source and target: pass 2 begins." << endl;
     markerGraph.edgesBySource.beginPass2();
     markerGraph.edgesByTarget.beginPass2();
+    markerGraph.outNeighbors.beginPass2();
+    markerGraph.inNeighbors.beginPass2();
     setupLoadBalancing(markerGraph.edges.size(), 100000);
     runThreads(&Assembler::createMarkerGraphEdgesThreadFunction2, threadCount);
     markerGraph.edgesBySource.endPass2();
     markerGraph.edgesByTarget.endPass2();
+    markerGraph.outNeighbors.endPass2();
+    markerGraph.inNeighbors.endPass2();
 
+    // Sort the neighbors of each vertex.
+    setupLoadBalancing(markerGraph.vertexCount(), 10000);
+    runThreads(&Assembler::createMarkerGraphEdgesThreadFunction3, threadCount);
 }
 
 
@@ -2203,14 +2495,34 @@ void Assembler::createMarkerGraphEdgesThreadFunction12(size_t threadId, size_t p
             if(pass == 1) {
                 markerGraph.edgesBySource.incrementCountMultithreaded(edge.source);
                 markerGraph.edgesByTarget.incrementCountMultithreaded(edge.target);
+                markerGraph.outNeighbors.incrementCountMultithreaded(edge.source);
+                markerGraph.inNeighbors.incrementCountMultithreaded(edge.target);
             } else {
                 markerGraph.edgesBySource.storeMultithreaded(edge.source, Uint40(i));
                 markerGraph.edgesByTarget.storeMultithreaded(edge.target, Uint40(i));
+                MarkerGraph::Neighbor neighbor;
+                neighbor.edgeId = Uint40(i);
+                neighbor.vertexId = edge.target;
+                markerGraph.outNeighbors.storeMultithreaded(edge.source, neighbor);
+                neighbor.vertexId = edge.source;
+                markerGraph.inNeighbors.storeMultithreaded(edge.target, neighbor);
             }
         }
     }
 
 }
+void Assembler::createMarkerGraphEdgesThreadFunction3(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(MarkerGraph::VertexId vertexId=begin; vertexId!=end; ++vertexId) {
+            auto outNeighbors = markerGraph.outNeighbors[vertexId];
+            sort(outNeighbors.begin(), outNeighbors.end());
+            auto inNeighbors = markerGraph.inNeighbors[vertexId];
+            sort(inNeighbors.begin(), inNeighbors.end());
+        }
+    }
+}
 
 
 void Assembler::accessMarkerGraphEdges(
@@ -2240,6 +2552,20 @@ void Assembler::accessMarkerGraphEdges(
         markerGraph.edgesByTarget.accessExistingReadOnly(
             largeDataName("GlobalMarkerGraphEdgesByTarget"));
     }
+
+    // The neighbors are not available for assemblies created
+    // by older versions. In that case, leave them closed,
+    // and the code that uses them falls back to the edges.
+    try {
+        markerGraph.outNeighbors.accessExistingReadOnly(
+            largeDataName("GlobalMarkerGraphOutNeighbors"));
+        markerGraph.inNeighbors.accessExistingReadOnly(
+            largeDataName("GlobalMarkerGraphInNeighbors"));
+    } catch(const exception&) {
+        if(markerGraph.outNeighbors.isOpen()) {
+            markerGraph.outNeighbors.close();
+        }
+    }
 }
 
 
@@ -2253,6 +2579,15 @@ void Assembler::checkMarkerGraphEdgesIsOpen() const
 
 
 
+// Work areas for a search used by transitiveReduction.
+class Assembler::TransitiveReductionBfsData {
+public:
+    std::queue< pair<MarkerGraph::VertexId, uint64_t> > q;
+    std::unordered_set<MarkerGraph::VertexId> encounteredVertices;
+};
+
+
+
 // Approximate transitive reduction of the marker graph.
 // This does the following, in this order:
 // - All edges with coverage less than or equal to lowCoverageThreshold
@@ -2280,13 +2615,12 @@ void Assembler::transitiveReduction(
     size_t lowCoverageThreshold,
     size_t highCoverageThreshold,
     size_t maxDistance,
-    size_t edgeMarkerSkipThreshold)
+    size_t edgeMarkerSkipThreshold,
+    size_t threadCount)
 {
     // Some shorthands for readability.
     auto& edges = markerGraph.edges;
-    using VertexId = MarkerGraph::VertexId;
     using EdgeId = MarkerGraph::EdgeId;
-    using Edge = MarkerGraph::Edge;
 
     // Initial message.
     performanceLog << timestamp << "Transitive reduction of the marker graph begins." << endl;
@@ -2333,23 +2667,6 @@ void Assembler::transitiveReduction(
     // Check that there are no edges with coverage 0.
     SHASTA_ASSERT(edgesByCoverage[0].size() == 0);
 
-    // Vector to contain vertex distances during each BFS.
-    // Is is set to -1 for vertices not reached by the BFS.
-    MemoryMapped::Vector<int> vertexDistances;
-    vertexDistances.createNew(
-        largeDataName("tmp-flagMarkerGraphWeakEdges-vertexDistances"),
-        largeDataPageSize);
-    vertexDistances.resize(markerGraph.vertexCount());
-    fill(vertexDistances.begin(), vertexDistances.end(), -1);
-
-    // Queue to be used for all BFSs.
-    std::queue<VertexId> q;
-
-    // Vector to store vertices encountered during a BFS.
-    vector<VertexId> bfsVertices;
-
-
-
     // Flag as weak all edges with coverage <= lowCoverageThreshold
     for(size_t coverage=1; coverage<=lowCoverageThreshold; coverage++) {
         const auto& edgesWithThisCoverage = edgesByCoverage[coverage];
@@ -2392,79 +2709,64 @@ void Assembler::transitiveReduction(
 
 
     // Process edges of intermediate coverage.
+    // The edges with each coverage are processed in windows.
+    // For all edges in a window, a speculative search runs in parallel,
+    // seeing only the edges flagged before the window began.
+    // Then the results are committed sequentially, in the same order
+    // used by the sequential algorithm. If an edge used by a speculative search
+    // was flagged by an earlier edge in the same window, the search
+    // is repeated sequentially. So the results are identical to
+    // processing all edges sequentially, regardless of the number of threads.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    auto& data = transitiveReductionData;
+    data.maxDistance = maxDistance;
+    const uint64_t windowSize = 10000 * threadCount;
+    TransitiveReductionBfsData bfsData;
     for(size_t coverage=lowCoverageThreshold+1;
         coverage<highCoverageThreshold; coverage++) {
         const auto& edgesWithThisCoverage = edgesByCoverage[coverage];
         if(edgesWithThisCoverage.size() == 0) {
             continue;
         }
+        const auto tCoverageBegin = steady_clock::now();
         size_t count = 0;
-
-        // Loop over edges with this coverage.
-        for(const EdgeId edgeId: edgesWithThisCoverage) {
-            const Edge& edge = edges[edgeId];
-            if(edge.wasRemovedByTransitiveReduction) {
-                continue;
-            }
-            const VertexId u0 = edge.source;
-            const VertexId u1 = edge.target;
-
-            // Do a forward BFS starting at u0, up to distance maxDistance,
-            // using only edges currently marked as strong
-            // and without using this edge.
-            // If we encounter u1, u1 is reachable from v0 without
-            // using this edge, and so we can mark this edge as weak.
-            q.push(u0);
-            vertexDistances[u0] = 0;
-            bfsVertices.push_back(u0);
-            bool found = false;
-            while(!q.empty()) {
-                const VertexId v0 = q.front();
-                q.pop();
-                const int distance0 = vertexDistances[v0];
-                const int distance1 = distance0 + 1;
-                for(const auto edgeId01: markerGraph.edgesBySource[v0]) {
-                    if(edgeId01 == edgeId) {
-                        continue;
-                    }
-                    const Edge& edge01 = markerGraph.edges[edgeId01];
-                    if(edge01.wasRemovedByTransitiveReduction) {
-                        continue;
-                    }
-                    const VertexId v1 = edge01.target;
-                    if(vertexDistances[v1] >= 0) {
-                        continue;   // We already encountered this vertex.
-                    }
-                    if(v1 == u1) {
-                        // We found it!
-                        found = true;
+        uint64_t repeatedCount = 0;
+
+        // Loop over windows of edges with this coverage.
+        for(uint64_t windowBegin=0; windowBegin<edgesWithThisCoverage.size(); windowBegin+=windowSize) {
+            const uint64_t windowEnd = min(uint64_t(edgesWithThisCoverage.size()), windowBegin + windowSize);
+            const uint64_t windowEdgeCount = windowEnd - windowBegin;
+
+            // Speculative searches, in parallel.
+            data.windowEdges = edgesWithThisCoverage.begin() + windowBegin;
+            data.found.resize(windowEdgeCount);
+            data.usedEdges.resize(windowEdgeCount);
+            setupLoadBalancing(windowEdgeCount, 100);
+            runThreads(&Assembler::transitiveReductionThreadFunction, threadCount);
+
+            // Commit the results sequentially.
+            for(uint64_t i=0; i<windowEdgeCount; i++) {
+                const EdgeId edgeId = data.windowEdges[i];
+                if(edges[edgeId].wasRemovedByTransitiveReduction) {
+                    continue;
+                }
+                bool found = data.found[i];
+                for(const EdgeId usedEdgeId: data.usedEdges[i]) {
+                    if(edges[usedEdgeId].wasRemovedByTransitiveReduction) {
+                        found = transitiveReductionBfs(edgeId, maxDistance, bfsData, 0);
+                        ++repeatedCount;
                         break;
                     }
-                    vertexDistances[v1] = distance1;
-                    bfsVertices.push_back(v1);
-                    if(distance1 < int(maxDistance)) {
-                        q.push(v1);
-                    }
                 }
+
                 if(found) {
-                    break;
+                    edges[edgeId].wasRemovedByTransitiveReduction = 1;
+                    edges[markerGraph.reverseComplementEdge[edgeId]].wasRemovedByTransitiveReduction = 1;
+                    count += 2;
                 }
             }
-
-            if(found) {
-                edges[edgeId].wasRemovedByTransitiveReduction = 1;
-                edges[markerGraph.reverseComplementEdge[edgeId]].wasRemovedByTransitiveReduction = 1;
-                count += 2;
-            }
-
-            // Clean up to be ready to process the next edge.
-            while(!q.empty()) {
-                q.pop();
-            }
-            for(const VertexId v: bfsVertices) {
-                vertexDistances[v] = -1;
-            }
-            bfsVertices.clear();
         }
 
         if(count) {
@@ -2472,13 +2774,20 @@ void Assembler::transitiveReduction(
                 " edges with coverage " << coverage <<
                 " out of "<< 2*edgesWithThisCoverage.size() << " total." << endl;
         }
+        performanceLog << timestamp << "Transitive reduction for coverage " << coverage <<
+            " processed " << edgesWithThisCoverage.size() << " edge pairs in " <<
+            seconds(steady_clock::now() - tCoverageBegin) << " s. " <<
+            repeatedCount << " searches were repeated sequentially." << endl;
     }
+    data.found.clear();
+    data.found.shrink_to_fit();
+    data.usedEdges.clear();
+    data.usedEdges.shrink_to_fit();
 
 
     // Clean up our work areas.
     edgesByCoverage.remove();
     // edgeFlags.remove();
-    vertexDistances.remove();
 
 
 
@@ -2500,6 +2809,101 @@ void Assembler::transitiveReduction(
 
 
 
+// Search used by transitiveReduction for edge A->B.
+// Do a forward BFS starting at A, up to distance maxDistance,
+// using only edges currently marked as strong
+// and without using this edge.
+// If we encounter B, B is reachable from A without
+// using this edge, and so we can mark this edge as weak.
+// If usedEdges is not zero, it is filled with the edges used by the search.
+bool Assembler::transitiveReductionBfs(
+    MarkerGraph::EdgeId edgeId,
+    uint64_t maxDistance,
+    TransitiveReductionBfsData& bfsData,
+    vector<MarkerGraph::EdgeId>* usedEdges) const
+{
+    using VertexId = MarkerGraph::VertexId;
+    using Edge = MarkerGraph::Edge;
+
+    auto& q = bfsData.q;
+    auto& encounteredVertices = bfsData.encounteredVertices;
+    if(usedEdges) {
+        usedEdges->clear();
+    }
+
+    const Edge& edge = markerGraph.edges[edgeId];
+    const VertexId u0 = edge.source;
+    const VertexId u1 = edge.target;
+
+    q.push(make_pair(u0, 0));
+    encounteredVertices.insert(u0);
+    bool found = false;
+    while(!q.empty()) {
+        const VertexId v0 = q.front().first;
+        const uint64_t distance1 = q.front().second + 1;
+        q.pop();
+        for(const auto edgeId01: markerGraph.edgesBySource[v0]) {
+            if(edgeId01 == edgeId) {
+                continue;
+            }
+            const Edge& edge01 = markerGraph.edges[edgeId01];
+            if(edge01.wasRemovedByTransitiveReduction) {
+                continue;
+            }
+            if(usedEdges) {
+                usedEdges->push_back(edgeId01);
+            }
+            const VertexId v1 = edge01.target;
+            if(not encounteredVertices.insert(v1).second) {
+                continue;   // We already encountered this vertex.
+            }
+            if(v1 == u1) {
+                // We found it!
+                found = true;
+                break;
+            }
+            if(distance1 < maxDistance) {
+                q.push(make_pair(v1, distance1));
+            }
+        }
+        if(found) {
+            break;
+        }
+    }
+
+    // Clean up to be ready for the next search.
+    while(!q.empty()) {
+        q.pop();
+    }
+    encounteredVertices.clear();
+
+    return found;
+}
+
+
+
+// Speculative searches for a window of edges, used by transitiveReduction.
+void Assembler::transitiveReductionThreadFunction(size_t threadId)
+{
+    auto& data = transitiveReductionData;
+    TransitiveReductionBfsData bfsData;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; ++i) {
+            const MarkerGraph::EdgeId edgeId = data.windowEdges[i];
+            if(markerGraph.edges[edgeId].wasRemovedByTransitiveReduction) {
+                data.found[i] = 0;
+                data.usedEdges[i].clear();
+            } else {
+                data.found[i] = transitiveReductionBfs(edgeId, data.maxDistance, bfsData, &data.usedEdges[i]);
+            }
+        }
+    }
+}
+
+
+
 // Approximate reverse transitive reduction of the marker graph.
 // The goal is to remove local back-edges.
 // This works similarly to transitive reduction,
@@ -2869,6 +3273,35 @@ void Assembler::pruneMarkerGraphStrongSubgraph(size_t iterationCount)
 
 
 
+    // The out-degree and in-degree of each vertex in the pruned strong subgraph,
+    // kept up to date as edges are pruned.
+    // A vertex is a forward leaf if its out-degree is 0,
+    // and a backward leaf if its in-degree is 0
+    // (see isForwardLeafOfMarkerGraphPrunedStrongSubgraph and
+    // isBackwardLeafOfMarkerGraphPrunedStrongSubgraph).
+    // This avoids looping over the edges of the source and target
+    // of each edge at each iteration.
+    MemoryMapped::Vector<uint32_t> outDegree;
+    MemoryMapped::Vector<uint32_t> inDegree;
+    outDegree.createNew(
+        largeDataName("tmp-PruneMarkerGraphStrongSubgraph-OutDegree"),
+        largeDataPageSize);
+    inDegree.createNew(
+        largeDataName("tmp-PruneMarkerGraphStrongSubgraph-InDegree"),
+        largeDataPageSize);
+    outDegree.resize(markerGraph.vertexCount());
+    inDegree.resize(markerGraph.vertexCount());
+    fill(outDegree.begin(), outDegree.end(), 0);
+    fill(inDegree.begin(), inDegree.end(), 0);
+    for(const MarkerGraph::Edge& edge: edges) {
+        if(!edge.wasRemovedByTransitiveReduction) {
+            ++outDegree[edge.source];
+            ++inDegree[edge.target];
+        }
+    }
+
+
+
     // At each prune iteration we prune one layer of leaves.
     for(size_t iteration=0; iteration!=iterationCount; iteration++) {
         performanceLog << timestamp << "Begin prune iteration " << iteration << endl;
@@ -2882,10 +3315,7 @@ void Assembler::pruneMarkerGraphStrongSubgraph(size_t iterationCount)
             if(edge.wasPruned) {
                 continue;
             }
-            if(
-                isForwardLeafOfMarkerGraphPrunedStrongSubgraph(edge.target) ||
-                isBackwardLeafOfMarkerGraphPrunedStrongSubgraph(edge.source)
-                ) {
+            if(outDegree[edge.target] == 0 || inDegree[edge.source] == 0) {
                 edgesToBePruned[edgeId] = true;
             }
         }
@@ -2896,7 +3326,10 @@ void Assembler::pruneMarkerGraphStrongSubgraph(size_t iterationCount)
         EdgeId count = 0;
         for(EdgeId edgeId=0; edgeId<edgeCount; edgeId++) {
             if(edgesToBePruned[edgeId]) {
-                edges[edgeId].wasPruned = 1;
+                MarkerGraph::Edge& edge = edges[edgeId];
+                edge.wasPruned = 1;
+                --outDegree[edge.source];
+                --inDegree[edge.target];
                 ++count;
                 edgesToBePruned[edgeId] = false;    // For next iteration.
             }
@@ -2906,6 +3339,8 @@ void Assembler::pruneMarkerGraphStrongSubgraph(size_t iterationCount)
 
 
     edgesToBePruned.remove();
+    outDegree.remove();
+    inDegree.remove();
 
 
     // Count the number of surviving edges in the pruned strong subgraph.
@@ -3132,11 +3567,11 @@ void Assembler::computeMarkerGraphVertexConsensusSequence(
     const size_t k = assemblerInfo->k;
     sequence.resize(k);
     repeatCounts.resize(k);
+    // Object to store base and repeat count information
+    // at each position. It is reused to avoid memory allocation.
+    Coverage coverage;
     for(uint32_t position=0; position<uint32_t(k); position++) {
-
-        // Object to store base and repeat count information
-        // at this position.
-        Coverage coverage;
+        coverage.clear();
 
         // Loop over markers.
         for(size_t i=0; i<markerCount; i++) {
@@ -3176,9 +3611,15 @@ void Assembler::computeMarkerGraphVertexConsensusSequence(
 // to avoid memory and performance problems.
 // Instead, we return as consensus the sequence of the shortest marker interval.
 // This should happen only exceptionally.
+// If the most frequent intervening sequence is present in at least
+// edgeConsensusMajorityFraction of the marker intervals used,
+// the other marker intervals are ignored and spoa is not used.
+// With edgeConsensusMajorityFraction=1 this only happens when
+// all intervening sequences are identical, which does not change the consensus.
 void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
     MarkerGraph::EdgeId edgeId,
     uint32_t markerGraphEdgeLengthThresholdForConsensus,
+    double edgeConsensusMajorityFraction,
     const std::unique_ptr<spoa::AlignmentEngine>& spoaAlignmentEngine,
     const std::unique_ptr<spoa::Graph>& spoaAlignmentGraph,
     vector<Base>& sequence,
@@ -3416,7 +3857,11 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
     // Gather all of the intervening sequences and repeatCounts, keeping track of distinct
     // sequences. For each sequence we store a vector of i values
     // where each sequence appear.
+    // To find distinct sequences quickly, we also store the hash of each
+    // distinct sequence and only compare sequences with the same hash.
     vector< vector<Base> > distinctSequences;
+    vector<uint64_t> distinctSequenceHashes;
+    uint64_t usedCount = 0;
     vector< vector<size_t> >& distinctSequenceOccurrences = detail.distinctSequenceOccurrences;
     distinctSequenceOccurrences.clear();
     vector<bool> isUsed(markerCount);
@@ -3441,6 +3886,7 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
             continue;
         }
         isUsed[i] = true;
+        ++usedCount;
 
         // Construct the sequence and repeat counts between the markers.
         const uint32_t begin = position0 + k;
@@ -3478,15 +3924,23 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
         }
 
         // Store, making sure to check if we already encountered this sequence.
-        const auto it = find(distinctSequences.begin(), distinctSequences.end(), interveningSequence);
-        if(it == distinctSequences.end()) {
+        const uint64_t hash = MurmurHash64A(interveningSequence.data(),
+            int(interveningSequence.size() * sizeof(Base)), 231);
+        uint64_t j = 0;
+        for(; j<distinctSequences.size(); j++) {
+            if(distinctSequenceHashes[j] == hash and distinctSequences[j] == interveningSequence) {
+                break;
+            }
+        }
+        if(j == distinctSequences.size()) {
             // We did not already encountered this sequence.
             distinctSequences.push_back(interveningSequence);
+            distinctSequenceHashes.push_back(hash);
             distinctSequenceOccurrences.resize(distinctSequenceOccurrences.size() + 1);
             distinctSequenceOccurrences.back().push_back(i);
         } else {
             // We already encountered this sequence,
-            distinctSequenceOccurrences[it - distinctSequences.begin()].push_back(i);
+            distinctSequenceOccurrences[j].push_back(i);
         }
     }
 
@@ -3504,6 +3958,14 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
     sort(distinctSequenceTable.begin(), distinctSequenceTable.end(),
         OrderPairsBySecondOnlyGreater<size_t, uint32_t>());
 
+    // If the most frequent sequence has a large enough majority,
+    // only use the marker intervals with that sequence.
+    // The consensus sequence is then that sequence,
+    // and only the repeat counts are computed (see below).
+    if(double(distinctSequenceTable.front().second) >= edgeConsensusMajorityFraction * double(usedCount)) {
+        distinctSequenceTable.resize(1);
+    }
+
     if(debug) {
         cout << "Distinct sequences:" << endl;
         for(size_t i=0; i<distinctSequences.size(); i++) {
@@ -3542,27 +4004,36 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
 
 
     // We are now ready to compute the spoa alignment for the distinct sequences.
-
-    spoaAlignmentGraph->clear();
-    // Add the sequences to the alignment, in order of decreasing frequency.
-    string sequenceString;
-    for(const auto& p: distinctSequenceTable) {
-        const vector<Base>& distinctSequence = distinctSequences[p.first];
-
-        // Add it to the alignment.
-        sequenceString.clear();
-        for(const Base base: distinctSequence) {
-            sequenceString += base.character();
+    // If there is only one distinct sequence, the alignment is that sequence
+    // and we don't need spoa.
+    vector<string>& msa = detail.msa;
+    if(distinctSequenceTable.size() == 1) {
+        msa.resize(1);
+        msa.front().clear();
+        for(const Base base: distinctSequences[distinctSequenceTable.front().first]) {
+            msa.front() += base.character();
         }
-        auto alignment = spoaAlignmentEngine->align(sequenceString, spoaAlignmentGraph);
-        spoaAlignmentGraph->add_alignment(alignment, sequenceString);
-    }
+    } else {
 
+        spoaAlignmentGraph->clear();
+        // Add the sequences to the alignment, in order of decreasing frequency,
+        // each with weight equal to its frequency.
+        string sequenceString;
+        for(const auto& p: distinctSequenceTable) {
+            const vector<Base>& distinctSequence = distinctSequences[p.first];
 
+            // Add it to the alignment.
+            sequenceString.clear();
+            for(const Base base: distinctSequence) {
+                sequenceString += base.character();
+            }
+            auto alignment = spoaAlignmentEngine->align(sequenceString, spoaAlignmentGraph);
+            spoaAlignmentGraph->add_alignment(alignment, sequenceString, p.second);
+        }
 
-    // Use spoa to compute the multiple sequence alignment.
-    vector<string>& msa = detail.msa;
-    spoaAlignmentGraph->generate_multiple_sequence_alignment(msa);
+        // Use spoa to compute the multiple sequence alignment.
+        spoaAlignmentGraph->generate_multiple_sequence_alignment(msa);
+    }
 
     // The length of the alignment.
     // This includes alignment gaps.
@@ -3596,14 +4067,16 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
     // At each position we compute a consensus base and repeat count.
     // If the consensus bases is not '-', we store the base and repeat count.
     vector<uint32_t> positions(markerCount, 0);
+    Coverage coverage;
     for(size_t position=0; position<alignmentLength; position++) {
 
         if(debug) {
             cout << "Computing consensus repeat count at alignment position " << position << endl;
         }
 
-        // Create a Coverage object for this position.
-        Coverage coverage;
+        // Prepare the Coverage object for this position.
+        // It is reused to avoid memory allocation.
+        coverage.clear();
 
         // Loop over distinct sequences, in the same order in
         // which we presented them to spoa.
@@ -4667,6 +5140,7 @@ void Assembler::computeMarkerGraphVerticesCoverageDataThreadFunction(size_t thre
     vector< pair<OrientedReadId, uint32_t> > markerInfos;
     vector<uint32_t> markerPositions;
     vector<CompressedCoverageData> compressedCoverageData;
+    Coverage coverage;
 
     // Loop over all batches assigned to this thread.
     uint64_t begin, end;
@@ -4696,7 +5170,7 @@ void Assembler::computeMarkerGraphVerticesCoverageDataThreadFunction(size_t thre
 
                 // Object to store base and repeat count information
                 // at this position.
-                Coverage coverage;
+                coverage.clear();
 
                 // Loop over markers.
                 for(size_t i=0; i<markerCount; i++) {
@@ -4743,6 +5217,10 @@ void Assembler::assembleMarkerGraphEdges(
     // This controls when we give up trying to compute consensus for long edges.
     uint32_t markerGraphEdgeLengthThresholdForConsensus,
 
+    // If the most frequent intervening sequence of an edge is present in at least
+    // this fraction of its marker intervals, it is used as consensus without spoa.
+    double edgeConsensusMajorityFraction,
+
     // Request storing detailed coverage information.
     bool storeCoverageData,
 
@@ -4766,6 +5244,7 @@ void Assembler::assembleMarkerGraphEdges(
 
     // Do the computation in parallel.
     assembleMarkerGraphEdgesData.markerGraphEdgeLengthThresholdForConsensus = markerGraphEdgeLengthThresholdForConsensus;
+    assembleMarkerGraphEdgesData.edgeConsensusMajorityFraction = edgeConsensusMajorityFraction;
     assembleMarkerGraphEdgesData.storeCoverageData = storeCoverageData;
     assembleMarkerGraphEdgesData.assembleAllEdges = assembleAllEdges;
     assembleMarkerGraphEdgesData.threadEdgeIds.resize(threadCount);
@@ -4869,6 +5348,7 @@ void Assembler::assembleMarkerGraphEdgesThreadFunction(size_t threadId)
 {
     AssemblyGraph& assemblyGraph = *assemblyGraphPointer;
     const uint32_t markerGraphEdgeLengthThresholdForConsensus = assembleMarkerGraphEdgesData.markerGraphEdgeLengthThresholdForConsensus;
+    const double edgeConsensusMajorityFraction = assembleMarkerGraphEdgesData.edgeConsensusMajorityFraction;
     const bool storeCoverageData = assembleMarkerGraphEdgesData.storeCoverageData;
     const bool assembleAllEdges = assembleMarkerGraphEdgesData.assembleAllEdges;
 
@@ -4953,6 +5433,7 @@ void Assembler::assembleMarkerGraphEdgesThreadFunction(size_t threadId)
                     ComputeMarkerGraphEdgeConsensusSequenceUsingSpoaDetail detail;
                     computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
                         edgeId, markerGraphEdgeLengthThresholdForConsensus,
+                        edgeConsensusMajorityFraction,
                         spoaAlignmentEngine, spoaAlignmentGraph,
                         sequence, repeatCounts, overlappingBaseCount,
                         detail,
@@ -5433,7 +5914,7 @@ void Assembler::assembleMarkerGraphPathRleStrict(
     const MarkerId firstMarkerId = markerGraph.getVertexMarkerIds(v0)[0];
     const CompressedMarker& firstMarker = markers.begin()[firstMarkerId];
     const KmerId kmerId = firstMarker.kmerId;
-    const Kmer kmer(kmerId, k);
+    const Kmer64 kmer = getKmer(kmerId);
     for(uint64_t i=0; i<k; i++) {
         rleSequence.push_back(kmer[i]);
     }
@@ -5474,7 +5955,7 @@ void Assembler::assembleMarkerGraphPathRleStrict(
         const MarkerId markerId1 = markerGraph.getVertexMarkerIds(v1)[0];
         const CompressedMarker& marker1 = markers.begin()[markerId1];
         const KmerId kmerId1 = marker1.kmerId;
-        const Kmer kmer1(kmerId1, k);
+        const Kmer64 kmer1 = getKmer(kmerId1);
 
 
         // Add the sequence of this edge and the v1 vertex.
@@ -5536,12 +6017,12 @@ void Assembler::getMarkerIntervalRleSequence(
     const OrientedReadId orientedReadId = markerInterval.orientedReadId;
 
     // Extract the k-mers and their RLE positions in this oriented read.
-    array<Kmer, 2> kmers;
+    array<Kmer64, 2> kmers;
     array<uint32_t, 2> positions;
     for(uint64_t i=0; i<2; i++) {
         const MarkerId markerId = getMarkerId(orientedReadId, markerInterval.ordinals[i]);
         const CompressedMarker& compressedMarker = markers.begin()[markerId];
-        kmers[i] = Kmer(compressedMarker.kmerId, k);
+        kmers[i] = getKmer(compressedMarker.kmerId);
         positions[i] = compressedMarker.position;
     }
 
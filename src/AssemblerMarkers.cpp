@@ -15,10 +15,12 @@ void Assembler::findMarkers(size_t threadCount)
     MarkerFinder markerFinder(
         assemblerInfo->k,
         kmerTable,
+        sparseKmerTable,
         getReads(),
         markers,
         threadCount);
 
+    createMarkerIdSampledToc();
 }
 
 
@@ -26,6 +28,31 @@ void Assembler::findMarkers(size_t threadCount)
 void Assembler::accessMarkers()
 {
     markers.accessExistingReadOnly(largeDataName("Markers"));
+
+    // The sampled markers toc is not available for assemblies
+    // created before it was introduced.
+    // In that case findMarkerId uses the markers toc.
+    try {
+        markerIdSampledToc.accessExistingReadOnly(largeDataName("MarkerIdSampledToc"));
+    } catch(const exception&) {
+        if(markerIdSampledToc.isOpen) {
+            markerIdSampledToc.close();
+        }
+    }
+}
+
+
+
+// Create the sampled markers toc used by findMarkerId.
+// See findMarkerId.hpp for more information.
+void Assembler::createMarkerIdSampledToc()
+{
+    checkMarkersAreOpen();
+    if(markerIdSampledToc.isOpen) {
+        markerIdSampledToc.close();
+    }
+    markerIdSampledToc.createNew(largeDataName("MarkerIdSampledToc"), largeDataPageSize);
+    shasta::createMarkerIdSampledToc(markers, markerIdSampledToc);
 }
 
 void Assembler::checkMarkersAreOpen() const
@@ -57,7 +84,7 @@ void Assembler::writeMarkers(ReadId readId, Strand strand, const string& fileNam
         csv << markerId << ",";
         csv << ordinal << ",";
         csv << marker.kmerId << ",";
-        csv << Kmer(marker.kmerId, assemblerInfo->k) << ",";
+        getKmer(marker.kmerId).write(csv, assemblerInfo->k) << ",";
         csv << marker.position << "\n";
     }
 }
@@ -122,13 +149,14 @@ MarkerId Assembler::getReverseComplementMarkerId(
 
 // Inverse of the above: given a global marker id,
 // return its OrientedReadId and ordinal.
-// This requires a binary search in the markers toc.
-// This could be avoided, at the cost of storing
-// an additional 4 bytes per marker.
 pair<OrientedReadId, uint32_t>
     Assembler::findMarkerId(MarkerId markerId) const
 {
-    return shasta::findMarkerId(markerId, markers);
+    if(markerIdSampledToc.isOpen) {
+        return shasta::findMarkerId(markerId, markers, markerIdSampledToc);
+    } else {
+        return shasta::findMarkerId(markerId, markers);
+    }
 }
 
 
@@ -156,7 +184,9 @@ MarkerId Assembler::findReverseComplement(MarkerId markerId) const
 void Assembler::writeMarkerFrequency()
 {
     const uint64_t k = assemblerInfo->k;
-    const uint64_t kmerCount = 1ULL << (2ULL*k);
+    const SparseKmerTable* sparseKmerTablePointer = getSparseKmerTable();
+    const uint64_t kmerCount = sparseKmerTablePointer ?
+        sparseKmerTablePointer->size() : (1ULL << (2ULL*k));
     SHASTA_ASSERT(markers.isOpen());
     vector<uint64_t> frequency(kmerCount, 0);
 
@@ -172,7 +202,7 @@ void Assembler::writeMarkerFrequency()
         if(n== 0) {
             continue;
         }
-        const Kmer kmer(kmerId, k);
+        const Kmer64 kmer = getKmer(KmerId(kmerId));
         kmer.write(csv, k);
         csv << "," << n << "\n";
     }
@@ -252,6 +252,14 @@ void AssemblerOptions::addConfigurableOptions()
         "This is done by specifying the O_DIRECT flag when opening "
         "input files containing reads.")
 
+        ("Reads.streamingChunkSize",
+        value<uint64_t>(&readsOptions.streamingChunkSize)->
+        default_value(0),
+        "If not zero, uncompressed input files are read and parsed "
+        "in chunks of this size (in MB) instead of being read entirely into memory. "
+        "Also used for compressed input files, which are always processed in chunks. "
+        "If zero, compressed input files use chunks of 1024 MB.")
+
         ("Reads.palindromicReads.skipFlagging",
         bool_switch(&readsOptions.palindromicReads.skipFlagging)->
         default_value(false),
@@ -300,7 +308,8 @@ void AssemblerOptions::addConfigurableOptions()
          ("Kmers.k",
          value<int>(&kmersOptions.k)->
          default_value(10),
-         "Length of marker k-mers (in run-length space).")
+         "Length of marker k-mers (in run-length space). "
+         "Maximum 16, or 31 with --Kmers.sparseTable.")
 
          ("Kmers.probability",
          value<double>(&kmersOptions.probability)->
@@ -324,6 +333,15 @@ void AssemblerOptions::addConfigurableOptions()
         "A relative path is not accepted. "
         "Only used if Kmers.generationMethod is 3.")
 
+        ("Kmers.sparseTable",
+        bool_switch(&kmersOptions.sparseTable)->
+        default_value(false),
+        "Store only the marker k-mers in a sparse table, instead of "
+        "a table of all 4^k k-mers. Reduces memory usage for large k "
+        "and allows k up to 31. "
+        "Only k-mers that occur in the reads are considered as markers. "
+        "Only supported for Kmers.generationMethod 0, 1, and 3.")
+
         ("MinHash.version",
         value<int>(&minHashOptions.version)->
         default_value(0),
@@ -377,6 +395,24 @@ void AssemblerOptions::addConfigurableOptions()
         "candidates with both orientation. This should only be used for experimentation "
         "on very small runs because it is very time consuming.")
 
+        ("MinHash.hashAllIterationsInOnePass",
+        bool_switch(&minHashOptions.hashAllIterationsInOnePass)->
+        default_value(false),
+        "Compute the low hashes for all MinHash iterations in a single pass "
+        "over the markers, before the first iteration. This is faster "
+        "but uses more memory. Only used with --MinHash.version 1.")
+
+        ("MinHash.checkpointDirectory",
+        value<string>(&minHashOptions.checkpointDirectory)->
+        default_value(""),
+        "If not empty, the absolute path of a directory where the common features "
+        "found at each MinHash iteration are stored in a checkpoint. "
+        "The directory is created if necessary and is not removed at the end. "
+        "If it already contains a checkpoint created with the same MinHash options, "
+        "k, and markers, the iterations in the checkpoint are not recomputed. "
+        "This can be used to resume after a failure, or to rerun with "
+        "more MinHash iterations. Only used with --MinHash.version 1.")
+
         ("Align.alignMethod",
         value<int>(&alignOptions.alignMethod)->
         default_value(3),
@@ -488,6 +524,14 @@ void AssemblerOptions::addConfigurableOptions()
         default_value(100),
         "Only used for alignment method 4 (experimental).")
 
+        ("Align.diagonalScreenBandWidth",
+        value<uint64_t>(&alignOptions.diagonalScreenBandWidth)->
+        default_value(0),
+        "If not zero, alignment candidates are screened before computing "
+        "their alignment. The candidate is discarded if no diagonal band "
+        "of this width (in markers) contains at least minAlignedMarkerCount "
+        "pairs of common markers. If zero, no screening is done.")
+
         ("ReadGraph.creationMethod",
         value<int>(&readGraphOptions.creationMethod)->
         default_value(0),
@@ -615,6 +659,18 @@ void AssemblerOptions::addConfigurableOptions()
         "Specifies whether to allow more than one marker on the "
         "same oriented read on a single marker graph vertex. Experimental.")
 
+        ("MarkerGraph.externalSortBufferGigabytes",
+        value<uint64_t>(&markerGraphOptions.externalSortBufferGigabytes)->
+        default_value(0),
+        "If not zero, marker graph vertices are created out of core, "
+        "using sorted runs written to the Data directory, or to the "
+        "assembly directory if binary data are in anonymous memory or on hugetlbfs. "
+        "This many gigabytes bound only the sort and merge buffers. "
+        "Other data remain resident: 16 bytes per oriented marker for the "
+        "disjoint set table during the unions, then 8 bytes per oriented marker "
+        "for the compacted table, plus the markers, "
+        "the marker graph vertices, and their vertexTable. Experimental.")
+
         ("MarkerGraph.cleanupDuplicateMarkers",
         bool_switch(&markerGraphOptions.cleanupDuplicateMarkers)->
         default_value(false),
@@ -715,6 +771,21 @@ void AssemblerOptions::addConfigurableOptions()
         default_value(1000),
         "Controls assembly of long marker graph edges.")
 
+        ("Assembly.edgeConsensusMajorityFraction",
+        value<double>(&assemblyOptions.edgeConsensusMajorityFraction)->
+        default_value(1.),
+        "If the most frequent sequence of a marker graph edge is present "
+        "in at least this fraction of the reads, it is used as consensus "
+        "without computing a multiple sequence alignment. "
+        "The default value of 1 only does this when all reads agree.")
+
+        ("Assembly.lazyEdgeConsensus",
+        bool_switch(&assemblyOptions.lazyEdgeConsensus)->
+        default_value(false),
+        "Compute consensus for marker graph edges during assembly, "
+        "without storing it for all marker graph edges. "
+        "Cannot be used together with coverage data.")
+
         ("Assembly.consensusCaller",
         value<string>(&assemblyOptions.consensusCallerString)->
         default_value("Modal"),
@@ -738,6 +809,12 @@ void AssemblerOptions::addConfigurableOptions()
         default_value(false),
         "Used to request writing the reads that contributed to assembling each segment.")
 
+        ("Assembly.bgzipOutput",
+        bool_switch(&assemblyOptions.bgzipOutput)->
+        default_value(false),
+        "Used to request bgzip compression of the assembly "
+        "FASTA and GFA files that contain sequence.")
+
         ("Assembly.pruneLength",
         value<uint64_t>(&assemblyOptions.pruneLength)->
         default_value(0),
@@ -950,6 +1027,7 @@ void ReadsOptions::write(ostream& s) const
     s << "desiredCoverage = " << desiredCoverageString << "\n";
     s << "noCache = " <<
         convertBoolToPythonString(noCache) << "\n";
+    s << "streamingChunkSize = " << streamingChunkSize << "\n";
     palindromicReads.write(s);
 }
 
@@ -964,6 +1042,8 @@ void KmersOptions::write(ostream& s) const
     s << "enrichmentThreshold = " << enrichmentThreshold << "\n";
     s << "distanceThreshold = " << distanceThreshold << "\n";
     s << "file = " << file << "\n";
+    s << "sparseTable = " <<
+        convertBoolToPythonString(sparseTable) << "\n";
 }
 
 
@@ -981,6 +1061,9 @@ void MinHashOptions::write(ostream& s) const
     s << "minFrequency = " << minFrequency << "\n";
     s << "allPairs = " <<
         convertBoolToPythonString(allPairs) << "\n";
+    s << "hashAllIterationsInOnePass = " <<
+        convertBoolToPythonString(hashAllIterationsInOnePass) << "\n";
+    s << "checkpointDirectory = " << checkpointDirectory << "\n";
 }
 
 
@@ -1009,6 +1092,7 @@ void AlignOptions::write(ostream& s) const
     s << "align4.deltaY = " << align4DeltaY << "\n";
     s << "align4.minEntryCountPerCell = " << align4MinEntryCountPerCell << "\n";
     s << "align4.maxDistanceFromBoundary = " << align4MaxDistanceFromBoundary << "\n";
+    s << "diagonalScreenBandWidth = " << diagonalScreenBandWidth << "\n";
 }
 
 
@@ -1050,6 +1134,7 @@ void MarkerGraphOptions::write(ostream& s) const
     s << "minEdgeCoveragePerStrand = " << minEdgeCoveragePerStrand << "\n";
     s << "allowDuplicateMarkers = " <<
         convertBoolToPythonString(allowDuplicateMarkers) << "\n";
+    s << "externalSortBufferGigabytes = " << externalSortBufferGigabytes << "\n";
     s << "cleanupDuplicateMarkers = " <<
         convertBoolToPythonString(cleanupDuplicateMarkers) << "\n";
     s << "duplicateMarkersPattern1Threshold = " << duplicateMarkersPattern1Threshold << "\n";
@@ -1079,6 +1164,10 @@ void AssemblyOptions::write(ostream& s) const
     s << "crossEdgeCoverageThreshold = " << crossEdgeCoverageThreshold << "\n";
     s << "markerGraphEdgeLengthThresholdForConsensus = " <<
         markerGraphEdgeLengthThresholdForConsensus << "\n";
+    s << "edgeConsensusMajorityFraction = " <<
+        edgeConsensusMajorityFraction << "\n";
+    s << "lazyEdgeConsensus = " <<
+        convertBoolToPythonString(lazyEdgeConsensus) << "\n";
     s << "consensusCaller = " <<
         consensusCaller << "\n";
     s << "storeCoverageData = " <<
@@ -1087,6 +1176,8 @@ void AssemblyOptions::write(ostream& s) const
         storeCoverageDataCsvLengthThreshold << "\n";
     s << "writeReadsByAssembledSegment = " <<
         convertBoolToPythonString(writeReadsByAssembledSegment) << "\n";
+    s << "bgzipOutput = " <<
+        convertBoolToPythonString(bgzipOutput) << "\n";
     s << "pruneLength = " << pruneLength << "\n";
     s << "detangleMethod = " << detangleMethod << "\n";
     s << "detangle.diagonalReadCountMin = " << detangleDiagonalReadCountMin << "\n";
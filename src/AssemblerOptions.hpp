@@ -125,6 +125,7 @@ public:
     uint64_t representation;    // 0 = Raw, 1=RLE
     int minReadLength;
     bool noCache;
+    uint64_t streamingChunkSize;
     string desiredCoverageString;
     uint64_t desiredCoverage;
     PalindromicReadOptions palindromicReads;
@@ -147,6 +148,7 @@ public:
     double enrichmentThreshold;
     uint64_t distanceThreshold;
     string file;
+    bool sparseTable;
     void write(ostream&) const;
 };
 
@@ -166,6 +168,8 @@ public:
     int maxBucketSize;
     int minFrequency;
     bool allPairs;
+    bool hashAllIterationsInOnePass;
+    string checkpointDirectory;
     void write(ostream&) const;
 };
 
@@ -195,6 +199,7 @@ public:
     uint64_t align4DeltaY;
     uint64_t align4MinEntryCountPerCell;
     uint64_t align4MaxDistanceFromBoundary;
+    uint64_t diagonalScreenBandWidth;
     void write(ostream&) const;
 };
 
@@ -237,6 +242,7 @@ public:
     uint64_t minEdgeCoveragePerStrand;
     bool allowDuplicateMarkers;
     bool cleanupDuplicateMarkers;
+    uint64_t externalSortBufferGigabytes;
     double duplicateMarkersPattern1Threshold;
     int lowCoverageThreshold;
     int highCoverageThreshold;
@@ -315,11 +321,14 @@ public:
     uint64_t mode;
     int crossEdgeCoverageThreshold;
     int markerGraphEdgeLengthThresholdForConsensus;
+    double edgeConsensusMajorityFraction;
+    bool lazyEdgeConsensus;
     string consensusCallerString;
     string consensusCaller;
     bool storeCoverageData;
     int storeCoverageDataCsvLengthThreshold;
     bool writeReadsByAssembledSegment;
+    bool bgzipOutput;
     uint64_t pruneLength;
 
     // Options that control detangling.
@@ -47,7 +47,7 @@ void Assembler::createReadGraph(
     // Vector to keep the alignments for each read,
     // with their number of markers.
     // Contains pairs(marker count, alignment id).
-    vector< pair<uint32_t, uint32_t> > readAlignments;
+    vector< pair<uint32_t, uint64_t> > readAlignments;
 
     const bool debug = false;
     if(debug) {
@@ -63,7 +63,7 @@ void Assembler::createReadGraph(
 
         // Gather the alignments for this read, each with its number of markers.
         readAlignments.clear();
-        for(const uint32_t alignmentId: alignmentTable[OrientedReadId(readId, 0).getValue()]) {
+        for(const uint64_t alignmentId: alignmentTable[OrientedReadId(readId, 0).getValue()]) {
             const AlignmentData& alignment = alignmentData[alignmentId];
             readAlignments.push_back(make_pair(alignment.info.markerCount, alignmentId));
         }
@@ -77,7 +77,7 @@ void Assembler::createReadGraph(
                 readAlignments.begin(),
                 readAlignments.begin() + maxAlignmentCount,
                 readAlignments.end(),
-                std::greater< pair<uint32_t, uint32_t> >());
+                std::greater< pair<uint32_t, uint64_t> >());
             readAlignments.resize(maxAlignmentCount);
         }
         if(debug) {
@@ -86,7 +86,7 @@ void Assembler::createReadGraph(
 
         // Mark the surviving alignments as to be kept.
         for(const auto& p: readAlignments) {
-            const uint32_t alignmentId = p.second;
+            const uint64_t alignmentId = p.second;
             keepAlignment[alignmentId] = true;
             if(debug) {
                 const AlignmentData& alignment = alignmentData[alignmentId];
@@ -556,8 +556,8 @@ void Assembler::flagChimericReadsThreadFunction(size_t threadId)
                     if(uComponent != component) {
                         reads->setChimericFlag(startReadId, true);
                         // Also flag all alignments involving this read as not in the read graph.
-                        const span<uint32_t> alignmentIds = alignmentTable[OrientedReadId(startReadId, 0).getValue()];
-                        for(const uint32_t alignmentId: alignmentIds) {
+                        const span<uint64_t> alignmentIds = alignmentTable[OrientedReadId(startReadId, 0).getValue()];
+                        for(const uint64_t alignmentId: alignmentIds) {
                             alignmentData[alignmentId].info.isInReadGraph = 0;
                         }
                         break;
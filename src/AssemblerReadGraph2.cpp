@@ -202,14 +202,14 @@ void Assembler::createReadGraph2(
     // Vector to keep the alignments for each read,
     // with their number of markers.
     // Contains pairs(marker count, alignment id).
-    vector< pair<uint32_t, uint32_t> > readAlignments;
+    vector< pair<uint32_t, uint64_t> > readAlignments;
 
     // Loop over reads.
     for(ReadId readId=0; readId<readCount; readId++) {
 
         // Gather the alignments for this read, each with its number of markers.
         readAlignments.clear();
-        for(const uint32_t alignmentId: alignmentTable[OrientedReadId(readId, 0).getValue()]) {
+        for(const uint64_t alignmentId: alignmentTable[OrientedReadId(readId, 0).getValue()]) {
             const AlignmentInfo& info = alignmentData[alignmentId].info;
 
             // Discard each alignment if it does not pass the chosen thresholds
@@ -227,13 +227,13 @@ void Assembler::createReadGraph2(
                     readAlignments.begin(),
                     readAlignments.begin() + maxAlignmentCount,
                     readAlignments.end(),
-                    std::greater< pair<uint32_t, uint32_t> >());
+                    std::greater< pair<uint32_t, uint64_t> >());
             readAlignments.resize(maxAlignmentCount);
         }
 
         // Mark the surviving alignments as to be kept.
         for(const auto& p: readAlignments) {
-            const uint32_t alignmentId = p.second;
+            const uint64_t alignmentId = p.second;
             keepAlignment[alignmentId] = true;
         }
     }
@@ -15,6 +15,7 @@ void Assembler::addReads(
     const string& fileName,
     uint64_t minReadLength,
     bool noCache,
+    uint64_t streamingChunkSize,
     const size_t threadCount)
 {
     reads->checkReadsAreOpen();
@@ -25,6 +26,7 @@ void Assembler::addReads(
         assemblerInfo->readRepresentation,
         minReadLength,
         noCache,
+        streamingChunkSize,
         threadCount,
         largeDataFileNamePrefix,
         largeDataPageSize,
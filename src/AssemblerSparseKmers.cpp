@@ -0,0 +1,444 @@
+// Functions that select marker k-mers and store them
+// in the sparse k-mer table instead of the dense k-mer table.
+// See SparseKmerTable.hpp for more information.
+
+// Shasta.
+#include "Assembler.hpp"
+#include "deduplicate.hpp"
+#include "extractKmerIds.hpp"
+#include "MurmurHash2.hpp"
+#include "Reads.hpp"
+using namespace shasta;
+
+// Standard library.
+#include <limits>
+
+
+
+void Assembler::createSparseKmerTable(size_t k, vector<KmerId64>& markerKmerIds)
+{
+    assemblerInfo->useSparseKmerTable = true;
+    sparseKmerTable.createNew(largeDataName("SparseKmers"), largeDataPageSize);
+    sparseKmerTable.store(k, markerKmerIds);
+}
+
+
+
+// Collect the k-mers that occur in the reads and are selected
+// by a hash function with probability approximately equal to fraction.
+// A k-mer and its reverse complement are always selected together,
+// and only the smaller of their two KmerId64 is stored.
+// This never enumerates all 4^k possible k-mers, so memory and time
+// are proportional to the number of distinct k-mers selected
+// and to the total length of the reads.
+void Assembler::collectSparseKmers(
+    uint64_t k,
+    double fraction,
+    int seed,
+    size_t threadCount,
+    vector<KmerId64>& kmerIds)
+{
+    SelectKmersSparseData& data = selectKmersSparseData;
+    if(fraction >= 1.) {
+        data.hashThreshold = std::numeric_limits<uint64_t>::max();
+    } else {
+        data.hashThreshold = uint64_t(fraction * 18446744073709551616.);
+    }
+    data.seed = uint64_t(seed);
+    data.collectedKmerIds.clear();
+
+    SHASTA_ASSERT(k == assemblerInfo->k);
+    setupLoadBalancing(reads->readCount(), 1000);
+    runThreads(&Assembler::collectSparseKmersThreadFunction, threadCount);
+
+    deduplicate(data.collectedKmerIds);
+    kmerIds.swap(data.collectedKmerIds);
+    data.collectedKmerIds.clear();
+    data.collectedKmerIds.shrink_to_fit();
+}
+
+
+
+void Assembler::collectSparseKmersThreadFunction(size_t threadId)
+{
+    SelectKmersSparseData& data = selectKmersSparseData;
+    const uint64_t k = assemblerInfo->k;
+    const uint64_t hashThreshold = data.hashThreshold;
+    const uint64_t seed = data.seed;
+
+    vector<KmerId64> kmerIds;
+    vector<KmerId64> reverseComplementedKmerIds;
+
+    // The k-mers collected by this thread.
+    // They are periodically deduplicated to bound memory usage.
+    vector<KmerId64> threadKmerIds;
+    uint64_t deduplicatedSize = 0;
+
+    // Loop over all batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over all reads assigned to this batch.
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            extractKmerIds(reads->getRead(readId), k, kmerIds, reverseComplementedKmerIds);
+            for(uint64_t i=0; i<kmerIds.size(); i++) {
+                const KmerId64 kmerId = min(kmerIds[i], reverseComplementedKmerIds[i]);
+                if(MurmurHash64A(&kmerId, sizeof(kmerId), seed) <= hashThreshold) {
+                    threadKmerIds.push_back(kmerId);
+                }
+            }
+        }
+
+        if(threadKmerIds.size() > 2 * deduplicatedSize + (1ULL << 20)) {
+            deduplicate(threadKmerIds);
+            deduplicatedSize = threadKmerIds.size();
+        }
+    }
+    deduplicate(threadKmerIds);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    data.collectedKmerIds.insert(data.collectedKmerIds.end(),
+        threadKmerIds.begin(), threadKmerIds.end());
+}
+
+
+
+// Randomly select the k-mers to be used as markers.
+// A k-mer and its reverse complement are selected together,
+// with the requested probability, using a hash function
+// of the k-mer instead of a random number generator.
+// Only k-mers that occur in the reads are considered,
+// so this never enumerates all 4^k k-mers.
+void Assembler::randomlySelectKmersSparse(
+    size_t k,           // k-mer length.
+    double probability, // The probability that a k-mer is selected as a marker.
+    int seed,           // Seed for the hash function.
+    size_t threadCount
+)
+{
+    // Sanity check on the value of k, then store it.
+    if(k > maxSparseKmerLength) {
+        throw runtime_error("K-mer capacity exceeded. "
+            "The sparse k-mer table supports k up to " + to_string(maxSparseKmerLength) + ".");
+    }
+    assemblerInfo->k = k;
+
+    // Sanity check on the requested fraction.
+    if(probability<0. || probability>1.) {
+        throw runtime_error("Invalid k-mer probability " +
+            to_string(probability) + " requested.");
+    }
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Select the marker k-mers.
+    // Their reverse complements are added by SparseKmerTable::store.
+    vector<KmerId64> markerKmerIds;
+    collectSparseKmers(k, probability, seed, threadCount, markerKmerIds);
+    createSparseKmerTable(k, markerKmerIds);
+
+    // Summary message.
+    cout << "Selected " << sparseKmerTable.size() << " k-mers of length " << k <<
+        " that occur in the reads as markers, with probability " <<
+        probability << "." << endl;
+}
+
+
+
+// Select marker k-mers randomly, but excluding
+// the ones that have high frequency in the reads.
+// This does the same as selectKmersBasedOnFrequency, with two differences:
+// - K-mer frequencies are only computed for a random pool
+//   of candidate k-mers that occur in the reads, selected via collectSparseKmers.
+//   Candidates are processed in order of increasing hash value.
+//   If the pool is not sufficient to achieve the requested
+//   marker density, its size is doubled and frequencies
+//   are recomputed.
+// - For large k, most possible k-mers never occur in the reads,
+//   so the enrichment of a k-mer is computed relative to the
+//   average frequency of the candidate k-mers, which all occur
+//   in the reads, rather than relative to the average over all 4^k k-mers.
+void Assembler::selectKmersBasedOnFrequencySparse(
+
+    // k-mer length.
+    size_t k,
+
+    // The desired marker density
+    double markerDensity,
+
+    // Seed for the hash function.
+    int seed,
+
+    // Exclude k-mers enriched by more than this amount.
+    // Enrichment is the ratio of k-mer frequency in reads
+    // over the average frequency of candidate k-mers.
+    double enrichmentThreshold,
+
+    size_t threadCount
+)
+{
+
+    // Sanity check on the value of k, then store it.
+    if(k > maxSparseKmerLength) {
+        throw runtime_error("K-mer capacity exceeded. "
+            "The sparse k-mer table supports k up to " + to_string(maxSparseKmerLength) + ".");
+    }
+    assemblerInfo->k = k;
+
+    // Sanity check.
+    if(markerDensity<0. || markerDensity>1.) {
+        throw runtime_error("Invalid marker density " +
+            to_string(markerDensity) + " requested.");
+    }
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+
+
+    // Initially, collect enough candidates to achieve the requested
+    // marker density if no k-mers are overenriched, with a margin of
+    // about a factor of two.
+    double candidateFraction = min(1., 2. * markerDensity);
+
+    SparseKmerTable& candidates = selectKmersSparseData.candidates;
+    MemoryMapped::Vector<uint64_t>& occurrenceCount = selectKmersSparseData.occurrenceCount;
+    vector<KmerId64> markerKmerIds;
+    while(true) {
+
+        // Collect the candidates and store them in a temporary sparse table.
+        // Each candidate is the smaller of the KmerId64 of a k-mer
+        // and of its reverse complement.
+        vector<KmerId64> candidateKmerIds;
+        collectSparseKmers(k, candidateFraction, seed, threadCount, candidateKmerIds);
+
+        // Process the candidates in order of increasing hash value.
+        // This is a random order, and it is consistent between iterations,
+        // so each iteration extends the selection of the previous one.
+        vector< pair<uint64_t, KmerId64> > orderedCandidateKmerIds;
+        orderedCandidateKmerIds.reserve(candidateKmerIds.size());
+        for(const KmerId64 kmerId: candidateKmerIds) {
+            orderedCandidateKmerIds.push_back(make_pair(
+                MurmurHash64A(&kmerId, sizeof(kmerId), uint64_t(seed)), kmerId));
+        }
+        sort(orderedCandidateKmerIds.begin(), orderedCandidateKmerIds.end());
+
+        candidates.createNew(largeDataName("tmp-SparseKmerCandidates"), largeDataPageSize);
+        candidates.store(k, candidateKmerIds);
+        candidateKmerIds.clear();
+        candidateKmerIds.shrink_to_fit();
+        cout << "Computing frequencies of " << candidates.size() << " candidate k-mers." << endl;
+
+        // Count occurrences of the candidates in the reads.
+        occurrenceCount.createNew(largeDataName("tmp-SparseKmerOccurrenceCount"), largeDataPageSize);
+        occurrenceCount.resize(candidates.size());
+        fill(occurrenceCount.begin(), occurrenceCount.end(), 0);
+        selectKmersSparseData.kmerPositionCount = 0;
+        setupLoadBalancing(reads->readCount(), 1000);
+        runThreads(&Assembler::computeSparseKmerFrequency, threadCount);
+
+        // The frequency of a candidate k-mer, as defined in selectKmersBasedOnFrequency.
+        auto frequency = [&](uint64_t index, uint64_t reverseComplementedIndex) {
+            return occurrenceCount[index] + occurrenceCount[reverseComplementedIndex];
+        };
+
+        // Each k-mer position in a read contributes an occurrence
+        // on each of the two oriented reads.
+        const uint64_t totalKmerOccurrences = 2 * selectKmersSparseData.kmerPositionCount;
+        uint64_t candidateKmerOccurrences = 0;
+        for(uint64_t index=0; index<candidates.size(); index++) {
+            candidateKmerOccurrences += frequency(index, candidates.getReverseComplementIndex(index));
+        }
+        const double averageOccurrenceCount =
+            double(candidateKmerOccurrences) / double(max(uint64_t(1), candidates.size()));
+        const uint64_t frequencyThreshold =
+            uint64_t(enrichmentThreshold * averageOccurrenceCount);
+        const uint64_t desiredKmerOccurrencesCount =
+            uint64_t(markerDensity * double(totalKmerOccurrences));
+
+        // Process the candidates in order, skipping the ones that are overenriched.
+        markerKmerIds.clear();
+        uint64_t kmerOccurrencesCount = 0;
+        uint64_t kmerCount = 0;
+        uint64_t overenrichedKmerCount = 0;
+        for(const auto& p: orderedCandidateKmerIds) {
+            if(kmerOccurrencesCount >= desiredKmerOccurrencesCount) {
+                break;
+            }
+            const KmerId64 kmerId = p.second;
+            const uint64_t index = candidates.find(kmerId);
+            SHASTA_ASSERT(index != SparseKmerTable::invalidIndex);
+            const uint64_t reverseComplementedIndex = candidates.getReverseComplementIndex(index);
+
+            const uint64_t kmerFrequency = frequency(index, reverseComplementedIndex);
+            const uint64_t pairKmerCount = (reverseComplementedIndex == index) ? 1 : 2;
+            if(kmerFrequency > frequencyThreshold) {
+                overenrichedKmerCount += pairKmerCount;
+                continue;
+            }
+
+            // Add this k-mer and its reverse complement.
+            markerKmerIds.push_back(kmerId);
+            kmerOccurrencesCount += pairKmerCount * kmerFrequency;
+            kmerCount += pairKmerCount;
+        }
+        const bool done =
+            (kmerOccurrencesCount >= desiredKmerOccurrencesCount) or
+            (candidateFraction >= 1.);
+
+
+
+        if(done) {
+
+            // Write out frequencies for the candidate k-mers.
+            ofstream csv("KmerFrequencies.csv");
+            csv << "KmerId,Kmer,ReverseComplementedKmerId,ReverseComplementedKmer,Frequency,Enrichment,Overenriched?\n";
+            for(uint64_t index=0; index<candidates.size(); index++) {
+                const uint64_t reverseComplementedIndex = candidates.getReverseComplementIndex(index);
+                const uint64_t kmerFrequency = frequency(index, reverseComplementedIndex);
+                csv << candidates.getKmerId64(index) << ",";
+                candidates.getKmer(index).write(csv, k);
+                csv << ",";
+                csv << candidates.getKmerId64(reverseComplementedIndex) << ",";
+                candidates.getKmer(reverseComplementedIndex).write(csv, k);
+                csv << ",";
+                csv << kmerFrequency << ",";
+                csv << double(kmerFrequency) / averageOccurrenceCount;
+                csv << ",";
+                csv << ((kmerFrequency > frequencyThreshold) ? "Yes" : "No");
+                csv << "\n";
+            }
+
+            cout <<
+                "K-mer length k " << k << "\n"
+                "Number of candidate k-mers " << candidates.size() << "\n"
+                "Total number of k-mer occurrences in all oriented reads " << totalKmerOccurrences << "\n"
+                "Average number of occurrences per candidate k-mer " <<
+                averageOccurrenceCount << endl;
+            cout << overenrichedKmerCount << " candidate k-mers were found to be "
+                "enriched by more than a factor of " << enrichmentThreshold <<
+                " and will not be used as markers." << endl;
+            if(kmerOccurrencesCount < desiredKmerOccurrencesCount) {
+                cout << "There are not enough k-mers that are not overenriched "
+                    "to achieve the requested marker density." << endl;
+            }
+            cout << "Selected " << kmerCount << " k-mers as markers." << endl;
+        }
+
+        candidates.remove();
+        occurrenceCount.remove();
+        if(done) {
+            break;
+        }
+
+        // Try again with a larger pool of candidates.
+        candidateFraction = min(1., 2. * candidateFraction);
+    }
+
+    createSparseKmerTable(k, markerKmerIds);
+}
+
+
+
+void Assembler::computeSparseKmerFrequency(size_t threadId)
+{
+    const SparseKmerTable& candidates = selectKmersSparseData.candidates;
+    MemoryMapped::Vector<uint64_t>& occurrenceCount = selectKmersSparseData.occurrenceCount;
+    uint64_t kmerPositionCount = 0;
+    vector<KmerId64> kmerIds;
+
+    // Loop over all batches assigned to this thread.
+    const size_t k = assemblerInfo->k;
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over all reads assigned to this batch.
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+
+            // Get the KmerId64 of all k-mers of this read.
+            // If the read is pathologically short, it has no k-mers.
+            extractKmerIds(reads->getRead(readId), k, kmerIds);
+            kmerPositionCount += kmerIds.size();
+
+            // If a k-mer is a candidate, increment its occurrence count.
+            for(const KmerId64 kmerId: kmerIds) {
+                const uint64_t index = candidates.find(kmerId);
+                if(index != SparseKmerTable::invalidIndex) {
+                    __sync_fetch_and_add(&occurrenceCount[index], 1ULL);
+                }
+            }
+        }
+    }
+
+    __sync_fetch_and_add(&selectKmersSparseData.kmerPositionCount, kmerPositionCount);
+}
+
+
+
+// Read the k-mers from file and store them in the sparse k-mer table.
+void Assembler::readKmersFromFileSparse(uint64_t k, const string& fileName)
+{
+    // Sanity check on the value of k, then store it.
+    if(k > maxSparseKmerLength) {
+        throw runtime_error("K-mer capacity exceeded. "
+            "The sparse k-mer table supports k up to " + to_string(maxSparseKmerLength) + ".");
+    }
+    assemblerInfo->k = k;
+
+    // Open the file.
+    ifstream file(fileName);
+    if(not file) {
+        throw runtime_error("Error opening " + fileName);
+    }
+
+
+
+    // Read one k-mer per line.
+    uint64_t lineCount = 0;
+    vector<KmerId64> markerKmerIds;
+    while(true) {
+
+        // Read a line.
+        string line;
+        std::getline(file, line);
+        if(not file) {
+            break;
+        }
+
+        // Check the length.
+        if(line.size() != k) {
+            throw runtime_error("Unexpected line length in " + fileName + ":\n" + line + "\n" +
+                "Expected " + to_string(k) + " characters, found " + to_string(line.size()));
+        }
+
+        // Read the k-mer.
+        Kmer64 kmer;
+        for(uint64_t i=0; i<k; i++) {
+            const char c = line[i];
+            const Base base = Base::fromCharacterNoException(c);
+            if(not base.isValid()) {
+                throw runtime_error("Unexpected base character in " + fileName + ":\n" + line);
+            }
+            kmer.set(i, base);
+        }
+        if((assemblerInfo->readRepresentation==1) and (not isRleKmer(kmer, k))) {
+            throw runtime_error("Non-RLE k-mer (duplicate consecutive bases) in " +
+                fileName + ":\n" + line);
+        }
+
+        // The reverse complement is added by SparseKmerTable::store.
+        markerKmerIds.push_back(kmer.id(k));
+        ++lineCount;
+
+    }
+    cout << "Processed " << lineCount << " lines of " << fileName << endl;
+    createSparseKmerTable(k, markerKmerIds);
+
+    cout << "Flagged as markers " << sparseKmerTable.size() <<
+        " k-mers of length " << k << endl;
+}
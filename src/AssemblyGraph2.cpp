@@ -43,6 +43,7 @@ AssemblyGraph2::AssemblyGraph2(
     uint64_t k, // Marker length
     const MemoryMapped::Vector<ReadFlags>& readFlags,
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    const SparseKmerTable* sparseKmerTable,
     MarkerGraph& markerGraph,
     uint64_t pruneLength,
     const Mode2AssemblyOptions& mode2Options,
@@ -55,6 +56,7 @@ AssemblyGraph2::AssemblyGraph2(
     k(k),
     readFlags(readFlags),
     markers(markers),
+    sparseKmerTable(sparseKmerTable),
     markerGraph(markerGraph)
 {
 
@@ -804,7 +806,7 @@ void AssemblyGraph2::assemble(edge_descriptor e)
         MarkerGraph::EdgeId const * const end = begin + path.size();
         const span<const MarkerGraph::EdgeId> pathSpan(begin, end);
         assembleMarkerGraphPath(readRepresentation, k,
-            markers, markerGraph, pathSpan, false, assembledSegment);
+            markers, sparseKmerTable, markerGraph, pathSpan, false, assembledSegment);
 
 
 
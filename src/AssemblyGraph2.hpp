@@ -27,6 +27,7 @@ namespace shasta {
     class MarkerGraph;
     class Mode2AssemblyOptions;
     class ReadFlags;
+    class SparseKmerTable;
 
     using AssemblyGraph2BaseClass =
         boost::adjacency_list<boost::listS, boost::listS, boost::bidirectionalS,
@@ -256,6 +257,7 @@ public:
         uint64_t k, // Marker length
         const MemoryMapped::Vector<ReadFlags>& readFlags,
         const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+        const SparseKmerTable*,
         MarkerGraph&,
         uint64_t pruneLength,
         const Mode2AssemblyOptions&,
@@ -312,6 +314,7 @@ private:
     uint64_t k;
     const MemoryMapped::Vector<ReadFlags>& readFlags;
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
+    const SparseKmerTable* sparseKmerTable;
 public:
     uint64_t getReadCount() const
     {
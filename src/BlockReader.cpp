@@ -0,0 +1,255 @@
+// Shasta.
+#include "BlockReader.hpp"
+#include "SHASTA_ASSERT.hpp"
+using namespace shasta;
+
+// Standard library.
+#include <limits>
+#include "stdexcept.hpp"
+
+// Linux.
+#include <fcntl.h>
+#include <unistd.h>
+
+// Zlib.
+#include <zlib.h>
+
+
+
+BlockReader::BlockReader(
+    const string& fileName,
+    bool decompress,
+    uint64_t blockSize,
+    uint64_t blockCount) :
+    fileName(fileName),
+    decompress(decompress),
+    blockSize(blockSize)
+{
+    SHASTA_ASSERT(blockSize > 0);
+    SHASTA_ASSERT(blockSize <= std::numeric_limits<uInt>::max());
+    SHASTA_ASSERT(blockCount > 0);
+
+    fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+    if(fileDescriptor == -1) {
+        throw runtime_error("Error opening " + fileName);
+    }
+
+    // Create the ring of buffers. They are allocated
+    // by the reading thread as it needs them.
+    freeBlocks.resize(blockCount);
+
+    // Start the reading thread.
+    thread = std::thread(&BlockReader::threadFunction, this);
+}
+
+
+
+BlockReader::~BlockReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    condition.notify_all();
+    if(thread.joinable()) {
+        thread.join();
+    }
+    ::close(fileDescriptor);
+}
+
+
+
+bool BlockReader::getNextBlock(vector<char>& block)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this]{return not fullBlocks.empty() or endOfFile;});
+
+    if(not errorMessage.empty()) {
+        throw runtime_error(errorMessage);
+    }
+    if(fullBlocks.empty()) {
+        return false;
+    }
+
+    // Hand the next block to the caller and return the
+    // caller's previous block to the ring.
+    block.swap(fullBlocks.front());
+    freeBlocks.push_back(std::move(fullBlocks.front()));
+    fullBlocks.pop_front();
+    lock.unlock();
+    condition.notify_all();
+
+    return true;
+}
+
+
+
+void BlockReader::threadFunction()
+{
+    try {
+        if(decompress) {
+            readAndDecompressBlocks();
+        } else {
+            readBlocks();
+        }
+    } catch(const std::exception& e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        errorMessage = "Error reading " + fileName + ": " + e.what();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        endOfFile = true;
+    }
+    condition.notify_all();
+}
+
+
+
+bool BlockReader::getFreeBlock(vector<char>& block)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this]{return not freeBlocks.empty() or stopRequested;});
+    if(stopRequested) {
+        return false;
+    }
+    block.swap(freeBlocks.back());
+    freeBlocks.pop_back();
+    return true;
+}
+
+
+
+void BlockReader::storeFullBlock(vector<char>& block)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fullBlocks.push_back(std::move(block));
+    }
+    condition.notify_all();
+}
+
+
+
+// Read the file, one block at a time.
+void BlockReader::readBlocks()
+{
+    while(true) {
+        vector<char> block;
+        if(not getFreeBlock(block)) {
+            break;
+        }
+
+        // Fill it.
+        block.resize(blockSize);
+        uint64_t size = 0;
+        while(size < blockSize) {
+            const ssize_t n = ::read(fileDescriptor, block.data() + size, blockSize - size);
+            if(n < 0) {
+                throw runtime_error("Read error.");
+            }
+            if(n == 0) {
+                break;
+            }
+            size += n;
+        }
+        block.resize(size);
+
+        if(size == 0) {
+            break;
+        }
+        storeFullBlock(block);
+        if(size < blockSize) {
+            break;
+        }
+    }
+}
+
+
+
+// Read and decompress the file, one block at a time.
+void BlockReader::readAndDecompressBlocks()
+{
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in = Z_NULL;
+    stream.avail_in = 0;
+
+    // 15 + 32 = maximum window size, with automatic header detection.
+    if(inflateInit2(&stream, 15 + 32) != Z_OK) {
+        throw runtime_error("Error initializing zlib.");
+    }
+
+    try {
+        vector<Bytef> inputBuffer(4 * 1024 * 1024);
+        bool inputEnd = false;
+
+        // This is set when we reach the end of a gzip member
+        // and reset when we start decompressing the next one.
+        // If it is not set when we reach the end of the file,
+        // the file is truncated.
+        bool memberIsComplete = false;
+
+        while(not inputEnd) {
+
+            // Get a free block from the ring, waiting if necessary.
+            vector<char> block;
+            if(not getFreeBlock(block)) {
+                break;
+            }
+
+            // Fill it with decompressed data.
+            block.resize(blockSize);
+            stream.next_out = reinterpret_cast<Bytef*>(block.data());
+            stream.avail_out = uInt(blockSize);
+            while(stream.avail_out > 0) {
+
+                // If necessary, read more compressed data.
+                if(stream.avail_in == 0) {
+                    const ssize_t n = ::read(fileDescriptor, inputBuffer.data(), inputBuffer.size());
+                    if(n < 0) {
+                        throw runtime_error("Read error.");
+                    }
+                    if(n == 0) {
+                        inputEnd = true;
+                        break;
+                    }
+                    stream.next_in = inputBuffer.data();
+                    stream.avail_in = uInt(n);
+                }
+
+                const int status = inflate(&stream, Z_NO_FLUSH);
+                if(status == Z_STREAM_END) {
+                    // We reached the end of a gzip member.
+                    // Get ready for the next one, if any.
+                    memberIsComplete = true;
+                    if(inflateReset(&stream) != Z_OK) {
+                        throw runtime_error("Error resetting zlib.");
+                    }
+                } else if(status == Z_OK or status == Z_BUF_ERROR) {
+                    memberIsComplete = false;
+                } else {
+                    throw runtime_error("Invalid gzip data, zlib error " + to_string(status) + ".");
+                }
+            }
+            block.resize(blockSize - stream.avail_out);
+
+            if(inputEnd and not memberIsComplete) {
+                throw runtime_error("The file is empty or truncated.");
+            }
+
+            // Make it available to the consumer.
+            if(not block.empty()) {
+                storeFullBlock(block);
+            }
+        }
+
+    } catch(...) {
+        inflateEnd(&stream);
+        throw;
+    }
+
+    inflateEnd(&stream);
+}
@@ -0,0 +1,107 @@
+#ifndef SHASTA_BLOCK_READER_HPP
+#define SHASTA_BLOCK_READER_HPP
+
+/*******************************************************************************
+
+Class BlockReader reads a file in a separate thread
+and makes its contents available as a sequence of
+fixed-size blocks. If requested, the file is decompressed
+using gzip as it is read.
+
+Blocks are kept in a bounded ring of buffers,
+so the memory used is at most (blockCount + 1) * blockSize bytes
+regardless of the size of the file.
+The reading thread stays at most blockCount blocks ahead
+of the consumer, and the consumer can process a block
+while the reading thread reads or decompresses the next ones.
+
+For decompression, files consisting of multiple concatenated gzip members
+(for example, files created by bgzip) are supported.
+
+Usage pattern:
+
+BlockReader blockReader(fileName, decompress, blockSize, blockCount);
+vector<char> block;
+while(blockReader.getNextBlock(block)) {
+    // Use the data in block.
+}
+
+*******************************************************************************/
+
+// Standard library.
+#include <condition_variable>
+#include "cstdint.hpp"
+#include <deque>
+#include <mutex>
+#include "string.hpp"
+#include <thread>
+#include "vector.hpp"
+
+namespace shasta {
+    class BlockReader;
+}
+
+
+
+class shasta::BlockReader {
+public:
+
+    // The constructor opens the file and starts the reading thread.
+    BlockReader(
+        const string& fileName,
+        bool decompress,
+        uint64_t blockSize,
+        uint64_t blockCount);
+
+    // The destructor stops the reading thread, if necessary.
+    ~BlockReader();
+
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    // Get the next block of data.
+    // The vector passed in is swapped with the next available block,
+    // and its previous contents are returned to the ring for reuse.
+    // All blocks are full (size equal to blockSize) except
+    // possibly the last one.
+    // Returns false if there are no more blocks.
+    bool getNextBlock(vector<char>&);
+
+private:
+
+    const string fileName;
+    const bool decompress;
+    const uint64_t blockSize;
+    int fileDescriptor = -1;
+
+    // The ring of buffers.
+    // Blocks that were filled by the reading thread
+    // and not yet consumed are in fullBlocks, in file order.
+    // Blocks that are available to the reading thread are in freeBlocks.
+    std::deque< vector<char> > fullBlocks;
+    vector< vector<char> > freeBlocks;
+
+    // Synchronization between the reading thread and the consumer.
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool endOfFile = false;
+    bool stopRequested = false;
+    string errorMessage;
+
+    // The reading thread.
+    std::thread thread;
+    void threadFunction();
+    void readBlocks();
+    void readAndDecompressBlocks();
+
+    // Get a free block from the ring, waiting if necessary.
+    // Returns false if the consumer requested a stop.
+    bool getFreeBlock(vector<char>&);
+
+    // Make a block available to the consumer.
+    void storeFullBlock(vector<char>&);
+};
+
+
+
+#endif
@@ -34,10 +34,24 @@ Coverage::Coverage()
 
 
 
+// Remove all reads, returning to the state after construction,
+// but without releasing memory.
+void Coverage::clear()
+{
+    readCoverageData.clear();
+    for(size_t base=0; base<5; base++) {
+        for(Strand strand=0; strand<2; strand++) {
+            detailedCoverage[base][strand].clear();
+            baseCoverage[base][strand] = 0;
+        }
+    }
+}
+
+
+
 // Add information about a supporting read.
 // If the AlignedBase is '-',repeatCount must be zero.
 // Otherwise, it must not be zero.
-// This is the only public non-const function.
 void Coverage::addRead(AlignedBase base, Strand strand, size_t repeatCount)
 {
     // Sanity check on the base.
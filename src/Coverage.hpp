@@ -101,9 +101,14 @@ public:
     // Add information about a supporting read.
     // If the AlignedBase is '-',repeatCount must be zero.
     // Otherwise, it must not be zero.
-    // This is the only public non-const function.
     void addRead(AlignedBase, Strand, size_t repeatCount);
 
+    // Remove all reads, returning to the state after construction.
+    // The memory allocated by the vectors is not released,
+    // so a Coverage object reused in a loop
+    // does not allocate memory once it has grown large enough.
+    void clear();
+
     // Return the list detailing coverage from each read.
     const vector<CoverageData>& getReadCoverageData() const
     {
@@ -137,6 +142,15 @@ public:
     size_t coverage(AlignedBase, size_t repeatCount) const;
     char coverageCharacter(AlignedBase, size_t repeatCount) const;
 
+    // Get coverage for a given base and strand, indexed by repeat count.
+    // The returned vector can be shorter than repeatCountEnd(base).
+    const vector<size_t>& detailedCoverageVector(AlignedBase base, Strand strand) const
+    {
+        SHASTA_ASSERT(base.value < 5);
+        SHASTA_ASSERT(strand < 2);
+        return detailedCoverage[base.value][strand];
+    }
+
     // Get base coverage for the best base.
     size_t mostFrequentBaseCoverage() const;
     char mostFrequentBaseCoverageCharacter() const;
@@ -0,0 +1,243 @@
+#ifndef SHASTA_EXTERNAL_SORT_HPP
+#define SHASTA_EXTERNAL_SORT_HPP
+
+// External sort of objects that don't fit in memory.
+// The objects are written to disk and read back as raw bytes,
+// so they must be trivially copy constructible (std::pair of integers is ok).
+// The caller sorts chunks of objects in memory and writes
+// each of them to disk as a sorted run.
+// The runs are then merged, invoking a function for each object
+// in sorted order. Memory usage during the merge is
+// bounded by the specified memory budget, and the number of runs
+// merged in one pass is also limited so the number of
+// open files stays well below the process limit.
+
+#include "algorithm.hpp"
+#include "fstream.hpp"
+#include "stdexcept.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+#include <filesystem>
+#include <queue>
+#include <sys/resource.h>
+#include <type_traits>
+
+namespace shasta {
+    template<class T> class ExternalSortRuns;
+}
+
+
+
+template<class T> class shasta::ExternalSortRuns {
+public:
+    static_assert(std::is_trivially_copy_constructible<T>::value,
+        "ExternalSortRuns requires trivially copy constructible objects.");
+
+    // Run i is stored in file fileNamePrefix + to_string(i).
+    ExternalSortRuns(const string& fileNamePrefix, uint64_t runCount) :
+        fileNamePrefix(fileNamePrefix)
+    {
+        for(uint64_t i=0; i<runCount; i++) {
+            fileNames.push_back(fileNamePrefix + to_string(i));
+        }
+    }
+
+    ~ExternalSortRuns()
+    {
+        remove();
+    }
+
+    // Write a sorted run. Different threads can write
+    // different runs concurrently.
+    void writeRun(uint64_t runId, const vector<T>& run) const
+    {
+        ofstream file(fileNames[runId], std::ios::binary);
+        if(not file) {
+            throw runtime_error("Error opening " + fileNames[runId]);
+        }
+        file.write(reinterpret_cast<const char*>(run.data()), std::streamsize(run.size() * sizeof(T)));
+        if(not file) {
+            throw runtime_error("Error writing " + fileNames[runId]);
+        }
+    }
+
+    // Merge the runs, calling f(const T&) for each object in sorted order.
+    // Memory usage is bounded by memoryBudget bytes.
+    // If there are too many runs to merge them in one pass
+    // with buffers of a reasonable size, or without opening
+    // too many files at once, they are first merged in groups
+    // into a smaller number of longer runs.
+    template<class F> void merge(uint64_t memoryBudget, F f)
+    {
+        while(fileNames.size() > maxMergeWidth(memoryBudget)) {
+            reduce(memoryBudget);
+        }
+        mergeFiles(fileNames, memoryBudget, f);
+    }
+
+    // Remove the files containing the runs.
+    void remove()
+    {
+        for(const string& fileName: fileNames) {
+            std::filesystem::remove(fileName);
+        }
+        fileNames.clear();
+    }
+
+private:
+    string fileNamePrefix;
+    vector<string> fileNames;
+
+    // Number of times runs were merged into longer runs.
+    uint64_t reduceCount = 0;
+
+    // Each run being merged gets a buffer of at least this many objects.
+    static const uint64_t minBufferObjectCount = 1024;
+
+    // The maximum number of runs merged in one pass, regardless of memory.
+    // Each run being merged uses an open file.
+    static const uint64_t maxMergeFanIn = 256;
+
+    // The maximum number of runs that can be merged in one pass.
+    // This is limited by the memory budget, by maxMergeFanIn,
+    // and by the limit on open files for this process,
+    // leaving half of it for the output file and other uses.
+    static uint64_t maxMergeWidth(uint64_t memoryBudget)
+    {
+        const uint64_t bufferCount = memoryBudget / (sizeof(T) * minBufferObjectCount);
+        uint64_t width = min(uint64_t(maxMergeFanIn), bufferCount > 0 ? bufferCount - 1 : 0);
+        rlimit fileLimit;
+        if(::getrlimit(RLIMIT_NOFILE, &fileLimit) == 0 and fileLimit.rlim_cur != RLIM_INFINITY) {
+            width = min(width, uint64_t(fileLimit.rlim_cur) / 2);
+        }
+        return max(uint64_t(2), width);
+    }
+
+    // Sequential access to a run, using a buffer.
+    class Reader {
+    public:
+        Reader(const string& fileName, uint64_t bufferObjectCount) :
+            file(fileName, std::ios::binary),
+            buffer(bufferObjectCount)
+        {
+            if(not file) {
+                throw runtime_error("Error opening " + fileName);
+            }
+            fill();
+        }
+        bool atEnd() const
+        {
+            return position == buffer.size();
+        }
+        const T& current() const
+        {
+            return buffer[position];
+        }
+        void next()
+        {
+            ++position;
+            if(position == buffer.size()) {
+                fill();
+            }
+        }
+    private:
+        ifstream file;
+        vector<T> buffer;
+        uint64_t position = 0;
+        void fill()
+        {
+            buffer.resize(buffer.capacity());
+            file.read(reinterpret_cast<char*>(buffer.data()), std::streamsize(buffer.size() * sizeof(T)));
+            buffer.resize(uint64_t(file.gcount()) / sizeof(T));
+            position = 0;
+        }
+    };
+
+    // Merge the given runs, calling f(const T&) for each object in sorted order.
+    // The memory budget is divided among the runs.
+    template<class F> static void mergeFiles(
+        const vector<string>& inputFileNames,
+        uint64_t memoryBudget,
+        F& f)
+    {
+        const uint64_t bufferObjectCount = max(uint64_t(minBufferObjectCount),
+            memoryBudget / (sizeof(T) * (inputFileNames.size() + 1)));
+        vector<Reader> readers;
+        readers.reserve(inputFileNames.size());
+        for(const string& fileName: inputFileNames) {
+            readers.emplace_back(fileName, bufferObjectCount);
+        }
+
+        // A heap of the readers that are not at end,
+        // with the one with the smallest current object on top.
+        auto comparator = [&readers](uint64_t i, uint64_t j) {
+            return readers[j].current() < readers[i].current();
+        };
+        std::priority_queue<uint64_t, vector<uint64_t>, decltype(comparator)> heap(comparator);
+        for(uint64_t i=0; i<readers.size(); i++) {
+            if(not readers[i].atEnd()) {
+                heap.push(i);
+            }
+        }
+
+        while(not heap.empty()) {
+            const uint64_t i = heap.top();
+            heap.pop();
+            Reader& reader = readers[i];
+            f(reader.current());
+            reader.next();
+            if(not reader.atEnd()) {
+                heap.push(i);
+            }
+        }
+    }
+
+    // Merge the runs in groups, reducing the number of runs.
+    void reduce(uint64_t memoryBudget)
+    {
+        // Half of the memory budget is used by the readers
+        // and the other half to buffer the output.
+        const uint64_t width = maxMergeWidth(memoryBudget / 2);
+        const uint64_t bufferObjectCount = max(uint64_t(minBufferObjectCount), memoryBudget / (sizeof(T) * 2));
+        vector<string> newFileNames;
+        for(uint64_t begin=0; begin<fileNames.size(); begin+=width) {
+            const uint64_t end = min(fileNames.size(), begin + width);
+            const vector<string> inputFileNames(fileNames.begin() + begin, fileNames.begin() + end);
+
+            const string newFileName = fileNamePrefix + "Merged-" +
+                to_string(reduceCount) + "-" + to_string(newFileNames.size());
+            ofstream file(newFileName, std::ios::binary);
+            if(not file) {
+                throw runtime_error("Error opening " + newFileName);
+            }
+
+            vector<T> buffer;
+            buffer.reserve(bufferObjectCount);
+            auto flush = [&]() {
+                file.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size() * sizeof(T)));
+                if(not file) {
+                    throw runtime_error("Error writing " + newFileName);
+                }
+                buffer.clear();
+            };
+            auto g = [&](const T& t) {
+                buffer.push_back(t);
+                if(buffer.size() == bufferObjectCount) {
+                    flush();
+                }
+            };
+            mergeFiles(inputFileNames, memoryBudget / 2, g);
+            flush();
+
+            for(const string& fileName: inputFileNames) {
+                std::filesystem::remove(fileName);
+            }
+            newFileNames.push_back(newFileName);
+        }
+        fileNames.swap(newFileNames);
+        ++reduceCount;
+    }
+};
+
+#endif
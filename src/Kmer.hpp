@@ -15,7 +15,32 @@ namespace shasta {
         std::numeric_limits<KmerId>::digits == 2*Kmer::capacity,
         "Kmer and KmerId types are inconsistent.");
 
+    // Type used to represent k-mers when using the sparse k-mer table,
+    // which supports k-mers up to maxSparseKmerLength bases.
+    // A KmerId64 is computed using Kmer64::id(k), in the same way as a KmerId.
+    // In that case, the KmerId stored in a marker is not the id of the k-mer,
+    // but its index in the sparse k-mer table. See SparseKmerTable.hpp.
+    using Kmer64 = ShortBaseSequence64;
+    using KmerId64 = uint64_t;
+    const uint64_t maxSparseKmerLength = 31;
+
     class KmerInfo;
+
+    // Return true if a k-mer does not contain repeated consecutive bases,
+    // that is, if it can occur in run-length encoded sequence.
+    template<class Int> inline bool isRleKmer(const ShortBaseSequence<Int>& kmer, uint64_t k)
+    {
+        for(uint64_t i=1; i<k; i++) {
+            if(kmer[i-1] == kmer[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    inline bool isRleKmer(KmerId64 kmerId, uint64_t k)
+    {
+        return isRleKmer(Kmer64(kmerId, k), k);
+    }
 }
 
 
@@ -0,0 +1,97 @@
+// Shasta.
+#include "KmerCounter.hpp"
+using namespace shasta;
+
+
+
+KmerCounter::KmerCounter(uint64_t k, MemoryMapped::Vector<uint64_t>& count) :
+    MultithreadedObject<KmerCounter>(*this),
+    k(k),
+    count(count)
+{
+    SHASTA_ASSERT(k <= Kmer::capacity);
+    const uint64_t kmerCount = 1ULL << (2ULL * k);
+    count.resize(kmerCount);
+    fill(count.begin(), count.end(), 0ULL);
+
+    // Use up to 1024 shards.
+    const uint64_t shardBits = min(uint64_t(10), 2 * k);
+    shift = 2 * k - shardBits;
+    shardCount = 1ULL << shardBits;
+    shardMutexes = vector<std::mutex>(shardCount);
+}
+
+
+
+KmerCounter::Buffer::Buffer(KmerCounter& kmerCounter) :
+    kmerCounter(kmerCounter),
+    shardBuffers(kmerCounter.shardCount)
+{
+    for(vector<KmerId>& shardBuffer: shardBuffers) {
+        shardBuffer.reserve(capacity);
+    }
+}
+
+
+
+void KmerCounter::Buffer::flush()
+{
+    for(uint64_t shardId=0; shardId<shardBuffers.size(); shardId++) {
+        flush(shardId);
+    }
+}
+
+
+
+void KmerCounter::Buffer::flush(uint64_t shardId)
+{
+    vector<KmerId>& shardBuffer = shardBuffers[shardId];
+    if(shardBuffer.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(kmerCounter.shardMutexes[shardId]);
+        uint64_t* countPointer = kmerCounter.count.begin();
+        for(const KmerId kmerId: shardBuffer) {
+            ++countPointer[kmerId];
+        }
+    }
+    shardBuffer.clear();
+}
+
+
+
+void KmerCounter::addReverseComplementCounts(size_t threadCount)
+{
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    setupLoadBalancing(count.size(), 1024 * 1024);
+    runThreads(&KmerCounter::addReverseComplementCountsThreadFunction, threadCount);
+}
+
+
+
+// Each pair of reverse complemented k-mers is processed
+// by the thread that owns the smaller of the two KmerIds,
+// so no synchronization is needed.
+void KmerCounter::addReverseComplementCountsThreadFunction(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t kmerId=begin; kmerId!=end; kmerId++) {
+            const uint64_t reverseComplementedKmerId = Kmer(kmerId, k).reverseComplement(k).id(k);
+            if(reverseComplementedKmerId < kmerId) {
+                continue;
+            }
+            if(reverseComplementedKmerId == kmerId) {
+                count[kmerId] *= 2;
+            } else {
+                const uint64_t sum = count[kmerId] + count[reverseComplementedKmerId];
+                count[kmerId] = sum;
+                count[reverseComplementedKmerId] = sum;
+            }
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef SHASTA_KMER_COUNTER_HPP
+#define SHASTA_KMER_COUNTER_HPP
+
+/*******************************************************************************
+
+Class KmerCounter counts occurrences of all 4^k k-mers of length k
+using multiple threads, with a single vector of counts
+shared by all threads.
+
+Having all threads increment the shared counts atomically is too slow,
+and giving each thread its own vector of 4^k counts requires
+O(threadCount * 4^k) memory plus a serial merge.
+Instead, the k-mer space is partitioned into shards by the
+most significant bits of the KmerId. Each thread accumulates
+KmerIds in a small buffer for each shard, and when a buffer
+is full it locks the shard and applies all the increments in the buffer.
+Because each shard covers a contiguous range of counts,
+the increments have good locality, and contention is low
+because there are many shards.
+Memory usage is 4^k counts plus a small buffer for each thread and shard.
+
+Usage pattern:
+
+KmerCounter kmerCounter(k, count);
+
+// In each thread:
+KmerCounter::Buffer buffer(kmerCounter);
+for(...) {
+    buffer.add(kmerId);
+}
+buffer.flush();
+
+// After all threads are done, optionally:
+kmerCounter.addReverseComplementCounts(threadCount);
+
+*******************************************************************************/
+
+#include "Kmer.hpp"
+#include "MemoryMappedVector.hpp"
+#include "MultithreadedObject.hpp"
+
+#include "cstdint.hpp"
+#include <mutex>
+#include "vector.hpp"
+
+namespace shasta {
+    class KmerCounter;
+}
+
+
+
+class shasta::KmerCounter : public MultithreadedObject<KmerCounter> {
+public:
+
+    // The counts are stored in the vector passed in,
+    // which is resized to 4^k and filled with zeros.
+    KmerCounter(uint64_t k, MemoryMapped::Vector<uint64_t>& count);
+
+    // Each thread uses its own Buffer to add k-mer occurrences.
+    class Buffer {
+    public:
+        Buffer(KmerCounter&);
+
+        void add(KmerId kmerId)
+        {
+            const uint64_t shardId = uint64_t(kmerId) >> kmerCounter.shift;
+            vector<KmerId>& shardBuffer = shardBuffers[shardId];
+            shardBuffer.push_back(kmerId);
+            if(shardBuffer.size() == capacity) {
+                flush(shardId);
+            }
+        }
+
+        // Apply all pending increments to the shared counts.
+        // This must be called when the thread is done adding k-mers.
+        void flush();
+
+    private:
+        KmerCounter& kmerCounter;
+        vector< vector<KmerId> > shardBuffers;
+        static const uint64_t capacity = 1024;
+        void flush(uint64_t shardId);
+    };
+
+    // Replace the count of each k-mer with the sum of its count
+    // and the count of its reverse complement.
+    // If only k-mers on strand 0 of each read were added,
+    // this gives the number of occurrences in all oriented reads,
+    // with palindromic k-mers counted twice for each occurrence.
+    // This uses multiple threads and must be called after all
+    // buffers have been flushed.
+    void addReverseComplementCounts(size_t threadCount);
+
+private:
+    uint64_t k;
+    MemoryMapped::Vector<uint64_t>& count;
+
+    // KmerIds are shifted right by this number of bits
+    // to obtain their shard id.
+    uint64_t shift;
+    uint64_t shardCount;
+    vector<std::mutex> shardMutexes;
+
+    void addReverseComplementCountsThreadFunction(size_t threadId);
+};
+
+
+
+#endif
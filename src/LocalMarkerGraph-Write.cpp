@@ -371,8 +371,7 @@ void LocalMarkerGraph::Writer::operator()(std::ostream& s, vertex_descriptor v)
 
         // Marker sequence (run-length).
         const size_t k = graph.k;
-        const KmerId kmerId = graph.getKmerId(v);
-        const Kmer kmer(kmerId, k);
+        const Kmer64 kmer = graph.getKmer(v);
         kmer.write(s, k);
         s << "\\n";
 
@@ -426,8 +425,7 @@ void LocalMarkerGraph::Writer::operator()(std::ostream& s, vertex_descriptor v)
 
         // Marker sequence (run-length).
         const size_t k = graph.k;
-        const KmerId kmerId = graph.getKmerId(v);
-        const Kmer kmer(kmerId, k);
+        const Kmer64 kmer = graph.getKmer(v);
         s << "<tr><td align='left'>Marker</td><td>";
         kmer.write(s, k);
         s << "</td></tr>";
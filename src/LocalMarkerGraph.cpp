@@ -3,6 +3,7 @@
 #include "approximateTopologicalSort.hpp"
 #include "findMarkerId.hpp"
 #include "orderPairs.hpp"
+#include "SparseKmerTable.hpp"
 using namespace shasta;
 
 // Boost libraries.
@@ -16,6 +17,7 @@ LocalMarkerGraph::LocalMarkerGraph(
     uint64_t assemblyMode,
     const Reads& reads,
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    const SparseKmerTable* sparseKmerTable,
     const MemoryMapped::Vector<MarkerGraph::CompressedVertexId>& globalMarkerGraphVertex,
     const ConsensusCaller& consensusCaller
     ) :
@@ -24,6 +26,7 @@ LocalMarkerGraph::LocalMarkerGraph(
     assemblyMode(assemblyMode),
     reads(reads),
     markers(markers),
+    sparseKmerTable(sparseKmerTable),
     globalMarkerGraphVertex(globalMarkerGraphVertex),
     consensusCaller(consensusCaller)
 {
@@ -100,6 +103,14 @@ KmerId LocalMarkerGraph::getKmerId(vertex_descriptor v) const
 
 
 
+// Get the k-mer for a vertex.
+Kmer64 LocalMarkerGraph::getKmer(vertex_descriptor v) const
+{
+    return getMarkerKmer(getKmerId(v), k, sparseKmerTable);
+}
+
+
+
 // Get the repeat counts for a MarkerInfo of a vertex.
 vector<uint8_t> LocalMarkerGraph::getRepeatCounts(
     const LocalMarkerGraphVertex::MarkerInfo& markerInfo) const
@@ -148,8 +159,7 @@ void LocalMarkerGraph::computeVertexConsensusInfo( vertex_descriptor v)
     LocalMarkerGraphVertex& vertex = graph[v];
 
     // Get the marker k-mer of this vertex.
-    const KmerId kmerId = graph.getKmerId(v);
-    const Kmer kmer(kmerId, k);
+    const Kmer64 kmer = graph.getKmer(v);
     // Resize the consensus info's for the vertex.
     vertex.coverages.resize(k);
 
@@ -41,6 +41,7 @@ namespace shasta {
     class ConsensusCaller;
     class LocalMarkerGraphRequestParameters;
     class LongBaseSequences;
+    class SparseKmerTable;
 }
 
 
@@ -229,6 +230,7 @@ public:
         uint64_t assemblyMode,
         const Reads& reads,
         const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+        const SparseKmerTable*,
         const MemoryMapped::Vector<MarkerGraph::CompressedVertexId>& globalMarkerGraphVertex,
         const ConsensusCaller&
         );
@@ -253,6 +255,9 @@ public:
     // Get the KmerId for a vertex.
     KmerId getKmerId(vertex_descriptor) const;
 
+    // Get the k-mer for a vertex.
+    Kmer64 getKmer(vertex_descriptor) const;
+
     // Get the repeat counts for a MarkerInfo of a vertex.
     vector<uint8_t> getRepeatCounts(const LocalMarkerGraphVertex::MarkerInfo&) const;
 
@@ -302,6 +307,10 @@ private:
     const Reads& reads;
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
 
+    // The sparse k-mer table, if in use, or 0 otherwise.
+    // Used to get the k-mer corresponding to a KmerId.
+    const SparseKmerTable* sparseKmerTable;
+
     // A reference to the vector containing the global marker graph vertex id
     // corresponding to each marker.
     // Indexed by MarkerId.
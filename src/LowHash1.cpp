@@ -8,6 +8,7 @@ using namespace shasta;
 // Standad library.
 #include "algorithm.hpp"
 #include "chrono.hpp"
+#include <filesystem>
 
 
 
@@ -19,8 +20,10 @@ LowHash1::LowHash1(
     size_t minBucketSize,           // The minimum size for a bucket to be used.
     size_t maxBucketSize,           // The maximum size for a bucket to be used.
     size_t minFrequency,            // Minimum number of minHash hits for a pair to be considered a candidate.
+    bool hashAllIterationsInOnePass,// Compute the low hashes for all iterations in a single pass.
+    const string& checkpointDirectory, // If not empty, store common features in a checkpoint there.
+    size_t k,                       // Marker length, only used to validate the checkpoint.
     size_t threadCountArgument,
-    const MemoryMapped::Vector<KmerInfo>& kmerTable,
     const Reads& reads,
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
     AlignmentCandidates& candidates,
@@ -29,18 +32,21 @@ LowHash1::LowHash1(
     ) :
     MultithreadedObject(*this),
     m(m),
+    k(k),
     hashFraction(hashFraction),
     minBucketSize(minBucketSize),
     maxBucketSize(maxBucketSize),
     minFrequency(minFrequency),
     threadCount(threadCountArgument),
-    kmerTable(kmerTable),
     reads(reads),
     markers(markers),
     candidates(candidates),
     largeDataFileNamePrefix(largeDataFileNamePrefix),
     largeDataPageSize(largeDataPageSize),
-    histogramCsv("LowHashBucketHistogram.csv")
+    minHashIterationCount(minHashIterationCount),
+    hashAllIterationsInOnePass(hashAllIterationsInOnePass),
+    histogramCsv("LowHashBucketHistogram.csv"),
+    checkpointDirectory(checkpointDirectory)
 
 {
     cout << timestamp << "LowHash1 begins." << endl;
@@ -106,11 +112,28 @@ LowHash1::LowHash1(
             largeDataPageSize);
     }
 
+    // If requested, open the checkpoint and skip the iterations it already contains.
+    firstIteration = 0;
+    if(useCheckpoint()) {
+        firstIteration = openCheckpoint(log2MinHashBucketCount);
+    }
+
+    // If requested, compute the low hashes for all iterations in a single pass.
+    if(hashAllIterationsInOnePass and firstIteration < minHashIterationCount) {
+        cout << timestamp << "Computing low hashes for all iterations." << endl;
+        allLowHashes.resize(minHashIterationCount);
+        for(auto& v: allLowHashes) {
+            v.resize(orientedReadCount);
+        }
+        setupLoadBalancing(readCount, 1000);
+        runThreads(&LowHash1::computeAllLowHashesThreadFunction, threadCount);
+    }
+
     // Write the header of the histogram file.
     histogramCsv << "Iteration,BucketSize,BucketCount,FeatureCount\n";
 
     // LowHash iteration loop.
-    for(iteration=0; iteration<minHashIterationCount; iteration++) {
+    for(iteration=firstIteration; iteration<minHashIterationCount; iteration++) {
         cout << timestamp << "LowHash iteration " << iteration << " begins." << endl;
 
         // Compute the low hashes for each oriented read
@@ -126,6 +149,11 @@ LowHash1::LowHash1(
         setupLoadBalancing(readCount, batchSize);
         runThreads(&LowHash1::fillBucketsThreadFunction, threadCount);
         buckets.endPass2(false, false);
+        peakMemoryBytes = computeMemoryBytes();
+        if(hashAllIterationsInOnePass) {
+            allLowHashes[iteration].clear();
+            allLowHashes[iteration].shrink_to_fit();
+        }
         cout << "Load factor at this iteration " <<
             double(buckets.totalSize()) / double(buckets.size()) << endl;
         computeBucketHistogram();
@@ -139,13 +167,33 @@ LowHash1::LowHash1(
         const uint64_t newCommonFeatureCount = countTotalThreadCommonFeatures();
         cout << "Stored " << newCommonFeatureCount-oldCommonFeatureCount <<
             " common features at this iteration." << endl;
+        peakMemoryBytes = max(peakMemoryBytes, computeMemoryBytes());
+        cout << "Peak memory used by LowHash1 data structures at this iteration " <<
+            peakMemoryBytes << " bytes." << endl;
+
+        // Move the common features found at this iteration to the checkpoint.
+        if(useCheckpoint()) {
+            writeCheckpoint();
+        }
     }
 
-    // Gather together all the common features found by all threads.
+    // Gather together all the common features found by all threads,
+    // or stored in the checkpoint.
     cout << timestamp << "Gathering common features found by all threads." << endl;
+    if(useCheckpoint()) {
+        gatherSources.push_back(make_pair(&checkpointCommonFeatures,
+            checkpointIterationBegin[minHashIterationCount]));
+    } else {
+        for(const auto& v: threadCommonFeatures) {
+            gatherSources.push_back(make_pair(v.get(), v->size()));
+        }
+    }
     gatherCommonFeatures();
+    gatherSources.clear();
     cout << timestamp << "Total number of common features including duplicates is " <<
         commonFeatures.totalSize() << endl;
+    cout << "Memory used by LowHash1 data structures after gathering common features " <<
+        computeMemoryBytes() << " bytes." << endl;
 
     // We no longer need the common features by thread.
     for(size_t threadId=0; threadId!=threadCount; threadId++) {
@@ -166,7 +214,13 @@ LowHash1::LowHash1(
     buckets.remove();
     kmerIds.remove();
     lowHashes.clear();
+    allLowHashes.clear();
     commonFeatures.remove();
+    if(useCheckpoint()) {
+        checkpointInfo.close();
+        checkpointCommonFeatures.close();
+        checkpointIterationBegin.close();
+    }
 
     // Done.
     const auto tEnd = steady_clock::now();
@@ -193,6 +247,7 @@ void LowHash1::createKmerIds()
     }
     kmerIds.beginPass2();
     kmerIds.endPass2(false);
+    markersChecksum = 0;
     const size_t batchSize = 10000;
     setupLoadBalancing(readCount, batchSize);
     runThreads(&LowHash1::createKmerIds, threadCount);
@@ -204,6 +259,9 @@ void LowHash1::createKmerIds()
 void LowHash1::createKmerIds(size_t threadId)
 {
 
+    // Checksum contribution of the oriented reads processed by this thread.
+    uint64_t checksum = 0;
+
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
@@ -220,9 +278,40 @@ void LowHash1::createKmerIds(size_t threadId)
                 for(const CompressedMarker& marker: orientedReadMarkers) {
                     *pointer++ = marker.kmerId;
                 }
+
+                checksum += MurmurHash64A(kmerIds.begin(orientedReadId.getValue()),
+                    int(orientedReadMarkers.size() * sizeof(KmerId)), orientedReadId.getValue());
             }
         }
     }
+
+    __sync_fetch_and_add(&markersChecksum, checksum);
+}
+
+
+
+// Compute the low hashes of an oriented read for one iteration,
+// using a FeatureHasher already set up for the oriented read.
+void LowHash1::computeLowHashes(
+    const FeatureHasher& featureHasher,
+    size_t iteration,
+    vector<uint64_t>& hashes,
+    vector< pair<uint64_t, uint32_t> >& orientedReadLowHashes) const
+{
+    orientedReadLowHashes.clear();
+
+    // Hash all the features of this oriented read.
+    // Features are sequences of m consecutive markers.
+    // In the pathological case where there are fewer than m markers
+    // there are no features, and this oriented read ends up in no bucket.
+    featureHasher.computeHashes(m, getSeed(iteration), hashes);
+
+    for(uint32_t j=0; j<uint32_t(hashes.size()); j++) {
+        const uint64_t hash = hashes[j];
+        if(hash < hashThreshold) {
+            orientedReadLowHashes.push_back(make_pair(hash, j));
+        }
+    }
 }
 
 
@@ -231,8 +320,8 @@ void LowHash1::createKmerIds(size_t threadId)
 // and count the number of entries in each bucket.
 void LowHash1::computeHashesThreadFunction(size_t threadId)
 {
-    const int featureByteCount = int(m * sizeof(KmerId));
-    const uint64_t seed = iteration * 37;
+    FeatureHasher featureHasher;
+    vector<uint64_t> hashes;
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
@@ -245,30 +334,22 @@ void LowHash1::computeHashesThreadFunction(size_t threadId)
             }
             for(Strand strand=0; strand<2; strand++) {
                 const OrientedReadId orientedReadId(readId, strand);
-
                 vector< pair<uint64_t, uint32_t> >& orientedReadLowHashes = lowHashes[orientedReadId.getValue()];
-                orientedReadLowHashes.clear();
-                const size_t markerCount = kmerIds.size(orientedReadId.getValue());
 
-                // Handle the pathological case where there are fewer than m markers.
-                // This oriented read ends up in no bucket.
-                if(markerCount < m) {
-                    continue;
+                // Get the low hashes for this oriented read,
+                // computing them if they were not precomputed.
+                if(hashAllIterationsInOnePass) {
+                    orientedReadLowHashes.swap(allLowHashes[iteration][orientedReadId.getValue()]);
+                } else {
+                    featureHasher.setKmerIds(
+                        kmerIds.begin(orientedReadId.getValue()),
+                        kmerIds.size(orientedReadId.getValue()));
+                    computeLowHashes(featureHasher, iteration, hashes, orientedReadLowHashes);
                 }
 
-                // Get the markers for this oriented read.
-                KmerId* kmerIdsPointer = kmerIds.begin(orientedReadId.getValue());
-                const size_t featureCount = markerCount - m + 1;
-
-                // Loop over features of this oriented read.
-                // Features are sequences of m consecutive markers.
-                for(size_t j=0; j<featureCount; j++, kmerIdsPointer++) {
-                    const uint64_t hash = MurmurHash64A(kmerIdsPointer, featureByteCount, seed);
-                    if(hash < hashThreshold) {
-                        orientedReadLowHashes.push_back(make_pair(hash, j));
-                        const uint64_t bucketId = hash & mask;
-                        buckets.incrementCountMultithreaded(bucketId);
-                    }
+                for(const auto& p: orientedReadLowHashes) {
+                    const uint64_t bucketId = p.first & mask;
+                    buckets.incrementCountMultithreaded(bucketId);
                 }
             }
         }
@@ -278,6 +359,38 @@ void LowHash1::computeHashesThreadFunction(size_t threadId)
 
 
 
+// Thread function to compute the low hashes for all iterations
+// in a single pass over the oriented reads.
+void LowHash1::computeAllLowHashesThreadFunction(size_t threadId)
+{
+    FeatureHasher featureHasher;
+    vector<uint64_t> hashes;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over oriented reads assigned to this batch.
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            if(reads.getFlags(readId).isPalindromic) {
+                continue;
+            }
+            for(Strand strand=0; strand<2; strand++) {
+                const OrientedReadId orientedReadId(readId, strand);
+                featureHasher.setKmerIds(
+                    kmerIds.begin(orientedReadId.getValue()),
+                    kmerIds.size(orientedReadId.getValue()));
+                for(size_t i=firstIteration; i<minHashIterationCount; i++) {
+                    computeLowHashes(featureHasher, i, hashes,
+                        allLowHashes[i][orientedReadId.getValue()]);
+                }
+            }
+        }
+    }
+}
+
+
+
 // Thread function to fill the buckets.
 void LowHash1::fillBucketsThreadFunction(size_t threadId)
 {
@@ -367,6 +480,7 @@ void LowHash1::scanBucketsThreadFunction(size_t threadId)
     MemoryMapped::Vector<CommonFeature>& commonFeatures = *threadCommonFeatures[threadId];
 
     const uint64_t mLocal = uint64_t(m);
+    vector<BucketEntryInfo> bucketEntryInfos;
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
@@ -384,30 +498,40 @@ void LowHash1::scanBucketsThreadFunction(size_t threadId)
                 continue;
             }
 
+            // Gather the information we need for each entry of the bucket.
+            bucketEntryInfos.resize(bucket.size());
+            for(uint64_t i=0; i<bucket.size(); i++) {
+                const BucketEntry& feature = bucket[i];
+                BucketEntryInfo& info = bucketEntryInfos[i];
+                const OrientedReadId orientedReadId = feature.orientedReadId;
+                const auto allKmerIds = kmerIds[orientedReadId.getValue()];
+                info.readId = orientedReadId.getReadId();
+                info.strand = orientedReadId.getStrand();
+                info.ordinal = feature.ordinal;
+                info.markerCount = uint32_t(allKmerIds.size());
+                info.featureKmerIds = allKmerIds.begin() + feature.ordinal;
+            }
+
             // Loop over pairs of bucket entries.
-            for(const BucketEntry& feature0: bucket) {
-                const OrientedReadId orientedReadId0 = feature0.orientedReadId;
-                const ReadId readId0 = orientedReadId0.getReadId();
-                const Strand strand0 = orientedReadId0.getStrand();
+            for(const BucketEntryInfo& feature0: bucketEntryInfos) {
+                const ReadId readId0 = feature0.readId;
+                const Strand strand0 = feature0.strand;
                 const uint32_t ordinal0 = feature0.ordinal;
-                const auto allKmerIds0 = kmerIds[orientedReadId0.getValue()];
-                const auto featureKmerIds0 = allKmerIds0.begin() + ordinal0;
-                const uint32_t markerCount0 = uint32_t(allKmerIds0.size());
+                const KmerId* featureKmerIds0 = feature0.featureKmerIds;
+                const uint32_t markerCount0 = feature0.markerCount;
 
-                for(const BucketEntry& feature1: bucket) {
-                    const OrientedReadId orientedReadId1 = feature1.orientedReadId;
-                    const ReadId readId1 = orientedReadId1.getReadId();
+                for(const BucketEntryInfo& feature1: bucketEntryInfos) {
+                    const ReadId readId1 = feature1.readId;
 
                     // Only consider the ones where readId0 < readId1.
                     if(readId0 >= readId1) {
                         continue;
                     }
 
-                    const Strand strand1 = orientedReadId1.getStrand();
+                    const Strand strand1 = feature1.strand;
                     const uint32_t ordinal1 = feature1.ordinal;
-                    const auto allKmerIds1 = kmerIds[orientedReadId1.getValue()];
-                    const auto featureKmerIds1 = allKmerIds1.begin() + ordinal1;
-                    const uint32_t markerCount1 = uint32_t(allKmerIds1.size());
+                    const KmerId* featureKmerIds1 = feature1.featureKmerIds;
+                    const uint32_t markerCount1 = feature1.markerCount;
 
                     // If the k-mers are not the same, this is a collision. Discard.
                     if(not std::equal(featureKmerIds0, featureKmerIds0+mLocal, featureKmerIds1)) {
@@ -438,6 +562,123 @@ void LowHash1::scanBucketsThreadFunction(size_t threadId)
 }
 
 
+LowHash1::CheckpointInfo LowHash1::getCheckpointInfo(uint64_t log2MinHashBucketCount) const
+{
+    CheckpointInfo info;
+    info.m = m;
+    info.hashFraction = hashFraction;
+    info.log2MinHashBucketCount = log2MinHashBucketCount;
+    info.minBucketSize = minBucketSize;
+    info.maxBucketSize = maxBucketSize;
+    info.orientedReadCount = markers.size();
+    info.markerCount = markers.totalSize();
+    info.k = k;
+    info.markersChecksum = markersChecksum;
+    return info;
+}
+
+
+
+bool LowHash1::checkpointMatches(const CheckpointInfo& info) const
+{
+    const CheckpointInfo& stored = checkpointInfo.object();
+    return
+        stored.m == info.m and
+        stored.hashFraction == info.hashFraction and
+        stored.log2MinHashBucketCount == info.log2MinHashBucketCount and
+        stored.minBucketSize == info.minBucketSize and
+        stored.maxBucketSize == info.maxBucketSize and
+        stored.orientedReadCount == info.orientedReadCount and
+        stored.markerCount == info.markerCount and
+        stored.k == info.k and
+        stored.markersChecksum == info.markersChecksum;
+}
+
+
+
+// Open an existing checkpoint or create a new one.
+// Returns the number of iterations that don't need to be computed.
+// The checkpoint is stored in checkpointDirectory, which is normally
+// on an ordinary filesystem even if binary data are not,
+// so it always uses 4 KB pages.
+size_t LowHash1::openCheckpoint(uint64_t log2MinHashBucketCount)
+{
+    std::filesystem::create_directories(checkpointDirectory);
+    const string name = checkpointDirectory + "/LowHash1Checkpoint";
+    const size_t checkpointPageSize = 4096;
+    const CheckpointInfo info = getCheckpointInfo(log2MinHashBucketCount);
+
+    // Try to use an existing checkpoint.
+    try {
+        checkpointInfo.accessExistingReadWrite(name + "-Info");
+        checkpointCommonFeatures.accessExistingReadWrite(name + "-CommonFeatures");
+        checkpointIterationBegin.accessExistingReadWrite(name + "-IterationBegin");
+    } catch(const std::exception&) {
+        if(checkpointInfo.isOpen) {
+            checkpointInfo.close();
+        }
+        if(checkpointCommonFeatures.isOpen) {
+            checkpointCommonFeatures.close();
+        }
+        if(checkpointIterationBegin.isOpen) {
+            checkpointIterationBegin.close();
+        }
+    }
+
+    if(checkpointIterationBegin.isOpen) {
+        if(checkpointMatches(info) and not checkpointIterationBegin.empty()) {
+
+            // Discard any common features from an iteration that did not complete.
+            checkpointCommonFeatures.resize(checkpointIterationBegin.back());
+
+            const size_t checkpointIterationCount = checkpointIterationBegin.size() - 1;
+            cout << timestamp << "Using LowHash1 checkpoint containing " <<
+                checkpointIterationCount << " iterations and " <<
+                checkpointCommonFeatures.size() << " common features." << endl;
+            if(checkpointIterationCount > minHashIterationCount) {
+                cout << "Only the first " << minHashIterationCount <<
+                    " iterations in the checkpoint will be used." << endl;
+            }
+            return min(checkpointIterationCount, minHashIterationCount);
+        } else {
+            cout << "Existing LowHash1 checkpoint was created with different "
+                "parameters and will be discarded." << endl;
+            checkpointInfo.close();
+            checkpointCommonFeatures.close();
+            checkpointIterationBegin.close();
+        }
+    }
+
+    // Create a new, empty checkpoint.
+    checkpointInfo.createNew(name + "-Info", checkpointPageSize);
+    checkpointInfo.object() = info;
+    checkpointCommonFeatures.createNew(name + "-CommonFeatures", checkpointPageSize);
+    checkpointIterationBegin.createNew(name + "-IterationBegin", checkpointPageSize);
+    checkpointIterationBegin.push_back(0);
+    cout << timestamp << "Created a new LowHash1 checkpoint in " << checkpointDirectory << endl;
+    return 0;
+}
+
+
+
+// Append the common features found by all threads at this iteration
+// to the checkpoint, then record the iteration as complete.
+void LowHash1::writeCheckpoint()
+{
+    SHASTA_ASSERT(checkpointIterationBegin.size() == iteration + 1);
+    for(const auto& v: threadCommonFeatures) {
+        const uint64_t oldSize = checkpointCommonFeatures.size();
+        checkpointCommonFeatures.resize(oldSize + v->size());
+        copy(v->begin(), v->end(), checkpointCommonFeatures.begin() + oldSize);
+        v->clear();
+    }
+    checkpointCommonFeatures.syncToDisk();
+    checkpointIterationBegin.push_back(checkpointCommonFeatures.size());
+    checkpointIterationBegin.syncToDisk();
+}
+
+
+
 // Add up the number of common feature found by all threads.
 uint64_t LowHash1::countTotalThreadCommonFeatures() const
 {
@@ -455,26 +696,149 @@ void LowHash1::gatherCommonFeatures()
     commonFeatures.createNew(
             largeDataFileNamePrefix.empty() ? "" : (largeDataFileNamePrefix + "tmp-CommonFeatures"),
             largeDataPageSize);
+
+    // Split the common features of each source into chunks.
+    gatherChunks.clear();
+    for(uint64_t sourceId=0; sourceId<gatherSources.size(); sourceId++) {
+        const uint64_t n = gatherSources[sourceId].second;
+        for(uint64_t begin=0; begin<n; begin+=gatherChunkSize) {
+            gatherChunks.push_back(make_pair(sourceId, begin));
+        }
+    }
+
     commonFeatures.beginPass1(kmerIds.size()/2);
+    setupLoadBalancing(gatherChunks.size(), 1);
     runThreads(&LowHash1::gatherCommonFeaturesPass1, threadCount);
     commonFeatures.beginPass2();
+    setupLoadBalancing(gatherChunks.size(), 1);
     runThreads(&LowHash1::gatherCommonFeaturesPass2, threadCount);
     commonFeatures.endPass2(false);
+    gatherChunks.clear();
 }
 void LowHash1::gatherCommonFeaturesPass1(size_t threadId)
 {
-    const MemoryMapped::Vector<CommonFeature>& v = *threadCommonFeatures[threadId];
-    for(const CommonFeature& commonFeature: v) {
-        commonFeatures.incrementCountMultithreaded(commonFeature.orientedReadPair.readIds[0]);
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t chunk=begin; chunk!=end; chunk++) {
+            const auto& source = gatherSources[gatherChunks[chunk].first];
+            const MemoryMapped::Vector<CommonFeature>& v = *source.first;
+            const uint64_t chunkBegin = gatherChunks[chunk].second;
+            const uint64_t chunkEnd = min(source.second, chunkBegin + gatherChunkSize);
+            for(uint64_t i=chunkBegin; i!=chunkEnd; i++) {
+                commonFeatures.incrementCountMultithreaded(v[i].orientedReadPair.readIds[0]);
+            }
+        }
     }
 }
 void LowHash1::gatherCommonFeaturesPass2(size_t threadId)
 {
-    const MemoryMapped::Vector<CommonFeature>& v = *threadCommonFeatures[threadId];
-    for(const CommonFeature& commonFeature: v) {
-        commonFeatures.storeMultithreaded(
-            commonFeature.orientedReadPair.readIds[0],
-            CommonFeatureInfo(commonFeature));
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t chunk=begin; chunk!=end; chunk++) {
+            const auto& source = gatherSources[gatherChunks[chunk].first];
+            const MemoryMapped::Vector<CommonFeature>& v = *source.first;
+            const uint64_t chunkBegin = gatherChunks[chunk].second;
+            const uint64_t chunkEnd = min(source.second, chunkBegin + gatherChunkSize);
+            for(uint64_t i=chunkBegin; i!=chunkEnd; i++) {
+                const CommonFeature& commonFeature = v[i];
+                commonFeatures.storeMultithreaded(
+                    commonFeature.orientedReadPair.readIds[0],
+                    CommonFeatureInfo(commonFeature));
+            }
+        }
+    }
+}
+
+
+
+// Memory used by the main data structures, in bytes.
+// For memory mapped data this uses sizes rather than capacities,
+// so it does not include rounding up to page boundaries.
+uint64_t LowHash1::computeMemoryBytes() const
+{
+    uint64_t n = 0;
+
+    if(kmerIds.isOpen()) {
+        n += (kmerIds.size() + 1) * sizeof(uint64_t) + kmerIds.totalSize() * sizeof(KmerId);
+    }
+    if(buckets.isOpen()) {
+        n += (buckets.size() + 1) * sizeof(uint64_t) + buckets.totalSize() * sizeof(BucketEntry);
+    }
+    if(commonFeatures.isOpen()) {
+        n += (commonFeatures.size() + 1) * sizeof(uint64_t) +
+            commonFeatures.totalSize() * sizeof(CommonFeatureInfo);
+    }
+
+    for(const auto& v: lowHashes) {
+        n += v.capacity() * sizeof(pair<uint64_t, uint32_t>);
+    }
+    for(const auto& w: allLowHashes) {
+        for(const auto& v: w) {
+            n += v.capacity() * sizeof(pair<uint64_t, uint32_t>);
+        }
+    }
+
+    for(const auto& v: threadCommonFeatures) {
+        if(v) {
+            n += v->size() * sizeof(CommonFeature);
+        }
+    }
+    if(checkpointCommonFeatures.isOpen) {
+        n += checkpointCommonFeatures.size() * sizeof(CommonFeature);
+    }
+
+    return n;
+}
+
+
+
+// Sort the common features of a readId0.
+// The LSD radix sort does one stable counting pass for each byte
+// of the key, from least to most significant, skipping bytes
+// that are the same for all features (typically the high bytes
+// of the ordinals and of readId1).
+void LowHash1::sortCommonFeatures(
+    span<CommonFeatureInfo> features,
+    vector<CommonFeatureInfo>& buffer)
+{
+    const uint64_t n = features.size();
+    if(n < radixSortThreshold) {
+        sort(features.begin(), features.end());
+        return;
+    }
+
+    buffer.resize(n);
+    CommonFeatureInfo* source = features.begin();
+    CommonFeatureInfo* destination = buffer.data();
+    array<uint64_t, 256> count;
+    for(uint64_t i=0; i<radixKeyByteCount; i++) {
+
+        // Count the occurrences of each value of this byte.
+        fill(count.begin(), count.end(), 0);
+        for(uint64_t j=0; j<n; j++) {
+            ++count[radixKeyByte(source[j], i)];
+        }
+
+        // If all features have the same value of this byte, skip it.
+        if(count[radixKeyByte(source[0], i)] == n) {
+            continue;
+        }
+
+        // Turn the counts into offsets and scatter.
+        uint64_t offset = 0;
+        for(uint64_t& c: count) {
+            const uint64_t c0 = c;
+            c = offset;
+            offset += c0;
+        }
+        for(uint64_t j=0; j<n; j++) {
+            destination[count[radixKeyByte(source[j], i)]++] = source[j];
+        }
+        swap(source, destination);
+    }
+
+    if(source != features.begin()) {
+        copy(source, source + n, features.begin());
     }
 }
 
@@ -581,6 +945,7 @@ void LowHash1::processCommonFeaturesThreadFunction(size_t threadId)
         (largeDataFileNamePrefix + "tmp-ThreadAlignmentCandidatesOrdinals-" + to_string(threadId)),
         largeDataPageSize);
     vector<uint64_t>& histogram = threadCandidateHistogram[threadId];
+    vector<CommonFeatureInfo> sortBuffer;
 
     // Loop over all batches assigned to this thread.
     uint64_t begin, end;
@@ -610,7 +975,7 @@ void LowHash1::processCommonFeaturesThreadFunction(size_t threadId)
             // Deduplicate.
             const auto uniqueBegin = features.begin();
             auto uniqueEnd = features.end();
-            sort(uniqueBegin, uniqueEnd);
+            sortCommonFeatures(features, sortBuffer);
             uniqueEnd = unique(uniqueBegin, uniqueEnd);
 
             /*
@@ -2,7 +2,9 @@
 #define SHASTA_LOW_HASH1_HPP
 
 // Shasta
+#include "hashFeatures.hpp"
 #include "Kmer.hpp"
+#include "MemoryMappedObject.hpp"
 #include "MemoryMappedVectorOfVectors.hpp"
 #include "MultithreadedObject.hpp"
 #include "OrientedReadPair.hpp"
@@ -35,8 +37,10 @@ public:
         size_t minBucketSize,           // The minimum size for a bucket to be used.
         size_t maxBucketSize,           // The maximum size for a bucket to be used.
         size_t minFrequency,            // Minimum number of minHash hits for a pair to be considered a candidate.
+        bool hashAllIterationsInOnePass,// Compute the low hashes for all iterations in a single pass.
+        const string& checkpointDirectory, // If not empty, store common features in a checkpoint there.
+        size_t k,                       // Marker length, only used to validate the checkpoint.
         size_t threadCount,
-        const MemoryMapped::Vector<KmerInfo>& kmerTable,
         const Reads& reads,
         const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>&,
         AlignmentCandidates& candidates,
@@ -48,12 +52,12 @@ private:
 
     // Store some of the arguments passed to the constructor.
     size_t m;                       // Number of consecutive markers that define a feature.
+    size_t k;                       // Marker length.
     double hashFraction;
     size_t minBucketSize;           // The minimum size for a bucket to be used.
     size_t maxBucketSize;           // The maximum size for a bucket to be used.
     size_t minFrequency;            // Minimum number of minHash hits for a pair to be considered a candidate.
     size_t threadCount;
-    const MemoryMapped::Vector<KmerInfo>& kmerTable;
     const Reads& reads;
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
     AlignmentCandidates& candidates;
@@ -68,6 +72,13 @@ private:
     void createKmerIds();
     void createKmerIds(size_t threadId);
 
+    // A checksum of the k-mer ids of the markers of all oriented reads,
+    // computed by createKmerIds and used to validate the checkpoint.
+    // It is the sum over oriented reads of the MurmurHash64A of their
+    // k-mer ids, using the OrientedReadId as the seed,
+    // so it does not depend on the order in which oriented reads are processed.
+    uint64_t markersChecksum;
+
     // The mask used to compute to compute the bucket
     // corresponding to a hash value.
     uint64_t mask;
@@ -79,13 +90,37 @@ private:
     // This is used to compute a different MurmurHash function
     // at each iteration.
     size_t iteration;
+    size_t minHashIterationCount;
+
+    // The seed of the MurmurHash function used at each iteration.
+    static uint64_t getSeed(size_t iteration)
+    {
+        return iteration * 37;
+    }
 
     // The low hashes of each oriented read and the ordinals at
     // which the corresponding feature occurs.
     // This is recomputed at each iteration.
     // Indexed by OrientedReadId::getValue().
     vector< vector< pair<uint64_t, uint32_t> > > lowHashes;
-    void computeLowHashes(size_t threadId);
+
+    // Compute the low hashes of an oriented read for one iteration,
+    // using a FeatureHasher already set up for the oriented read.
+    void computeLowHashes(
+        const FeatureHasher&,
+        size_t iteration,
+        vector<uint64_t>& hashes,
+        vector< pair<uint64_t, uint32_t> >& orientedReadLowHashes) const;
+
+    // If hashAllIterationsInOnePass is set, the low hashes for all iterations
+    // are computed up front, in a single pass over the kmerIds,
+    // so the mixing of the MurmurHash input blocks is shared by all iterations.
+    // At each iteration, the low hashes for that iteration are
+    // then moved to lowHashes.
+    // Indexed by [iteration][OrientedReadId::getValue()].
+    bool hashAllIterationsInOnePass;
+    vector< vector< vector< pair<uint64_t, uint32_t> > > > allLowHashes;
+    void computeAllLowHashesThreadFunction(size_t threadId);
 
     // Each bucket entry describes a low hash feature.
     // It consists of an oriented read id and
@@ -147,6 +182,64 @@ private:
 
 
 
+    // Checkpoint support.
+    // If checkpointDirectory is not empty, at the end of each iteration
+    // the common features found by all threads are appended
+    // to a checkpoint stored in files in that directory,
+    // which are not removed at the end.
+    // The checkpoint also records the parameters that affect
+    // the common features found at each iteration,
+    // plus k and a checksum of the markers.
+    // When LowHash1 runs again with the same parameters and checkpointDirectory,
+    // possibly in a different assembly directory,
+    // the iterations already in the checkpoint are not repeated.
+    // This can be used to resume after a failure, or to add iterations
+    // to an existing run.
+    // Because the seed of each iteration only depends on the iteration number,
+    // the result is the same as for a run without a checkpoint.
+    class CheckpointInfo {
+    public:
+        uint64_t m;
+        double hashFraction;
+        uint64_t log2MinHashBucketCount;
+        uint64_t minBucketSize;
+        uint64_t maxBucketSize;
+        uint64_t orientedReadCount;
+        uint64_t markerCount;
+        uint64_t k;
+        uint64_t markersChecksum;
+    };
+    string checkpointDirectory;
+    bool useCheckpoint() const
+    {
+        return not checkpointDirectory.empty();
+    }
+    MemoryMapped::Object<CheckpointInfo> checkpointInfo;
+
+    // The common features of all iterations in the checkpoint.
+    MemoryMapped::Vector<CommonFeature> checkpointCommonFeatures;
+
+    // The common features of iteration i are in
+    // checkpointCommonFeatures[checkpointIterationBegin[i]] through
+    // checkpointCommonFeatures[checkpointIterationBegin[i+1]-1].
+    // So the number of iterations in the checkpoint is
+    // checkpointIterationBegin.size()-1.
+    // This is updated after the common features of an iteration are stored,
+    // so an interrupted iteration is ignored.
+    MemoryMapped::Vector<uint64_t> checkpointIterationBegin;
+
+    // Open an existing checkpoint or create a new one.
+    // Returns the number of iterations that don't need to be computed.
+    size_t openCheckpoint(uint64_t log2MinHashBucketCount);
+    void writeCheckpoint();
+    bool checkpointMatches(const CheckpointInfo&) const;
+    CheckpointInfo getCheckpointInfo(uint64_t log2MinHashBucketCount) const;
+
+    // The first iteration that needs to be computed.
+    size_t firstIteration;
+
+
+
     // The common features found by each thread are stored together,
     // segregated by the first ReadId, readId0.
     // This vector of vectors is indexed by readId0.
@@ -171,9 +264,18 @@ private:
         }
     };
     MemoryMapped::VectorOfVectors<CommonFeatureInfo, uint64_t> commonFeatures;
+    // To balance the load, the vectors of common features found by each thread
+    // are processed in chunks of gatherChunkSize common features.
+    // The chunk table contains (thread, begin) for each chunk.
     void gatherCommonFeatures();
     void gatherCommonFeaturesPass1(size_t threadId);
     void gatherCommonFeaturesPass2(size_t threadId);
+    static const uint64_t gatherChunkSize = 1024 * 1024;
+    vector< pair<uint64_t, uint64_t> > gatherChunks;
+
+    // The vectors of common features to be gathered and,
+    // for each of them, the number of common features to use.
+    vector< pair<const MemoryMapped::Vector<CommonFeature>*, uint64_t> > gatherSources;
 
 
 
@@ -216,6 +318,53 @@ private:
 
     // Thread function to scan the buckets to find common features.
     void scanBucketsThreadFunction(size_t threadId);
+
+    // Information about a bucket entry, gathered once per bucket
+    // before looping over pairs of entries, so the inner loop
+    // does not have to go back to kmerIds.
+    class BucketEntryInfo {
+    public:
+        ReadId readId;
+        Strand strand;
+        uint32_t ordinal;
+        uint32_t markerCount;
+        const KmerId* featureKmerIds;
+    };
+
+
+
+    // Sort the common features of a readId0 in the order
+    // defined by CommonFeatureInfo::operator<.
+    // Short ranges use std::sort. Longer ranges use an LSD radix sort
+    // on the bytes of the sort key, using the buffer as scratch space.
+    static void sortCommonFeatures(
+        span<CommonFeatureInfo>,
+        vector<CommonFeatureInfo>& buffer);
+    static const uint64_t radixSortThreshold = 256;
+
+    // Return byte i of the radix sort key of a CommonFeatureInfo.
+    // Byte 0 is the least significant.
+    static const uint64_t radixKeyByteCount = 13;
+    static uint64_t radixKeyByte(const CommonFeatureInfo& feature, uint64_t i)
+    {
+        if(i < 4) {
+            return (feature.ordinals[1] >> (8 * i)) & 0xff;
+        } else if(i < 8) {
+            return (feature.ordinals[0] >> (8 * (i - 4))) & 0xff;
+        } else if(i == 8) {
+            return feature.isSameStrand ? 1 : 0;
+        } else {
+            return (feature.readId1 >> (8 * (i - 9))) & 0xff;
+        }
+    }
+
+
+
+    // Memory used by the main data structures, in bytes.
+    // The maximum value of this at each iteration is
+    // written out to help with memory planning.
+    uint64_t computeMemoryBytes() const;
+    uint64_t peakMemoryBytes;
 };
 
 #endif
@@ -16,6 +16,12 @@ Because of the way markers are selected, the following is
 true for all permitted values of i, 0 <= i < 4^k:
 kmerTable[i].isMarker == kmerTable[kmerTable[i].reverseComplementKmerId].isMarker
 
+Optionally, the dense k-mer table can be replaced by a sparse k-mer table
+that only stores the marker k-mers. See SparseKmerTable.hpp.
+In that case, the KmerId of a marker is the index of its k-mer
+in the sparse k-mer table, and Assembler::getKmer
+must be used to obtain the k-mer.
+
 *******************************************************************************/
 
 #include "Kmer.hpp"
@@ -1,8 +1,10 @@
 // shasta.
 #include "MarkerFinder.hpp"
+#include "extractKmerIds.hpp"
 #include "LongBaseSequence.hpp"
 #include "performanceLog.hpp"
 #include "ReadId.hpp"
+#include "SparseKmerTable.hpp"
 #include "timestamp.hpp"
 using namespace shasta;
 
@@ -14,15 +16,18 @@ using namespace shasta;
 MarkerFinder::MarkerFinder(
     size_t k,
     const MemoryMapped::Vector<KmerInfo>& kmerTable,
+    const SparseKmerTable& sparseKmerTable,
     const Reads& reads,
     MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
     size_t threadCountArgument) :
     MultithreadedObject(*this),
     k(k),
     kmerTable(kmerTable),
+    sparseKmerTable(sparseKmerTable),
     reads(reads),
     markers(markers),
-    threadCount(threadCountArgument)
+    threadCount(threadCountArgument),
+    useSparseKmerTable(sparseKmerTable.isOpen())
 {
     // Initial message.
     performanceLog << timestamp << "Finding markers in " << reads.readCount() << " reads." << endl;
@@ -33,16 +38,41 @@ MarkerFinder::MarkerFinder(
         threadCount = std::thread::hardware_concurrency();
     }
 
+    // Create the marker bitmap.
+    // This is not needed when using the sparse k-mer table,
+    // which is queried directly.
+    if(not useSparseKmerTable) {
+        const uint64_t kmerCount = 1ULL << (2ULL * k);
+        markerBitmap.resize((kmerCount + 63) / 64, 0ULL);
+        setupLoadBalancing(markerBitmap.size(), 1024);
+        runThreads(&MarkerFinder::fillMarkerBitmapThreadFunction, threadCount);
+    }
+
+    // Find the markers on strand 0 of each read,
+    // storing them in per-batch buffers.
     const size_t batchSize = 100;
-    markers.beginPass1(2 * reads.readCount());
+    batches.clear();
     setupLoadBalancing(reads.readCount(), batchSize);
-    pass = 1;
-    runThreads(&MarkerFinder::threadFunction, threadCount);
+    runThreads(&MarkerFinder::findMarkersThreadFunction, threadCount);
+
+    // Now that we know the number of markers in each read,
+    // we can allocate space for all markers.
+    markers.beginPass1(2 * reads.readCount());
+    for(const Batch& batch: batches) {
+        for(ReadId readId=batch.readBegin; readId!=batch.readEnd; readId++) {
+            const uint64_t markerCount = batch.markerCount[readId - batch.readBegin];
+            markers.incrementCount(OrientedReadId(readId, 0).getValue(), markerCount);
+            markers.incrementCount(OrientedReadId(readId, 1).getValue(), markerCount);
+        }
+    }
     markers.beginPass2();
     markers.endPass2(false);
-    setupLoadBalancing(reads.readCount(), batchSize);
-    pass = 2;
-    runThreads(&MarkerFinder::threadFunction, threadCount);
+
+    // Copy the markers from the batch buffers, on both strands.
+    setupLoadBalancing(batches.size(), 1);
+    runThreads(&MarkerFinder::storeMarkersThreadFunction, threadCount);
+    batches.clear();
+    batches.shrink_to_fit();
 
     markers.unreserve();
     // Final message.
@@ -53,73 +83,147 @@ MarkerFinder::MarkerFinder(
 
 
 
-void MarkerFinder::threadFunction(size_t threadId)
+// Each thread fills entire words of the bitmap,
+// so no synchronization is needed.
+void MarkerFinder::fillMarkerBitmapThreadFunction(size_t threadId)
 {
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t wordIndex=begin; wordIndex!=end; wordIndex++) {
+            uint64_t word = 0;
+            const uint64_t kmerIdBegin = wordIndex << 6;
+            const uint64_t kmerIdEnd = min(kmerIdBegin + 64, uint64_t(kmerTable.size()));
+            for(uint64_t kmerId=kmerIdBegin; kmerId!=kmerIdEnd; kmerId++) {
+                if(kmerTable[kmerId].isMarker) {
+                    word |= (1ULL << (kmerId & 63));
+                }
+            }
+            markerBitmap[wordIndex] = word;
+        }
+    }
+}
+
+
+
+// Find markers on strand 0 of each read in the batches
+// assigned to this thread.
+void MarkerFinder::findMarkersThreadFunction(size_t threadId)
+{
+    // Vectors to contain the KmerIds of a read
+    // and of their reverse complements.
+    // When using the sparse k-mer table, we use KmerId64 instead.
+    vector<KmerId> kmerIds;
+    vector<KmerId> reverseComplementedKmerIds;
+    vector<KmerId64> kmerIds64;
+    vector<KmerId64> reverseComplementedKmerIds64;
+
+    // The batches processed by this thread.
+    vector<Batch> threadBatches;
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
+        threadBatches.resize(threadBatches.size() + 1);
+        Batch& batch = threadBatches.back();
+        batch.readBegin = ReadId(begin);
+        batch.readEnd = ReadId(end);
+        batch.markerCount.reserve(end - begin);
 
         // Loop over reads of this batch.
         for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
-
             const LongBaseSequenceView read = reads.getRead(readId);
-            size_t markerCount = 0; // For this read.
-            CompressedMarker* markerPointerStrand0 = 0;
-            CompressedMarker* markerPointerStrand1 = 0;
-            if(pass == 2) {
-                markerPointerStrand0 = markers.begin(OrientedReadId(readId, 0).getValue());
-                markerPointerStrand1 = markers.end(OrientedReadId(readId, 1).getValue()) - 1ULL;
-            }
 
-            if(read.baseCount >= k) {   // Avoid pathological case.
+            // When using the sparse k-mer table, the KmerId of a marker
+            // is the index of its k-mer in the table.
+            if(useSparseKmerTable) {
+                extractKmerIds(read, k, kmerIds64, reverseComplementedKmerIds64);
+                uint32_t markerCount = 0;
+                for(uint32_t position=0; position<uint32_t(kmerIds64.size()); position++) {
+                    const uint64_t index = sparseKmerTable.find(kmerIds64[position]);
+                    if(index != SparseKmerTable::invalidIndex) {
+                        const uint64_t reverseComplementedIndex =
+                            sparseKmerTable.find(reverseComplementedKmerIds64[position]);
+                        SHASTA_ASSERT(reverseComplementedIndex != SparseKmerTable::invalidIndex);
+                        CompressedMarker marker;
+                        marker.kmerId = KmerId(index);
+                        marker.position = position;
+                        batch.markers.push_back(marker);
+                        batch.reverseComplementedKmerIds.push_back(KmerId(reverseComplementedIndex));
+                        ++markerCount;
+                    }
+                }
+                batch.markerCount.push_back(markerCount);
+                continue;
+            }
 
-                // Loop over k-mers of this read.
-                Kmer kmer;
-                for(size_t position=0; position<k; position++) {
-                    kmer.set(position, read[position]);
+            // Compute the KmerIds of all k-mers of this read.
+            extractKmerIds(read, k, kmerIds, reverseComplementedKmerIds);
+
+            // Loop over k-mers of this read.
+            uint32_t markerCount = 0;
+            for(uint32_t position=0; position<uint32_t(kmerIds.size()); position++) {
+                const KmerId kmerId = kmerIds[position];
+                if(isMarker(kmerId)) {
+                    // This k-mer is a marker.
+                    CompressedMarker marker;
+                    marker.kmerId = kmerId;
+                    marker.position = position;
+                    batch.markers.push_back(marker);
+                    batch.reverseComplementedKmerIds.push_back(reverseComplementedKmerIds[position]);
+                    ++markerCount;
                 }
-                for(uint32_t position=0; /*The check is done later */; position++) {
-                    const KmerId kmerId = KmerId(kmer.id(k));
-                    if(kmerTable[kmerId].isMarker) {
-                        // This k-mer is a marker.
-
-                        if(pass == 1) {
-                            ++markerCount;
-                        } else {
-                            // Strand 0.
-                            markerPointerStrand0->kmerId = kmerId;
-                            markerPointerStrand0->position = position;
-                            ++markerPointerStrand0;
-
-                            // Strand 1.
-                            markerPointerStrand1->kmerId = kmerTable[kmerId].reverseComplementedKmerId;
-                            markerPointerStrand1->position = uint32_t(read.baseCount - k - position);
-                            --markerPointerStrand1;
-
-                        }
-                    }
+            }
+            batch.markerCount.push_back(markerCount);
+        }
+    }
+
+    // Make our batches available to the other threads.
+    std::lock_guard<std::mutex> lock(mutex);
+    for(Batch& batch: threadBatches) {
+        batches.push_back(std::move(batch));
+    }
+}
 
-                    if(position+k == read.baseCount) {
-                        break;
-                    }
 
-                    // Update the k-mer.
-                    kmer.shiftLeft();
-                    kmer.set(k-1, read[position+k]);
+
+// Copy markers from the batch buffers to their final location,
+// on both strands. Each batch buffer is freed after being copied.
+void MarkerFinder::storeMarkersThreadFunction(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t batchIndex=begin; batchIndex!=end; batchIndex++) {
+            Batch& batch = batches[batchIndex];
+
+            const CompressedMarker* batchMarkerPointer = batch.markers.data();
+            const KmerId* batchReverseComplementedKmerIdPointer = batch.reverseComplementedKmerIds.data();
+            for(ReadId readId=batch.readBegin; readId!=batch.readEnd; readId++) {
+                const uint64_t markerCount = batch.markerCount[readId - batch.readBegin];
+                const uint64_t baseCount = reads.getRead(readId).baseCount;
+                CompressedMarker* markerPointerStrand0 = markers.begin(OrientedReadId(readId, 0).getValue());
+                CompressedMarker* markerPointerStrand1 = markers.end(OrientedReadId(readId, 1).getValue()) - 1ULL;
+
+                for(uint64_t i=0; i<markerCount; i++) {
+                    const CompressedMarker& marker = *batchMarkerPointer++;
+                    const KmerId reverseComplementedKmerId = *batchReverseComplementedKmerIdPointer++;
+
+                    // Strand 0.
+                    *markerPointerStrand0++ = marker;
+
+                    // Strand 1.
+                    markerPointerStrand1->kmerId = reverseComplementedKmerId;
+                    markerPointerStrand1->position = uint32_t(baseCount - k - marker.position);
+                    --markerPointerStrand1;
                 }
-            }
 
-            if(pass == 1) {
-                markers.incrementCount(OrientedReadId(readId, 0).getValue(), markerCount);
-                markers.incrementCount(OrientedReadId(readId, 1).getValue(), markerCount);
-            } else {
                 SHASTA_ASSERT(markerPointerStrand0 ==
                     markers.end(OrientedReadId(readId, 0).getValue()));
                 SHASTA_ASSERT(markerPointerStrand1 ==
                     markers.begin(OrientedReadId(readId, 1).getValue()) - 1ULL);
             }
+
+            // Free the memory of this batch.
+            batch = Batch();
         }
     }
-
 }
@@ -8,6 +8,7 @@
 namespace shasta {
     class MarkerFinder;
     class LongBaseSequences;
+    class SparseKmerTable;
 
     namespace MemoryMapped {
         template<class T> class Vector;
@@ -22,9 +23,12 @@ class shasta::MarkerFinder :
 public:
 
     // The constructor does all the work.
+    // If the sparse k-mer table is open, it is used
+    // instead of the dense k-mer table.
     MarkerFinder(
         size_t k,
         const MemoryMapped::Vector<KmerInfo>& kmerTable,
+        const SparseKmerTable& sparseKmerTable,
         const Reads& reads,
         MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
         size_t threadCount);
@@ -34,16 +38,45 @@ private:
     // The arguments passed to the constructor.
     size_t k;
     const MemoryMapped::Vector<KmerInfo>& kmerTable;
+    const SparseKmerTable& sparseKmerTable;
     const Reads& reads;
     MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
     size_t threadCount;
 
-    void threadFunction(size_t threadId);
+    bool useSparseKmerTable;
 
-    // In pass 1, we count the number of markers for each
-    // read and call reads->incrementCountMultithreaded.
-    // In pass 2, we store the markers.
-    size_t pass;
+    // Bitmap of 4^k bits, with the bit for each KmerId set if
+    // the k-mer is a marker. This is much more compact than the
+    // k-mer table and used for fast membership tests.
+    // It is not used with the sparse k-mer table.
+    vector<uint64_t> markerBitmap;
+    void fillMarkerBitmapThreadFunction(size_t threadId);
+    bool isMarker(KmerId kmerId) const
+    {
+        return (markerBitmap[kmerId >> 6] >> (kmerId & 63)) & 1ULL;
+    }
+
+    // Markers are found in a single pass over the reads.
+    // Each thread stores the markers it finds, on strand 0 only,
+    // in a buffer for each batch of reads it processes.
+    // When all markers are found, space for them is allocated
+    // and they are copied from the batch buffers, on both strands.
+    class Batch {
+    public:
+        ReadId readBegin;
+        ReadId readEnd;
+
+        // The number of markers in each read of the batch.
+        vector<uint32_t> markerCount;
+
+        // The markers on strand 0 of all reads in the batch
+        // and the KmerIds of their reverse complements.
+        vector<CompressedMarker> markers;
+        vector<KmerId> reverseComplementedKmerIds;
+    };
+    vector<Batch> batches;
+    void findMarkersThreadFunction(size_t threadId);
+    void storeMarkersThreadFunction(size_t threadId);
 
 };
 
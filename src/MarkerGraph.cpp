@@ -39,6 +39,12 @@ void MarkerGraph::remove()
     if(edgesByTarget.isOpen()) {
         edgesByTarget.remove();
     }
+    if(outNeighbors.isOpen()) {
+        outNeighbors.remove();
+    }
+    if(inNeighbors.isOpen()) {
+        inNeighbors.remove();
+    }
     if(vertexRepeatCounts.isOpen) {
         vertexRepeatCounts.remove();
     }
@@ -62,6 +68,18 @@ void MarkerGraph::remove()
 const MarkerGraph::Edge*
     MarkerGraph::findEdge(Uint40 source, Uint40 target) const
 {
+    if(outNeighbors.isOpen()) {
+        const span<const Neighbor> neighbors = outNeighbors[source];
+        Neighbor neighbor;
+        neighbor.vertexId = target;
+        neighbor.edgeId = 0;
+        const auto it = std::lower_bound(neighbors.begin(), neighbors.end(), neighbor);
+        if(it != neighbors.end() and it->vertexId == target) {
+            return &edges[it->edgeId];
+        }
+        return 0;
+    }
+
     const auto edgesWithThisSource = edgesBySource[source];
     for(const uint64_t i: edgesWithThisSource) {
         const Edge& edge = edges[i];
@@ -80,6 +98,43 @@ MarkerGraph::EdgeId MarkerGraph::findEdgeId(Uint40 source, Uint40 target) const
     return edgePointer - edges.begin();
 }
 
+span<const MarkerGraph::Neighbor> MarkerGraph::getOutNeighbors(
+    VertexId vertexId,
+    vector<Neighbor>& buffer) const
+{
+    if(outNeighbors.isOpen()) {
+        return outNeighbors[vertexId];
+    }
+    buffer.clear();
+    for(const EdgeId edgeId: edgesBySource[vertexId]) {
+        Neighbor neighbor;
+        neighbor.vertexId = edges[edgeId].target;
+        neighbor.edgeId = edgeId;
+        buffer.push_back(neighbor);
+    }
+    sort(buffer.begin(), buffer.end());
+    return span<const Neighbor>(buffer.data(), buffer.data() + buffer.size());
+}
+span<const MarkerGraph::Neighbor> MarkerGraph::getInNeighbors(
+    VertexId vertexId,
+    vector<Neighbor>& buffer) const
+{
+    if(inNeighbors.isOpen()) {
+        return inNeighbors[vertexId];
+    }
+    buffer.clear();
+    for(const EdgeId edgeId: edgesByTarget[vertexId]) {
+        Neighbor neighbor;
+        neighbor.vertexId = edges[edgeId].source;
+        neighbor.edgeId = edgeId;
+        buffer.push_back(neighbor);
+    }
+    sort(buffer.begin(), buffer.end());
+    return span<const Neighbor>(buffer.data(), buffer.data() + buffer.size());
+}
+
+
+
 // Compute in-degree or out-degree of a vertex,
 // counting only edges that were not removed.
 uint64_t MarkerGraph::inDegree(VertexId vertexId) const
@@ -191,6 +246,12 @@ void MarkerGraph::removeVertices(
     if(edgesByTarget.isOpen()) {
         edgesByTarget.remove();
     }
+    if(outNeighbors.isOpen()) {
+        outNeighbors.remove();
+    }
+    if(inNeighbors.isOpen()) {
+        inNeighbors.remove();
+    }
     if(reverseComplementEdge.isOpen) {
         reverseComplementEdge.remove();
     }
@@ -242,6 +242,9 @@ public:
         }
     };
     MemoryMapped::Vector<Edge> edges;
+
+    // Locate the edge given the vertices.
+    // This uses a binary search in outNeighbors, if available.
     const Edge* findEdge(Uint40 source, Uint40 target) const;
     EdgeId findEdgeId(Uint40 source, Uint40 target) const;
 
@@ -256,6 +259,36 @@ public:
     // Contains indexes into the above edges vector.
     MemoryMapped::VectorOfVectors<Uint40, uint64_t> edgesByTarget;
 
+    // Read-only compressed sparse row representation of the marker graph.
+    // For each vertex, outNeighbors has one entry for each edge that
+    // the vertex is the source of, storing the target vertex next to the edge id,
+    // so the neighbors of a vertex can be visited without accessing the edges.
+    // Similarly, inNeighbors has one entry for each edge that the vertex
+    // is the target of, storing the source vertex.
+    // For each vertex, the entries are sorted by vertex id, then by edge id.
+    // These are created together with edgesBySource and edgesByTarget,
+    // and don't depend on the flags of the edges.
+    class Neighbor {
+    public:
+        Uint40 vertexId;
+        Uint40 edgeId;
+        bool operator<(const Neighbor& that) const
+        {
+            return
+                (vertexId < that.vertexId) or
+                ((vertexId == that.vertexId) and (edgeId < that.edgeId));
+        }
+    };
+    MemoryMapped::VectorOfVectors<Neighbor, uint64_t> outNeighbors;
+    MemoryMapped::VectorOfVectors<Neighbor, uint64_t> inNeighbors;
+
+    // Return the outNeighbors or inNeighbors of a vertex.
+    // If they are not available (for example, for an assembly
+    // created by an older version), they are computed from the edges
+    // and stored in the buffer, which is only used in that case.
+    span<const Neighbor> getOutNeighbors(VertexId, vector<Neighbor>& buffer) const;
+    span<const Neighbor> getInNeighbors(VertexId, vector<Neighbor>& buffer) const;
+
     // Compute in-degree or out-degree of a vertex,
     // counting only edges that were not removed.
     uint64_t inDegree(VertexId) const;
@@ -0,0 +1,310 @@
+// Shasta.
+#include "ParallelTextWriter.hpp"
+#include "SHASTA_ASSERT.hpp"
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "stdexcept.hpp"
+#include <thread>
+
+// Zlib.
+#include <zlib.h>
+
+
+
+ParallelTextWriter::ParallelTextWriter(
+    const string& fileName,
+    bool bgzip) :
+    MultithreadedObject<ParallelTextWriter>(*this),
+    fileName(fileName),
+    bgzip(bgzip),
+    file(fileName, std::ios::binary)
+{
+    if(not file) {
+        throw runtime_error("Error opening " + fileName);
+    }
+}
+
+
+
+ParallelTextWriter::~ParallelTextWriter()
+{
+    try {
+        close();
+    } catch(...) {
+    }
+}
+
+
+
+void ParallelTextWriter::write(const string& text)
+{
+    SHASTA_ASSERT(not isClosed);
+    pendingText += text;
+    if(pendingText.size() >= chunkSize) {
+        flushPendingText();
+    }
+}
+
+
+
+void ParallelTextWriter::flushPendingText()
+{
+    if(pendingText.empty()) {
+        return;
+    }
+    if(bgzip) {
+        string compressedText;
+        bgzipCompress(pendingText.data(), pendingText.size(), compressedText);
+        writeToFile(compressedText);
+    } else {
+        writeToFile(pendingText);
+    }
+    pendingText.clear();
+}
+
+
+
+void ParallelTextWriter::writeToFile(const string& data)
+{
+    file.write(data.data(), std::streamsize(data.size()));
+    if(not file) {
+        throw runtime_error("Error writing " + fileName);
+    }
+}
+
+
+
+void ParallelTextWriter::close()
+{
+    if(isClosed) {
+        return;
+    }
+    isClosed = true;
+
+    flushPendingText();
+    if(bgzip) {
+        string endOfFile;
+        bgzipAppendEndOfFile(endOfFile);
+        writeToFile(endOfFile);
+    }
+    file.close();
+    if(not file) {
+        throw runtime_error("Error closing " + fileName);
+    }
+}
+
+
+
+void ParallelTextWriter::writeItems(
+    uint64_t itemCount,
+    const std::function<uint64_t(uint64_t itemId)>& itemSize,
+    const std::function<void(uint64_t itemId, string& text)>& formatItem,
+    size_t threadCount)
+{
+    SHASTA_ASSERT(not isClosed);
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Text written by write must go first.
+    flushPendingText();
+
+    // Create the chunks.
+    WriteItemsData& data = writeItemsData;
+    data.formatItem = &formatItem;
+    data.chunks.clear();
+    uint64_t chunkBegin = 0;
+    uint64_t currentChunkSize = 0;
+    for(uint64_t itemId=0; itemId<itemCount; itemId++) {
+        currentChunkSize += itemSize(itemId);
+        if(currentChunkSize >= chunkSize) {
+            data.chunks.push_back(make_pair(chunkBegin, itemId + 1));
+            chunkBegin = itemId + 1;
+            currentChunkSize = 0;
+        }
+    }
+    if(chunkBegin != itemCount) {
+        data.chunks.push_back(make_pair(chunkBegin, itemCount));
+    }
+
+    // Each round formats up to this number of chunks.
+    // This bounds memory usage to about 2 * roundChunkCount * chunkSize,
+    // because the previous round is written while the next one is formatted.
+    const uint64_t roundChunkCount = max(uint64_t(threadCount), uint64_t(16));
+
+    // Loop over rounds.
+    bool previousRoundExists = false;
+    for(data.roundBegin=0; data.roundBegin<data.chunks.size(); data.roundBegin+=roundChunkCount) {
+        const uint64_t roundEnd = min(uint64_t(data.chunks.size()), data.roundBegin + roundChunkCount);
+        const uint64_t chunkCount = roundEnd - data.roundBegin;
+
+        // Start formatting this round.
+        vector<string>& output = data.output[data.outputIndex];
+        output.resize(chunkCount);
+        setupLoadBalancing(chunkCount, 1);
+        startThreads(&ParallelTextWriter::writeItemsThreadFunction, min(uint64_t(threadCount), chunkCount));
+
+        // While that happens, write the previous round.
+        // If writing fails, the threads must still be joined
+        // before the exception propagates, otherwise
+        // std::thread destructors would call std::terminate.
+        if(previousRoundExists) {
+            try {
+                for(const string& text: data.output[1 - data.outputIndex]) {
+                    writeToFile(text);
+                }
+            } catch(...) {
+                try {
+                    waitForThreads();
+                } catch(...) {
+                }
+                throw;
+            }
+        }
+        waitForThreads();
+
+        previousRoundExists = true;
+        data.outputIndex = 1 - data.outputIndex;
+    }
+
+    // Write the last round.
+    if(previousRoundExists) {
+        for(const string& text: data.output[1 - data.outputIndex]) {
+            writeToFile(text);
+        }
+    }
+
+    // Free the buffers.
+    data.output[0].clear();
+    data.output[1].clear();
+    data.chunks.clear();
+    data.formatItem = 0;
+}
+
+
+
+void ParallelTextWriter::writeItemsThreadFunction(size_t /* threadId */)
+{
+    WriteItemsData& data = writeItemsData;
+    const std::function<void(uint64_t, string&)>& formatItem = *data.formatItem;
+    vector<string>& output = data.output[data.outputIndex];
+
+    string text;
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const pair<uint64_t, uint64_t>& chunk = data.chunks[data.roundBegin + i];
+
+            string& chunkOutput = output[i];
+            string& chunkText = bgzip ? text : chunkOutput;
+            chunkText.clear();
+            for(uint64_t itemId=chunk.first; itemId!=chunk.second; itemId++) {
+                formatItem(itemId, chunkText);
+            }
+            if(bgzip) {
+                chunkOutput.clear();
+                bgzipCompress(text.data(), text.size(), chunkOutput);
+            }
+        }
+    }
+}
+
+
+
+// BGZF format, as described in the SAM/BAM specification.
+// Each BGZF block is a gzip member with an extra field "BC"
+// that contains the total size of the block minus 1.
+// Blocks contain at most 64 KB of compressed data.
+// To guarantee that, we use the same maximum amount of uncompressed
+// data per block used by bgzip.
+void shasta::bgzipCompress(const char* data, uint64_t size, string& output)
+{
+    const uint64_t maxBlockInputSize = 0xff00;
+    const uint64_t headerSize = 18;
+    const uint64_t footerSize = 8;
+    const uint64_t maxBlockSize = 0x10000;
+
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+
+    // Negative window bits = raw deflate, without zlib or gzip header.
+    // The gzip header and footer are written explicitly below.
+    if(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw runtime_error("Error initializing zlib.");
+    }
+
+    try {
+        for(uint64_t blockBegin=0; blockBegin<size; blockBegin+=maxBlockInputSize) {
+            const uint64_t blockInputSize = min(maxBlockInputSize, size - blockBegin);
+
+            // Make space for the largest possible block.
+            const uint64_t blockBegin0 = output.size();
+            output.resize(blockBegin0 + maxBlockSize);
+            unsigned char* block = reinterpret_cast<unsigned char*>(output.data() + blockBegin0);
+
+            // Compress.
+            if(deflateReset(&stream) != Z_OK) {
+                throw runtime_error("Error resetting zlib.");
+            }
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + blockBegin));
+            stream.avail_in = uInt(blockInputSize);
+            stream.next_out = block + headerSize;
+            stream.avail_out = uInt(maxBlockSize - headerSize - footerSize);
+            if(deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+                throw runtime_error("Error compressing BGZF block.");
+            }
+            const uint64_t compressedSize = maxBlockSize - headerSize - footerSize - stream.avail_out;
+            const uint64_t blockSize = headerSize + compressedSize + footerSize;
+
+            // Header.
+            const unsigned char header[headerSize] = {
+                31, 139,    // gzip magic
+                8,          // CM = deflate
+                4,          // FLG = FEXTRA
+                0, 0, 0, 0, // MTIME
+                0,          // XFL
+                255,        // OS = unknown
+                6, 0,       // XLEN
+                'B', 'C',   // Subfield identifier
+                2, 0,       // Subfield length
+                (unsigned char)((blockSize - 1) & 0xff),
+                (unsigned char)((blockSize - 1) >> 8)
+            };
+            std::copy(header, header + headerSize, block);
+
+            // Footer: CRC32 and uncompressed size, little endian.
+            const uint32_t crc = uint32_t(crc32(crc32(0L, Z_NULL, 0),
+                reinterpret_cast<const Bytef*>(data + blockBegin), uInt(blockInputSize)));
+            unsigned char* footer = block + headerSize + compressedSize;
+            for(uint64_t i=0; i<4; i++) {
+                footer[i] = (unsigned char)((crc >> (8 * i)) & 0xff);
+                footer[4 + i] = (unsigned char)((blockInputSize >> (8 * i)) & 0xff);
+            }
+
+            output.resize(blockBegin0 + blockSize);
+        }
+
+    } catch(...) {
+        deflateEnd(&stream);
+        throw;
+    }
+
+    deflateEnd(&stream);
+}
+
+
+
+void shasta::bgzipAppendEndOfFile(string& output)
+{
+    static const unsigned char endOfFile[28] = {
+        31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0,
+        27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    output.append(reinterpret_cast<const char*>(endOfFile), 28);
+}
@@ -0,0 +1,136 @@
+#ifndef SHASTA_PARALLEL_TEXT_WRITER_HPP
+#define SHASTA_PARALLEL_TEXT_WRITER_HPP
+
+/*******************************************************************************
+
+Class ParallelTextWriter writes a large text file whose contents
+consist of a sequence of items (for example, one line for each
+assembled segment) that can be formatted independently of each other.
+
+The items are grouped in chunks of roughly chunkSize bytes.
+Chunks are formatted in parallel into per-chunk buffers,
+and written to the file in order, one large block at a time.
+Chunks are processed in rounds of a bounded number of chunks,
+so memory usage is bounded regardless of the size of the output.
+While one round is being formatted, the previous one is written.
+
+If requested, the output is compressed in the BGZF format used by bgzip
+(a sequence of gzip members, each containing at most 64 KB).
+The compression is done by the same threads that format the chunks.
+The resulting file can be read by gzip, zcat, and by tools
+that use random access to bgzip-compressed files.
+
+Usage pattern:
+
+ParallelTextWriter writer(fileName, bgzip);
+writer.write("Header\n");
+writer.writeItems(itemCount, itemSize, formatItem, threadCount);
+writer.close();
+
+*******************************************************************************/
+
+// Shasta.
+#include "MultithreadedObject.hpp"
+
+// Standard library.
+#include "cstdint.hpp"
+#include "fstream.hpp"
+#include <functional>
+#include "string.hpp"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace shasta {
+    class ParallelTextWriter;
+
+    // Append to the output string the BGZF compressed version
+    // of the given data, as a sequence of complete BGZF blocks.
+    void bgzipCompress(const char* data, uint64_t size, string& output);
+
+    // Append to the output string the empty BGZF block
+    // that marks the end of a bgzip-compressed file.
+    void bgzipAppendEndOfFile(string& output);
+}
+
+
+
+class shasta::ParallelTextWriter :
+    public MultithreadedObject<ParallelTextWriter> {
+public:
+
+    // The constructor opens the file.
+    ParallelTextWriter(const string& fileName, bool bgzip);
+
+    // The destructor calls close if it was not called,
+    // without reporting errors.
+    ~ParallelTextWriter();
+
+    ParallelTextWriter(const ParallelTextWriter&) = delete;
+    ParallelTextWriter& operator=(const ParallelTextWriter&) = delete;
+
+    // Append text that does not need parallel formatting.
+    // It is buffered and written (and compressed if requested)
+    // in blocks of chunkSize bytes.
+    void write(const string&);
+    ParallelTextWriter& operator<<(const string& s)
+    {
+        write(s);
+        return *this;
+    }
+
+    // Write the text for items in [0, itemCount), in order.
+    // formatItem(itemId, text) appends the text for an item to text.
+    // itemSize(itemId) returns the approximate number of bytes
+    // generated for an item and is used to create the chunks.
+    // Items for which formatItem appends nothing are skipped.
+    // If threadCount is 0, the number of virtual processors is used.
+    void writeItems(
+        uint64_t itemCount,
+        const std::function<uint64_t(uint64_t itemId)>& itemSize,
+        const std::function<void(uint64_t itemId, string& text)>& formatItem,
+        size_t threadCount);
+
+    // Flush the buffered text, write the BGZF end of file marker
+    // if compressing, and close the file.
+    void close();
+
+    // Approximate number of bytes of text in each chunk.
+    static const uint64_t chunkSize = 4 * 1024 * 1024;
+
+private:
+    const string fileName;
+    const bool bgzip;
+    ofstream file;
+    bool isClosed = false;
+
+    // Text passed to write and not yet written to the file.
+    string pendingText;
+    void flushPendingText();
+
+    // Write data to the file.
+    void writeToFile(const string&);
+
+    // Data used by writeItems.
+    class WriteItemsData {
+    public:
+        const std::function<void(uint64_t, string&)>* formatItem = 0;
+
+        // The item ranges for all chunks.
+        vector< pair<uint64_t, uint64_t> > chunks;
+
+        // The first chunk of the round being formatted.
+        uint64_t roundBegin = 0;
+
+        // The output buffers of each round.
+        // Formatting of a round uses one set while
+        // the previous round is written from the other.
+        vector<string> output[2];
+        uint64_t outputIndex = 0;
+    };
+    WriteItemsData writeItemsData;
+    void writeItemsThreadFunction(size_t threadId);
+};
+
+
+
+#endif
@@ -103,6 +103,7 @@ PYBIND11_MODULE(shasta, shastaModule)
         .def_readwrite("align4DeltaY", &AlignOptions::align4DeltaY)
         .def_readwrite("align4MinEntryCountPerCell", &AlignOptions::align4MinEntryCountPerCell)
         .def_readwrite("align4MaxDistanceFromBoundary", &AlignOptions::align4MaxDistanceFromBoundary)
+        .def_readwrite("diagonalScreenBandWidth", &AlignOptions::diagonalScreenBandWidth)
         ;
 
     // Expose class Mode2AssemblyOptions to Python.
@@ -182,6 +183,19 @@ PYBIND11_MODULE(shasta, shastaModule)
             arg("seed") = 231,
             arg("distanceThreshold"),
             arg("threadCount") = 0)
+        .def("randomlySelectKmersSparse",
+            &Assembler::randomlySelectKmersSparse,
+            arg("k"),
+            arg("probability"),
+            arg("seed") = 231,
+            arg("threadCount") = 0)
+        .def("selectKmersBasedOnFrequencySparse",
+            &Assembler::selectKmersBasedOnFrequencySparse,
+            arg("k"),
+            arg("markerDensity"),
+            arg("seed") = 231,
+            arg("enrichmentThreshold"),
+            arg("threadCount") = 0)
 
 
 
@@ -192,6 +206,8 @@ PYBIND11_MODULE(shasta, shastaModule)
             &Assembler::findMarkers,
             "Find markers in reads.",
             arg("threadCount") = 0)
+        .def("createMarkerIdSampledToc",
+            &Assembler::createMarkerIdSampledToc)
         .def("writeMarkers",
             (
                 void (Assembler::*)
@@ -234,6 +250,8 @@ PYBIND11_MODULE(shasta, shastaModule)
             arg("minBucketSize"),
             arg("maxBucketSize"),
             arg("minFrequency"),
+            arg("hashAllIterationsInOnePass") = false,
+            arg("checkpointDirectory") = "",
             arg("threadCount") = 0)
         .def("accessAlignmentCandidates",
             &Assembler::accessAlignmentCandidates)
@@ -432,6 +450,7 @@ PYBIND11_MODULE(shasta, shastaModule)
             arg("allowDuplicateMarkers"),
             arg("peakFinderMinAreaFraction"),
             arg("peakFinderAreaStartIndex"),
+            arg("externalSortBufferGigabytes") = 0,
             arg("threadCount") = 0)
         .def("accessMarkerGraphVertices",
              &Assembler::accessMarkerGraphVertices,
@@ -518,7 +537,8 @@ PYBIND11_MODULE(shasta, shastaModule)
             arg("lowCoverageThreshold"),
             arg("highCoverageThreshold"),
             arg("maxDistance"),
-            arg("edgeMarkerSkipThreshold"))
+            arg("edgeMarkerSkipThreshold"),
+            arg("threadCount") = 0)
         .def("reverseTransitiveReduction",
             &Assembler::reverseTransitiveReduction,
             arg("lowCoverageThreshold"),
@@ -543,6 +563,7 @@ PYBIND11_MODULE(shasta, shastaModule)
             &Assembler::assembleMarkerGraphEdges,
             arg("threadCount") = 0,
             arg("markerGraphEdgeLengthThresholdForConsensus"),
+            arg("edgeConsensusMajorityFraction") = 1.,
             arg("storeCoverageData"),
             arg("assembleAllEdges"))
         .def("accessMarkerGraphConsensus",
@@ -579,20 +600,26 @@ PYBIND11_MODULE(shasta, shastaModule)
         .def("assemble",
             &Assembler::assemble,
             arg("threadCount") = 0,
-            arg("storeCoverageDataCsvLengthThreshold") = 0)
+            arg("storeCoverageDataCsvLengthThreshold") = 0,
+            arg("computeEdgeConsensus") = false,
+            arg("markerGraphEdgeLengthThresholdForConsensus") = 1000,
+            arg("edgeConsensusMajorityFraction") = 1.)
         .def("accessAssemblyGraphSequences",
             &Assembler::accessAssemblyGraphSequences)
         .def("computeAssemblyStatistics",
             &Assembler::computeAssemblyStatistics)
         .def("writeGfa1",
             &Assembler::writeGfa1,
-            arg("fileName"))
+            arg("fileName"),
+            arg("threadCount") = 0)
         .def("writeGfa1BothStrands",
             &Assembler::writeGfa1BothStrands,
-            arg("fileName"))
+            arg("fileName"),
+            arg("threadCount") = 0)
         .def("writeFasta",
             &Assembler::writeFasta,
-            arg("fileName"))
+            arg("fileName"),
+            arg("threadCount") = 0)
         .def("colorGfaWithTwoReads",
             &Assembler::colorGfaWithTwoReads,
             arg("readId0"),
@@ -7,11 +7,15 @@
 using namespace shasta;
 
 // Standard library.
+#include "array.hpp"
 #include "chrono.hpp"
 #include "iterator.hpp"
 #include <filesystem>
 #include "tuple.hpp"
 
+// Zlib.
+#include <zlib.h>
+
 
 // Load reads from a fastq or fasta file.
 ReadLoader::ReadLoader(
@@ -19,6 +23,7 @@ ReadLoader::ReadLoader(
     uint64_t representation, // 0 = raw sequence, 1 = RLE sequence
     uint64_t minReadLength,
     bool noCache,
+    uint64_t streamingChunkSize,
     size_t threadCount,
     const string& dataNamePrefix,
     size_t pageSize,
@@ -32,7 +37,8 @@ ReadLoader::ReadLoader(
     threadCount(threadCount),
     dataNamePrefix(dataNamePrefix),
     pageSize(pageSize),
-    reads(reads)
+    reads(reads),
+    chunkSize(streamingChunkSize * 1024ULL * 1024ULL)
 {
     performanceLog << timestamp << "Loading reads from " << fileName << endl;
 
@@ -47,21 +53,58 @@ ReadLoader::ReadLoader(
             " must have an extension consistent with its format.");
     }
 
+    // Compressed file. The format is given by the
+    // extension that precedes the ".gz".
+    // Compressed files are always processed in chunks.
+    if(extension=="gz" || extension=="GZ") {
+        if(chunkSize == 0) {
+            chunkSize = defaultCompressedChunkSize;
+        }
+        string uncompressedExtension;
+        try {
+            uncompressedExtension = filesystem::extension(
+                fileName.substr(0, fileName.size() - extension.size() - 1));
+        } catch (...) {
+        }
+        if(uncompressedExtension=="fasta" || uncompressedExtension=="fa" ||
+            uncompressedExtension=="FASTA" || uncompressedExtension=="FA") {
+            processFileInChunks(true, false);
+            return;
+        }
+        if(uncompressedExtension=="fastq" || uncompressedExtension=="fq" ||
+            uncompressedExtension=="FASTQ" || uncompressedExtension=="FQ") {
+            processFileInChunks(true, true);
+            return;
+        }
+        throw runtime_error("Compressed input file " + fileName +
+            " must have a name ending in .fasta.gz, .fa.gz, .FASTA.gz, .FA.gz, "
+            ".fastq.gz, .fq.gz, .FASTQ.gz, or .FQ.gz.");
+    }
+
     // Fasta file. ReadLoader is more forgiving than OldFastaReadLoader.
     if(extension=="fasta" || extension=="fa" || extension=="FASTA" || extension=="FA") {
-        processFastaFile();
+        if(chunkSize == 0) {
+            processFastaFile();
+        } else {
+            processFileInChunks(false, false);
+        }
         return;
     }
 
     // Fastq file.
     if(extension=="fastq" || extension=="fq" || extension=="FASTQ" || extension=="FQ") {
-        processFastqFile();
+        if(chunkSize == 0) {
+            processFastqFile();
+        } else {
+            processFileInChunks(false, true);
+        }
         return;
     }
 
     // If getting here, the file extension is not supported.
     throw runtime_error("File extension " + extension + " is not supported. "
-        "Supported file extensions are .fasta, .fa, .FASTA, .FA, .fastq, .fq, .FASTQ, .FQ.");
+        "Supported file extensions are .fasta, .fa, .FASTA, .FA, .fastq, .fq, .FASTQ, .FQ, "
+        "optionally followed by .gz for compressed files.");
 }
 
 
@@ -96,6 +139,7 @@ void ReadLoader::processFastaFile()
     // Store the reads computed by each thread and free
     // the per-thread data structures.
     storeReads();
+    finishStoringReads();
     const auto t3 = std::chrono::steady_clock::now();
 
 
@@ -327,6 +371,7 @@ void ReadLoader::processFastqFile()
     // the per-thread data structures.
     const auto t3 = std::chrono::steady_clock::now();
     storeReads();
+    finishStoringReads();
     const auto t4 = std::chrono::steady_clock::now();
 
 
@@ -402,11 +447,11 @@ void ReadLoader::processFastqFileThreadFunction(size_t threadId)
         // Check the header line.
         if (headerEnd == headerBegin) {
             throw runtime_error("Empty header line for read at offset " +
-                to_string(headerBegin - fileBegin) + ".");
+                to_string(bufferOffset + (headerBegin - fileBegin)) + ".");
         }
         if (*headerBegin != '@') {
             throw runtime_error("Read at offset " +
-                to_string(headerBegin - fileBegin) +
+                to_string(bufferOffset + (headerBegin - fileBegin)) +
                 " does not begin with \"@\".");
         }
 
@@ -424,7 +469,7 @@ void ReadLoader::processFastqFileThreadFunction(size_t threadId)
         }
         if(readName.empty()) {
             throw runtime_error("Empty name for read at offset " +
-                to_string(headerBegin - fileBegin) + ".");
+                to_string(bufferOffset + (headerBegin - fileBegin)) + ".");
         }
 
         // Extract the read meta data. It starts at the first non-space character
@@ -445,7 +490,7 @@ void ReadLoader::processFastqFileThreadFunction(size_t threadId)
         // We already checked above that it is at least 1 character long.
         if (*plusBegin != '+') {
             throw runtime_error("Third line does not contain \"+\" for read " +
-                                readName + " at offset " + to_string(headerBegin - fileBegin) + ".");
+                                readName + " at offset " + to_string(bufferOffset + (headerBegin - fileBegin)) + ".");
         }
 
         // Get the number of bases.
@@ -454,7 +499,7 @@ void ReadLoader::processFastqFileThreadFunction(size_t threadId)
             throw runtime_error(
                     "Inconsistent numbers of bases and quality scores for read " +
                     readName + " at offset " +
-                    to_string(headerBegin - fileBegin) + ": " +
+                    to_string(bufferOffset + (headerBegin - fileBegin)) + ": " +
                     to_string(baseCount) + " bases, " +
                     to_string(scoresEnd - scoresBegin) + " quality scores."
             );
@@ -467,7 +512,7 @@ void ReadLoader::processFastqFileThreadFunction(size_t threadId)
             const Base base = Base::fromCharacterNoException(c);
             if (!base.isValid()) {
                 throw runtime_error("Invalid base " + string(1, c) + " for read " +
-                                    readName + " at offset " + to_string(it - fileBegin) + ".");
+                                    readName + " at offset " + to_string(bufferOffset + (it - fileBegin)) + ".");
             }
             read.push_back(base);
         }
@@ -597,6 +642,7 @@ void ReadLoader::findLineEnds()
     runThreads(&ReadLoader::findLineEndsThreadFunction, threadCount);
 
     // Combine the line ends founds by all threads.
+    lineEnds.clear();
     for(size_t threadId=0; threadId<threadCount; threadId++) {
         const vector<uint64_t>& thisThreadLineEnds = threadLineEnds[threadId];
         lineEnds.insert(lineEnds.end(),
@@ -741,7 +787,13 @@ void ReadLoader::storeReads()
     threadReadMetaData.clear();
     threadReads.clear();
     threadReadRepeatCounts.clear();
+}
+
 
+
+// Final processing after all reads in the file have been stored.
+void ReadLoader::finishStoringReads()
+{
     // Free up unused allocated memory.
     reads.readNames.unreserve();
     reads.readMetaData.unreserve();
@@ -754,3 +806,423 @@ void ReadLoader::storeReads()
     reads.readFlags.resize(reads.readCount());
 }
 
+
+
+
+// Process a file in chunks.
+// For compressed files (.gz), this uses either
+// parallel BGZF decompression (for files created by bgzip)
+// or sequential gzip decompression in a separate thread.
+void ReadLoader::processFileInChunks(bool isCompressed, bool isFastq)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+
+    performanceLog << "File size: " <<
+        std::filesystem::file_size(fileName) << " bytes." << endl;
+    performanceLog << "Processing this file in chunks of " << chunkSize << " bytes." << endl;
+    if(noCache) {
+        performanceLog << "Reads.noCache is ignored when processing a file in chunks." << endl;
+    }
+
+    // The BlockReader holds up to one chunk of data read ahead.
+    const uint64_t blockSize = min(chunkSize, maxBlockSize);
+    const uint64_t blockCount = max(uint64_t(1), chunkSize / blockSize);
+
+    if(not isCompressed) {
+        blockReader = make_unique<BlockReader>(fileName, false, blockSize, blockCount);
+    } else if(isBgzfFile()) {
+        performanceLog << "This file is in BGZF format and will be decompressed "
+            "using " << threadCount << " threads." << endl;
+        compressedFileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+        if(compressedFileDescriptor == -1) {
+            throw runtime_error("Error opening " + fileName);
+        }
+        compressedBuffer.createNew(dataName("tmp-CompressedBuffer"), pageSize);
+        compressedBuffer.reserve(bgzfWindowSize);
+    } else {
+        performanceLog << "This file is not in BGZF format and will be decompressed "
+            "sequentially." << endl;
+        blockReader = make_unique<BlockReader>(fileName, true, blockSize, blockCount);
+    }
+
+    processChunks(isFastq);
+
+    // Clean up.
+    if(compressedFileDescriptor != -1) {
+        ::close(compressedFileDescriptor);
+        compressedFileDescriptor = -1;
+        compressedBuffer.remove();
+        bgzfBlocks.clear();
+    }
+    blockReader.reset();
+    block.clear();
+    block.shrink_to_fit();
+    finishStoringReads();
+
+    const auto t1 = std::chrono::steady_clock::now();
+    performanceLog << "Uncompressed file size: " << bufferOffset << " bytes." << endl;
+    performanceLog << "Total time to process this file: " << seconds(t1-t0) << " s." << endl;
+}
+
+
+
+// Process the file in chunks, each ending at a read boundary.
+// Each chunk is parsed by all threads before proceeding to the next.
+void ReadLoader::processChunks(bool isFastq)
+{
+    const ThreadFunction threadFunction = isFastq ?
+        &ReadLoader::processFastqFileThreadFunction :
+        &ReadLoader::processFastaFileThreadFunction;
+
+    buffer.createNew(dataName("tmp-FastaBuffer"), pageSize);
+    buffer.reserve(chunkSize);
+    bufferOffset = 0;
+
+    // Used to hold the incomplete read at the end of each chunk
+    // while the chunk is being parsed.
+    vector<char> carryOver;
+
+    bool endOfFile = false;
+    double readTime = 0.;
+    double locateTime = 0.;
+    double parseTime = 0.;
+    double storeTime = 0.;
+    uint64_t chunkCount = 0;
+    while(true) {
+
+        // Add data to the buffer until it contains at least chunkSize bytes
+        // and at least one complete read, or we reach the end of the file.
+        uint64_t chunkEnd = 0;
+        while(true) {
+            if(not endOfFile and buffer.size() < chunkSize) {
+                const auto t0 = std::chrono::steady_clock::now();
+                endOfFile = not appendToBuffer();
+                const auto t1 = std::chrono::steady_clock::now();
+                readTime += seconds(t1 - t0);
+                continue;
+            }
+
+            const auto t0 = std::chrono::steady_clock::now();
+            if(endOfFile) {
+                // At the end of the file, the entire buffer must consist of complete reads.
+                if(isFastq) {
+                    findLineEnds();
+                    if((lineEnds.size() %4) != 0) {
+                        throw runtime_error("File " + fileName + " has " +
+                            "a number of lines that is not a multiple of 4. "
+                            "Only fastq files with each read on exactly 4 lines are supported.");
+                    }
+                }
+                chunkEnd = buffer.size();
+            } else {
+                chunkEnd = isFastq ? findFastqChunkEnd() : findFastaChunkEnd();
+            }
+            const auto t1 = std::chrono::steady_clock::now();
+            locateTime += seconds(t1 - t0);
+
+            if(chunkEnd > 0 or endOfFile) {
+                break;
+            }
+
+            // The buffer does not contain a complete read. Keep reading.
+            const auto t2 = std::chrono::steady_clock::now();
+            endOfFile = not appendToBuffer();
+            const auto t3 = std::chrono::steady_clock::now();
+            readTime += seconds(t3 - t2);
+        }
+        if(chunkEnd == 0) {
+            break;
+        }
+        ++chunkCount;
+
+        // Set aside the incomplete read at the end of the buffer, if any.
+        carryOver.assign(buffer.begin() + chunkEnd, buffer.end());
+        buffer.resize(chunkEnd);
+
+        // Each thread stores reads in its own data structures.
+        const auto t0 = std::chrono::steady_clock::now();
+        allocatePerThreadDataStructures();
+        runThreads(threadFunction, threadCount);
+        lineEnds.clear();
+
+        // Store the reads computed by each thread and free
+        // the per-thread data structures.
+        const auto t1 = std::chrono::steady_clock::now();
+        storeReads();
+        const auto t2 = std::chrono::steady_clock::now();
+        parseTime += seconds(t1 - t0);
+        storeTime += seconds(t2 - t1);
+
+        // The next chunk begins with the data we set aside.
+        bufferOffset += chunkEnd;
+        buffer.resize(carryOver.size());
+        copy(carryOver.begin(), carryOver.end(), buffer.begin());
+    }
+    buffer.remove();
+
+    performanceLog << "Processed this file in " << chunkCount << " chunks.\n" <<
+        "Read + decompress: " << readTime << " s.\n" <<
+        "Locate: " << locateTime << " s.\n"
+        "Parse: " << parseTime << " s.\n"
+        "Store: " << storeTime << " s." << endl;
+}
+
+
+
+// Append to the buffer the next portion of (decompressed) data.
+// Returns false if there is no more data.
+bool ReadLoader::appendToBuffer()
+{
+    if(not blockReader) {
+        return appendBgzfBlocks();
+    }
+
+    if(not blockReader->getNextBlock(block)) {
+        return false;
+    }
+    const uint64_t oldSize = buffer.size();
+    buffer.resize(oldSize + block.size());
+    copy(block.begin(), block.end(), buffer.begin() + oldSize);
+    return true;
+}
+
+
+
+// Return the offset of the last read that begins in the buffer
+// at a position other than 0, or 0 if there is no such read.
+uint64_t ReadLoader::findFastaChunkEnd() const
+{
+    for(uint64_t offset=buffer.size()-1; offset>0; offset--) {
+        if(fastaReadBeginsHere(offset)) {
+            return offset;
+        }
+    }
+    return 0;
+}
+
+
+
+// Return the offset following the last line end of the last
+// complete 4-line fastq read in the buffer, or 0 if
+// the buffer does not contain a complete read.
+// This assumes that the buffer begins at a read boundary.
+uint64_t ReadLoader::findFastqChunkEnd()
+{
+    findLineEnds();
+    lineEnds.resize(4 * (lineEnds.size() / 4));
+    if(lineEnds.empty()) {
+        return 0;
+    } else {
+        return lineEnds.back() + 1;
+    }
+}
+
+
+
+// Return true if the file begins with the header of a BGZF block.
+// This is the format created by bgzip and samtools.
+// See section 4.1 of the SAM specification
+// (https://samtools.github.io/hts-specs/SAMv1.pdf).
+bool ReadLoader::isBgzfFile() const
+{
+    const int fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+    if(fileDescriptor == -1) {
+        throw runtime_error("Error opening " + fileName);
+    }
+    array<char, 18> header;
+    const ssize_t n = ::read(fileDescriptor, header.data(), header.size());
+    ::close(fileDescriptor);
+    if(n != ssize_t(header.size())) {
+        return false;
+    }
+
+    try {
+        uint64_t headerSize;
+        return parseBgzfHeader(header.data(), header.size(), headerSize) > 0;
+    } catch(const runtime_error&) {
+        return false;
+    }
+}
+
+
+
+// Parse the header of a BGZF block beginning at p, with n bytes available.
+// Returns the total size of the block (BSIZE+1), or 0 if more
+// bytes are needed to parse the header.
+// Throws an exception if this is not the header of a BGZF block.
+// On return, headerSize contains the size of the header,
+// which is also the offset of the compressed data in the block.
+uint64_t ReadLoader::parseBgzfHeader(
+    const char* p,
+    uint64_t n,
+    uint64_t& headerSize) const
+{
+    const unsigned char* q = reinterpret_cast<const unsigned char*>(p);
+
+    // The fixed portion of the header.
+    if(n < 12) {
+        return 0;
+    }
+    if(q[0] != 31 or q[1] != 139 or q[2] != 8 or (q[3] & 4) == 0) {
+        throw runtime_error("Invalid BGZF block header.");
+    }
+
+    // The extra subfields. Look for the one containing BSIZE.
+    const uint64_t xlen = q[10] + (uint64_t(q[11]) << 8);
+    headerSize = 12 + xlen;
+    if(n < headerSize) {
+        return 0;
+    }
+    uint64_t offset = 12;
+    while(offset + 4 <= headerSize) {
+        const uint64_t slen = q[offset+2] + (uint64_t(q[offset+3]) << 8);
+        if(q[offset] == 66 and q[offset+1] == 67 and slen == 2 and offset + 6 <= headerSize) {
+            const uint64_t bsize = q[offset+4] + (uint64_t(q[offset+5]) << 8);
+            if(bsize + 1 < headerSize + 8) {
+                throw runtime_error("Invalid BGZF block size.");
+            }
+            return bsize + 1;
+        }
+        offset += 4 + slen;
+    }
+    throw runtime_error("BGZF block header does not contain the BC subfield.");
+}
+
+
+
+// Read the next portion of a BGZF file, decompress in parallel
+// the BGZF blocks it contains, and append the decompressed
+// data to the buffer.
+// Returns false if there is no more data.
+bool ReadLoader::appendBgzfBlocks()
+{
+    // Move to the beginning of compressedBuffer the incomplete
+    // BGZF block left over from the previous call, if any.
+    const uint64_t leftoverSize = compressedBuffer.size() - compressedBufferUsed;
+    copy(compressedBuffer.begin() + compressedBufferUsed, compressedBuffer.end(),
+        compressedBuffer.begin());
+    compressedFileOffset += compressedBufferUsed;
+    compressedBufferUsed = 0;
+
+    // Fill the rest of compressedBuffer.
+    compressedBuffer.resize(bgzfWindowSize);
+    uint64_t size = leftoverSize;
+    while(size < bgzfWindowSize) {
+        const ssize_t n = ::read(compressedFileDescriptor,
+            compressedBuffer.begin() + size, bgzfWindowSize - size);
+        if(n < 0) {
+            throw runtime_error("Error reading " + fileName);
+        }
+        if(n == 0) {
+            break;
+        }
+        size += n;
+    }
+    compressedBuffer.resize(size);
+    if(size == 0) {
+        return false;
+    }
+
+
+
+    // Locate the BGZF blocks.
+    bgzfBlocks.clear();
+    uint64_t decompressedSize = buffer.size();
+    const unsigned char* q = reinterpret_cast<const unsigned char*>(compressedBuffer.begin());
+    while(compressedBufferUsed < size) {
+        uint64_t headerSize = 0;
+        const uint64_t blockSize = parseBgzfHeader(
+            compressedBuffer.begin() + compressedBufferUsed,
+            size - compressedBufferUsed,
+            headerSize);
+        if(blockSize == 0 or compressedBufferUsed + blockSize > size) {
+            // This block is incomplete.
+            break;
+        }
+
+        // The footer contains the CRC32 and the decompressed size.
+        const unsigned char* footer = q + compressedBufferUsed + blockSize - 8;
+        BgzfBlock bgzfBlock;
+        bgzfBlock.compressedBegin = compressedBufferUsed + headerSize;
+        bgzfBlock.compressedSize = blockSize - headerSize - 8;
+        bgzfBlock.decompressedBegin = decompressedSize;
+        bgzfBlock.crc =
+            uint32_t(footer[0]) +
+            (uint32_t(footer[1]) << 8) +
+            (uint32_t(footer[2]) << 16) +
+            (uint32_t(footer[3]) << 24);
+        bgzfBlock.decompressedSize =
+            uint64_t(footer[4]) +
+            (uint64_t(footer[5]) << 8) +
+            (uint64_t(footer[6]) << 16) +
+            (uint64_t(footer[7]) << 24);
+
+        // Empty blocks (such as the end of file marker) have nothing to decompress.
+        if(bgzfBlock.decompressedSize > 0) {
+            bgzfBlocks.push_back(bgzfBlock);
+            decompressedSize += bgzfBlock.decompressedSize;
+        }
+        compressedBufferUsed += blockSize;
+    }
+
+    if(compressedBufferUsed == 0) {
+        // We did not find any complete blocks.
+        // Since a BGZF block is at most 64 KB, this can only
+        // happen at the end of the file.
+        throw runtime_error("BGZF file " + fileName + " is truncated at offset " +
+            to_string(compressedFileOffset) + ".");
+    }
+
+
+
+    // Decompress them in parallel.
+    buffer.resize(decompressedSize);
+    setupLoadBalancing(bgzfBlocks.size(), 16);
+    runThreads(&ReadLoader::decompressBgzfBlocksThreadFunction, threadCount);
+
+    return true;
+}
+
+
+
+void ReadLoader::decompressBgzfBlocksThreadFunction(size_t threadId)
+{
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in = Z_NULL;
+    stream.avail_in = 0;
+
+    // Negative window bits = raw deflate data without a header.
+    if(inflateInit2(&stream, -15) != Z_OK) {
+        throw runtime_error("Error initializing zlib.");
+    }
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over BGZF blocks assigned to this batch.
+        for(uint64_t i=begin; i!=end; i++) {
+            const BgzfBlock& bgzfBlock = bgzfBlocks[i];
+            Bytef* decompressedBegin = reinterpret_cast<Bytef*>(buffer.begin() + bgzfBlock.decompressedBegin);
+
+            inflateReset(&stream);
+            stream.next_in = reinterpret_cast<Bytef*>(compressedBuffer.begin() + bgzfBlock.compressedBegin);
+            stream.avail_in = uInt(bgzfBlock.compressedSize);
+            stream.next_out = decompressedBegin;
+            stream.avail_out = uInt(bgzfBlock.decompressedSize);
+            const int status = inflate(&stream, Z_FINISH);
+
+            if(status != Z_STREAM_END or stream.avail_out != 0 or
+                crc32(0, decompressedBegin, uInt(bgzfBlock.decompressedSize)) != bgzfBlock.crc) {
+                inflateEnd(&stream);
+                throw runtime_error("Invalid BGZF block in " + fileName + " near offset " +
+                    to_string(compressedFileOffset + bgzfBlock.compressedBegin) + ".");
+            }
+        }
+    }
+
+    inflateEnd(&stream);
+}
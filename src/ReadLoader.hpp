@@ -2,6 +2,7 @@
 #define SHASTA_READ_LOADER_HPP
 
 // Shasta
+#include "BlockReader.hpp"
 #include "LongBaseSequence.hpp"
 #include "MemoryMappedObject.hpp"
 #include "MultithreadedObject.hpp"
@@ -17,7 +18,13 @@ namespace shasta {
 
 
 
-// Class used to load reads from a fasta file.
+// Class used to load reads from a fasta or fastq file.
+// The file can optionally be compressed with gzip or bgzip
+// (file names ending in .gz).
+// Uncompressed files are read in their entirety into memory
+// and then parsed, unless streaming is requested
+// via a non-zero streamingChunkSize.
+// Compressed files are always processed in a streaming fashion.
 class shasta::ReadLoader :
     public MultithreadedObject<ReadLoader>{
 public:
@@ -28,6 +35,7 @@ public:
         uint64_t representation, // 0 = raw sequence, 1 = RLE sequence
         uint64_t minReadLength,
         bool noCache,
+        uint64_t streamingChunkSize, // In MB. 0 = no streaming for uncompressed files.
         size_t threadCount,
         const string& dataNamePrefix,
         size_t pageSize,
@@ -112,6 +120,9 @@ private:
     // the per-thread data structures.
     void storeReads();
 
+    // Final processing after all reads in the file have been stored.
+    void finishStoringReads();
+
     // Functions used for fasta files.
     void processFastaFile();
     void processFastaFileThreadFunction(size_t threadId);
@@ -129,6 +140,73 @@ private:
     vector< vector<uint64_t> > threadLineEnds;
     vector<uint64_t> lineEnds;
 
+
+
+    // Functions used for streaming.
+    // The file is processed in chunks. Each chunk ends
+    // at a read boundary and is parsed by all threads before
+    // proceeding to the next chunk, so memory usage
+    // does not depend on the size of the file.
+    // Files created by bgzip consist of independent BGZF blocks
+    // which are decompressed in parallel.
+    // Other files are read (and decompressed, if necessary)
+    // by a BlockReader in a separate thread, while the threads parse
+    // the previous chunk.
+    void processFileInChunks(bool isCompressed, bool isFastq);
+    void processChunks(bool isFastq);
+
+    // The size of each chunk, in bytes.
+    // Zero if streaming was not requested.
+    uint64_t chunkSize;
+    static const uint64_t defaultCompressedChunkSize = 1024ULL * 1024ULL * 1024ULL;
+
+    // Offset in the uncompressed file of the first byte in the buffer.
+    // Only used for error messages.
+    uint64_t bufferOffset = 0;
+
+    // Append to the buffer the next portion of decompressed data.
+    // Returns false if there is no more data.
+    bool appendToBuffer();
+
+    // Find the end of the last complete read in the buffer.
+    // Returns 0 if the buffer does not contain a complete read.
+    // For fastq files, this also fills lineEnds
+    // for the portion of the buffer preceding the returned offset.
+    uint64_t findFastaChunkEnd() const;
+    uint64_t findFastqChunkEnd();
+
+    // The BlockReader used for files not created by bgzip.
+    // It holds up to one chunk of data read ahead.
+    static const uint64_t maxBlockSize = 16 * 1024 * 1024;
+    unique_ptr<BlockReader> blockReader;
+    vector<char> block;
+
+    // Data structures used for files created by bgzip.
+    bool isBgzfFile() const;
+    int compressedFileDescriptor = -1;
+    uint64_t compressedFileOffset = 0;
+    static const uint64_t bgzfWindowSize = 64 * 1024 * 1024;
+    MemoryMapped::Vector<char> compressedBuffer;
+    uint64_t compressedBufferUsed = 0;
+    class BgzfBlock {
+    public:
+        // The compressed data (excluding the header and the footer),
+        // as offsets in compressedBuffer.
+        uint64_t compressedBegin;
+        uint64_t compressedSize;
+
+        // The decompressed data, as offsets in buffer.
+        uint64_t decompressedBegin;
+        uint64_t decompressedSize;
+
+        // The CRC32 of the decompressed data.
+        uint32_t crc;
+    };
+    vector<BgzfBlock> bgzfBlocks;
+    uint64_t parseBgzfHeader(const char*, uint64_t n, uint64_t& headerSize) const;
+    bool appendBgzfBlocks();
+    void decompressBgzfBlocksThreadFunction(size_t threadId);
+
 };
 
 
@@ -179,6 +179,7 @@ SimpleBayesianConsensusCaller::SimpleBayesianConsensusCaller(
 
     maxInputRunlength = uint16_t(probabilityMatrices[0][0].size() - 1);
     maxOutputRunlength = uint16_t(probabilityMatrices[0].size() - 1);
+    createTables();
 
     cout << "Bayesian consensus caller configuration name is " <<
         configurationName << endl;
@@ -333,164 +334,218 @@ void SimpleBayesianConsensusCaller::normalizeLikelihoods(vector<double>& x, doub
 }
 
 
-void SimpleBayesianConsensusCaller::factorRepeats(
-    array<std::map<uint16_t,uint16_t>,2>& factoredRepeats,
-    const Coverage& coverage) const{
-
-    // Store counts for each unique observation
-    for (auto& observation: coverage.getReadCoverageData() ){
-        // If NOT a gap, always increment
-        if (not observation.base.isGap()) {
-            factoredRepeats[uint16_t(observation.strand)][uint16_t(observation.repeatCount)]++;
-        // If IS a gap only increment if "countGapsAsZeros" is true
-        }else if (countGapsAsZeros){
-            factoredRepeats[uint16_t(observation.strand)][0]++;
+// Fill transposedProbabilityMatrices and unanimousRunlengths.
+void SimpleBayesianConsensusCaller::createTables()
+{
+    const uint64_t ySize = maxOutputRunlength + 1;
+    const uint64_t xSize = maxInputRunlength + 1;
+
+    for(uint64_t base=0; base<4; base++) {
+        vector<double>& t = transposedProbabilityMatrices[base];
+        t.resize(xSize * ySize);
+        for(uint64_t x=0; x<xSize; x++) {
+            for(uint64_t y=0; y<ySize; y++) {
+                t[x * ySize + y] = probabilityMatrices[base][y][x];
+            }
         }
     }
-}
-
 
-void SimpleBayesianConsensusCaller::factorRepeats(
-    array<std::map<uint16_t,uint16_t>,2>& factoredRepeats,
-    const Coverage& coverage,
-    AlignedBase consensusBase) const{
-
-    // Store counts for each unique observation
-    for (auto& observation: coverage.getReadCoverageData() ){
-        // Ignore non consensus repeat values
-        if (observation.base.value == consensusBase.value){
-            // If NOT a gap, always increment
-            if (not observation.base.isGap()) {
-                factoredRepeats[uint16_t(observation.strand)][uint16_t(observation.repeatCount)]++;
-            // If IS a gap only increment if "countGapsAsZeros" is true
-            }else if (countGapsAsZeros){
-                factoredRepeats[uint16_t(observation.strand)][0]++;
+    // For unanimous columns, the log likelihood of each y is computed
+    // exactly as in computeLogLikelihoods, so the results are identical.
+    unanimousRunlengths.resize(4 * xSize * (unanimousMaxCount + 1) * (unanimousMaxCount + 1));
+    for(uint64_t base=0; base<4; base++) {
+        const char baseCharacter = AlignedBase::fromInteger(uint8_t(base)).character();
+        const vector<double>& prior = priors[(baseCharacter == 'A' or baseCharacter == 'T') ? 0 : 1];
+        for(uint64_t x=0; x<xSize; x++) {
+            const double* column = transposedProbabilityMatrices[base].data() + x * ySize;
+            for(uint64_t c0=0; c0<=unanimousMaxCount; c0++) {
+                for(uint64_t c1=0; c1<=unanimousMaxCount; c1++) {
+                    double yMaxLikelihood = -INF;
+                    uint16_t yMax = 0;
+                    for(uint16_t y=0; y<ySize; y++) {
+                        double logSum = prior[y];
+                        if(c0) {
+                            logSum += double(c0) * column[y];
+                        }
+                        if(c1) {
+                            logSum += double(c1) * column[y];
+                        }
+                        if(logSum > yMaxLikelihood) {
+                            yMaxLikelihood = logSum;
+                            yMax = y;
+                        }
+                    }
+                    unanimousRunlengths[unanimousRunlengthsIndex(base, x, c0, c1)] = max(uint16_t(1), yMax);
+                }
             }
         }
     }
 }
 
 
-uint16_t SimpleBayesianConsensusCaller::predictRunlength(const Coverage &coverage, AlignedBase consensusBase, vector<double>& logLikelihoodY) const{
-    array <std::map <uint16_t,uint16_t>, 2> factoredRepeats;    // Repeats grouped by strand and length
 
-    size_t priorIndex = -1;   // Used to determine which prior probability vector to access (AT=0 or GC=1)
-    uint16_t x;               // Element of X = {x_0, x_1, ..., x_i} observed repeats
-    uint16_t c;               // Number of times x_i was observed
-    uint16_t y;               // Element of Y = {y_0, y_1, ..., y_j} true repeat between 0 and j=max_runlength
-    double logSum;            // Product (in logspace) of P(x_i|y_j) for each i
+// Call f(strand, x, c) for each observed run length x and the number of times c
+// it was observed on each strand, in order of strand and then x.
+// This visits the same (strand, x, c) as the std::map based
+// version that was used before, in the same order.
+template<class F> void SimpleBayesianConsensusCaller::factorRepeats(
+    const Coverage& coverage,
+    AlignedBase consensusBase,
+    F f) const
+{
+    const AlignedBase gap = AlignedBase::gap();
 
-    double yMaxLikelihood = -INF;     // Probability of most probable true repeat length
-    uint16_t yMax = 0;                 // Most probable repeat length
+    for(Strand strand=0; strand<2; strand++) {
 
-    // Determine which index to use for this->priors
-    if (consensusBase.character() == 'A' || consensusBase.character() == 'T'){
-        priorIndex = 0;
-    }
-    else if (consensusBase.character() == 'G' || consensusBase.character() == 'C'){
-        priorIndex = 1;
-    }
+        // Gaps have repeat count 0 and are only used if countGapsAsZeros is true.
+        uint64_t gapCount = 0;
+        if(countGapsAsZeros and
+            (not ignoreNonConsensusBaseRepeats or consensusBase.isGap())) {
+            const vector<size_t>& g = coverage.detailedCoverageVector(gap, strand);
+            if(not g.empty()) {
+                gapCount = g[0];
+            }
+        }
+        if(gapCount) {
+            f(strand, uint64_t(0), gapCount);
+        }
 
-    // Count the number of times each unique repeat was observed, to reduce redundancy in calculating log likelihoods/
-    // Depending on class boolean "ignoreNonConsensusBaseRepeats" filter out observations
-    if (ignoreNonConsensusBaseRepeats) {
-        factorRepeats(factoredRepeats, coverage, consensusBase);
-    }
-    else {
-        factorRepeats(factoredRepeats, coverage);
+        // Non-gap bases have repeat count at least 1.
+        if(ignoreNonConsensusBaseRepeats) {
+            if(consensusBase.isGap()) {
+                continue;
+            }
+            const vector<size_t>& v = coverage.detailedCoverageVector(consensusBase, strand);
+            for(uint64_t x=1; x<v.size(); x++) {
+                if(v[x]) {
+                    f(strand, x, uint64_t(v[x]));
+                }
+            }
+        } else {
+            uint64_t xEnd = 0;
+            for(uint8_t base=0; base<4; base++) {
+                xEnd = max(xEnd, uint64_t(coverage.detailedCoverageVector(AlignedBase::fromInteger(base), strand).size()));
+            }
+            for(uint64_t x=1; x<xEnd; x++) {
+                uint64_t c = 0;
+                for(uint8_t base=0; base<4; base++) {
+                    const vector<size_t>& v = coverage.detailedCoverageVector(AlignedBase::fromInteger(base), strand);
+                    if(x < v.size()) {
+                        c += v[x];
+                    }
+                }
+                if(c) {
+                    f(strand, x, c);
+                }
+            }
+        }
     }
+}
 
-    // Iterate all possible Y from 0 to j to calculate p(Y_j|X) where X is all observations 0 to i,
-    // assuming i and j are less than maxRunlength
-    for (y = 0; y <= maxOutputRunlength; y++){
-        // Initialize logSum for this Y value using empirically determined priors
-        logSum = priors[priorIndex][y];
 
-        for (uint16_t strand = 0; strand <= factoredRepeats.size() - 1; strand++){
-            for (auto& item: factoredRepeats[strand]){
-                x = item.first;
-                c = item.second;
 
-                // In the case that observed runlength is too large for the matrix, cap it at maxRunlength
-                if (x > maxInputRunlength){
-                    x = maxInputRunlength;
-                }
+uint16_t SimpleBayesianConsensusCaller::computeLogLikelihoods(
+    const Coverage& coverage,
+    AlignedBase consensusBase,
+    double* logLikelihoodY) const
+{
+    // Determine which prior probability vector to use (AT=0 or GC=1).
+    SHASTA_ASSERT(not consensusBase.isGap());
+    const char baseCharacter = consensusBase.character();
+    const vector<double>& prior = priors[(baseCharacter == 'A' or baseCharacter == 'T') ? 0 : 1];
+
+    // Initialize using empirically determined priors.
+    const uint64_t ySize = maxOutputRunlength + 1;
+    for(uint64_t y=0; y<ySize; y++) {
+        logLikelihoodY[y] = prior[y];
+    }
 
-                // Increment log likelihood for this y_j
-                logSum += double(c)*probabilityMatrices[consensusBase.value][y][x];
-            }
+    // Add the contribution of each observed run length x, observed c times.
+    // In the case that observed runlength is too large for the matrix, cap it at maxRunlength.
+    const double* matrix = transposedProbabilityMatrices[consensusBase.value].data();
+    factorRepeats(coverage, consensusBase,
+        [&](Strand, uint64_t x, uint64_t c) {
+        const double* column = matrix + min(x, uint64_t(maxInputRunlength)) * ySize;
+        const double dc = double(c);
+        for(uint64_t y=0; y<ySize; y++) {
+            logLikelihoodY[y] += dc * column[y];
         }
-
-        logLikelihoodY[y] = logSum;
-
-        // Update max Y value if log likelihood is greater than previous maximum... Should do this outside this loop?
-        if (logSum > yMaxLikelihood){
-            yMaxLikelihood = logSum;
+    });
+
+    // Find the most likely y.
+    double yMaxLikelihood = -INF;
+    uint16_t yMax = 0;
+    for(uint16_t y=0; y<ySize; y++) {
+        if(logLikelihoodY[y] > yMaxLikelihood) {
+            yMaxLikelihood = logLikelihoodY[y];
             yMax = y;
         }
     }
+    return yMax;
+}
 
-    normalizeLikelihoods(logLikelihoodY, yMaxLikelihood);
 
+
+uint16_t SimpleBayesianConsensusCaller::predictRunlength(const Coverage &coverage, AlignedBase consensusBase, vector<double>& logLikelihoodY) const{
+    logLikelihoodY.resize(maxOutputRunlength + 1);
+    const uint16_t yMax = computeLogLikelihoods(coverage, consensusBase, logLikelihoodY.data());
+    normalizeLikelihoods(logLikelihoodY, logLikelihoodY[yMax]);
     return max(uint16_t(1), yMax);   // Don't allow zeroes...
 }
 
 
 AlignedBase SimpleBayesianConsensusCaller::predictConsensusBase(const Coverage& coverage) const{
-    const vector<CoverageData>& coverageDataVector = coverage.getReadCoverageData();
-    vector<uint32_t> baseCounts(5,0);
-    uint32_t maxBaseCount = 0;
-    uint8_t maxBase = 4;   // Default to gap in case coverage is empty (is this possible?)
-    uint32_t key;
-
-    // Count bases. If it's a gap increment placeholder 4 in baseCount vector
-    for(const CoverageData& observation: coverageDataVector) {
-        if (not observation.base.isGap()) {
-            key = observation.base.value;
-            baseCounts[key]++;
-        }
-        else{
-            key = 4;
-            baseCounts[key]++;
-        }
-    }
-
-    // Determine most represented base (consensus)
-    for (uint32_t i=0; i<5; i++){
-        if (baseCounts[i] > maxBaseCount){
-            maxBaseCount = baseCounts[i];
-            maxBase = uint8_t(i);
-        }
-    }
-
-    return AlignedBase::fromInteger(maxBase);
+    // Most represented base (consensus), with ties broken in favor of the lowest base value
+    // and defaulting to gap in case coverage is empty.
+    return coverage.mostFrequentBase();
 }
 
 
 Consensus SimpleBayesianConsensusCaller::operator()(const Coverage& coverage) const{
-    AlignedBase consensusBase;
-    uint16_t consensusRepeat;
+    const AlignedBase consensusBase = predictConsensusBase(coverage);
 
-    vector<double> logLikelihoods(u_long(maxOutputRunlength+1), -INF);    // initialize as zeros in log space
-
-    consensusBase = predictConsensusBase(coverage);
-
-    if (predictGapRunlengths) {
-        // Predict all run lengths regardless of whether consensus base is a gap
-        consensusRepeat = predictRunlength(coverage, consensusBase, logLikelihoods);
+    // Consensus IS a gap character, and the configuration forbids predicting gaps.
+    if(consensusBase.isGap() and not predictGapRunlengths) {
+        return Consensus(consensusBase, 0);
     }
-    else{
-        if (not consensusBase.isGap()) {
-            // Consensus is NOT a gap character, and the configuration forbids predicting gaps
-            consensusRepeat = predictRunlength(coverage, consensusBase, logLikelihoods);
-        }
-        else{
-            // Consensus IS a gap character, and the configuration forbids predicting gaps
-            consensusRepeat = 0;
+
+    // Check if this is a unanimous column, with at most one observed
+    // run length x on each strand, and the same x on both strands.
+    // If so, look up the run length in the precomputed table.
+    bool isUnanimous = true;
+    uint64_t unanimousX = 0;
+    array<uint64_t, 2> unanimousCounts = {0, 0};
+    factorRepeats(coverage, consensusBase,
+        [&](Strand strand, uint64_t x, uint64_t c) {
+        x = min(x, uint64_t(maxInputRunlength));
+        if(unanimousCounts[0] + unanimousCounts[1] == 0) {
+            unanimousX = x;
+        } else if(x != unanimousX or unanimousCounts[strand] != 0) {
+            isUnanimous = false;
         }
+        unanimousCounts[strand] += c;
+    });
+    if(not consensusBase.isGap() and isUnanimous and
+        unanimousCounts[0] <= unanimousMaxCount and
+        unanimousCounts[1] <= unanimousMaxCount) {
+        const uint16_t consensusRepeat = unanimousRunlengths[unanimousRunlengthsIndex(
+            consensusBase.value, unanimousX, unanimousCounts[0], unanimousCounts[1])];
+        return Consensus(consensusBase, consensusRepeat);
+    }
+
+    // General case. The log likelihoods are only needed temporarily,
+    // so use a buffer on the stack if possible.
+    array<double, 128> logLikelihoodsBuffer;
+    vector<double> logLikelihoodsVector;
+    double* logLikelihoods = logLikelihoodsBuffer.data();
+    if(uint64_t(maxOutputRunlength) + 1 > logLikelihoodsBuffer.size()) {
+        logLikelihoodsVector.resize(maxOutputRunlength + 1);
+        logLikelihoods = logLikelihoodsVector.data();
     }
+    const uint16_t consensusRepeat = max(uint16_t(1),
+        computeLogLikelihoods(coverage, consensusBase, logLikelihoods));
 
-    return Consensus(AlignedBase::fromInteger(consensusBase.value), consensusRepeat);
+    return Consensus(consensusBase, consensusRepeat);
 }
 
 
@@ -92,6 +92,26 @@ private:
     // priors p(Y) normalized for each Y, where X = observed and Y = True run length
     array<vector<double>, 2> priors;
 
+    // The same as probabilityMatrices, but transposed and stored contiguously.
+    // For each base, the probabilities for observed run length x are
+    // in positions x*(maxOutputRunlength+1) through x*(maxOutputRunlength+1)+maxOutputRunlength.
+    // Accumulating log likelihoods one observed run length at a time
+    // then becomes a loop over contiguous memory that the compiler can vectorize.
+    array<vector<double>, 4> transposedProbabilityMatrices;
+
+    // Precomputed predicted run lengths for unanimous columns,
+    // where all observations used have the same run length x
+    // (capped at maxInputRunlength).
+    // Indexed by [base][x][count on strand 0][count on strand 1],
+    // with counts up to unanimousMaxCount.
+    // This is the most common case when computing vertex consensus.
+    static const uint64_t unanimousMaxCount = 31;
+    vector<uint16_t> unanimousRunlengths;
+    uint64_t unanimousRunlengthsIndex(uint64_t base, uint64_t x, uint64_t c0, uint64_t c1) const
+    {
+        return ((base * (maxInputRunlength + 1) + x) * (unanimousMaxCount + 1) + c0) * (unanimousMaxCount + 1) + c1;
+    }
+
     /// ----- Methods ----- ///
 
     // Attempt to construct interpreting the constructor string as
@@ -118,9 +138,21 @@ private:
     // For a given vector of likelihoods over each Y value, normalize by the maximum
     void normalizeLikelihoods(vector<double>& x, double xMax) const;
 
-    // Count the number of times each unique repeat was observed, to reduce redundancy in calculating log likelihoods
-    void factorRepeats(array<std::map<uint16_t, uint16_t>, 2>& factoredRepeats, const Coverage& coverage) const;
-    void factorRepeats(array<std::map<uint16_t, uint16_t>, 2>& factoredRepeats, const Coverage& coverage, AlignedBase consensusBase) const;
+    // Fill transposedProbabilityMatrices and unanimousRunlengths.
+    void createTables();
+
+    // Call f(strand, x, c) for each observed run length x and the number of times c
+    // it was observed on each strand, in order of strand and then x.
+    // Depending on ignoreNonConsensusBaseRepeats, only observations for the consensus base are used.
+    // Depending on countGapsAsZeros, gaps are counted as x = 0.
+    // This uses the coverage counts stored in the Coverage object
+    // and does not allocate memory.
+    template<class F> void factorRepeats(const Coverage&, AlignedBase consensusBase, F f) const;
+
+    // Store in logLikelihoodY the log likelihood of each true run length,
+    // and return the most likely one (before normalization).
+    // logLikelihoodY must have size at least maxOutputRunlength+1.
+    uint16_t computeLogLikelihoods(const Coverage&, AlignedBase consensusBase, double* logLikelihoodY) const;
 
     // For debugging or exporting
     void printPriors(char separator);
@@ -0,0 +1,123 @@
+// Shasta.
+#include "SparseKmerTable.hpp"
+#include "deduplicate.hpp"
+#include "SHASTA_ASSERT.hpp"
+using namespace shasta;
+
+// Standard library.
+#include "stdexcept.hpp"
+
+
+
+string SparseKmerTable::kmersName(const string& name)
+{
+    return name.empty() ? name : (name + "-Kmers");
+}
+string SparseKmerTable::directoryName(const string& name)
+{
+    return name.empty() ? name : (name + "-Directory");
+}
+
+
+
+void SparseKmerTable::createNew(const string& name, uint64_t pageSize)
+{
+    kmers.createNew(kmersName(name), pageSize);
+    directory.createNew(directoryName(name), pageSize);
+    directory.resize(2);
+    directory[0] = 0;
+    directory[1] = 0;
+    shift = 0;
+    k = 0;
+}
+
+
+
+void SparseKmerTable::accessExistingReadOnly(const string& name, uint64_t kArgument)
+{
+    k = kArgument;
+    kmers.accessExistingReadOnly(kmersName(name));
+    directory.accessExistingReadOnly(directoryName(name));
+
+    // Recover the number of directory bits from the size of the directory.
+    SHASTA_ASSERT(directory.size() >= 2);
+    const uint64_t directoryBucketCount = directory.size() - 1;
+    SHASTA_ASSERT((directoryBucketCount & (directoryBucketCount - 1)) == 0);
+    const uint64_t directoryBits = __builtin_ctzll(directoryBucketCount);
+    SHASTA_ASSERT(directoryBits <= 2 * k);
+    shift = 2 * k - directoryBits;
+    SHASTA_ASSERT(directory.back() == kmers.size());
+}
+
+
+
+void SparseKmerTable::remove()
+{
+    if(kmers.isOpen) {
+        kmers.remove();
+    }
+    if(directory.isOpen) {
+        directory.remove();
+    }
+}
+
+
+
+void SparseKmerTable::store(uint64_t kArgument, vector<KmerId64>& kmerIds)
+{
+    k = kArgument;
+    SHASTA_ASSERT(k > 0);
+    SHASTA_ASSERT(k <= maxSparseKmerLength);
+
+    // Add the reverse complements, then sort and deduplicate.
+    const uint64_t n = kmerIds.size();
+    kmerIds.reserve(2 * n);
+    for(uint64_t i=0; i<n; i++) {
+        const KmerId64 kmerId = kmerIds[i];
+        SHASTA_ASSERT((kmerId >> (2 * k)) == 0);
+        kmerIds.push_back(Kmer64(kmerId, k).reverseComplement(k).id(k));
+    }
+    deduplicate(kmerIds);
+
+    // The index of each k-mer is used as its KmerId in markers,
+    // so it must fit in a KmerId.
+    if(kmerIds.size() > uint64_t(std::numeric_limits<KmerId>::max())) {
+        throw runtime_error("Too many marker k-mers for the sparse k-mer table: " +
+            to_string(kmerIds.size()));
+    }
+
+    // Store the sorted KmerId64.
+    kmers.resize(kmerIds.size());
+    copy(kmerIds.begin(), kmerIds.end(), kmers.begin());
+
+    // Choose the number of directory bits so there are
+    // on average no more than 4 marker k-mers per directory entry.
+    uint64_t directoryBits = 0;
+    while((directoryBits < 2 * k) and ((4ULL << directoryBits) < kmers.size())) {
+        ++directoryBits;
+    }
+    shift = 2 * k - directoryBits;
+
+    // Fill in the directory.
+    const uint64_t directoryBucketCount = 1ULL << directoryBits;
+    directory.resize(directoryBucketCount + 1);
+    uint64_t i = 0;
+    for(uint64_t directoryIndex=0; directoryIndex<directoryBucketCount; directoryIndex++) {
+        directory[directoryIndex] = i;
+        while((i < kmers.size()) and ((kmers[i] >> shift) == directoryIndex)) {
+            ++i;
+        }
+    }
+    SHASTA_ASSERT(i == kmers.size());
+    directory[directoryBucketCount] = i;
+}
+
+
+
+uint64_t SparseKmerTable::getReverseComplementIndex(uint64_t index) const
+{
+    const uint64_t reverseComplementIndex =
+        find(Kmer64(kmers[index], k).reverseComplement(k).id(k));
+    SHASTA_ASSERT(reverseComplementIndex != invalidIndex);
+    return reverseComplementIndex;
+}
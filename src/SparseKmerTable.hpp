@@ -0,0 +1,164 @@
+#ifndef SHASTA_SPARSE_KMER_TABLE_HPP
+#define SHASTA_SPARSE_KMER_TABLE_HPP
+
+/*******************************************************************************
+
+Class SparseKmerTable stores the set of k-mers selected as markers
+without storing information for all 4^k k-mers of length k,
+as the dense k-mer table (Assembler::kmerTable) does.
+Its memory usage is proportional to the number of marker k-mers
+rather than to 4^k. This makes it possible to use k-mers
+longer than Kmer::capacity, up to maxSparseKmerLength bases.
+
+The KmerId64 of all marker k-mers, as computed by Kmer64::id(k),
+are stored sorted. When the sparse k-mer table is in use,
+the KmerId stored in each marker is the index of its k-mer
+in this sorted vector, so KmerId remains a 32-bit integer
+regardless of k. Use getKmer to obtain the k-mer for a KmerId.
+
+To speed up lookups, a directory indexed by the most significant
+bits of the KmerId64 gives the range of marker KmerId64
+beginning with those bits. The number of directory bits is chosen
+so there are on average a few marker k-mers per directory entry.
+A lookup then consists of a directory access followed
+by a binary search in a very short range of KmerId64.
+
+As for the dense k-mer table, a k-mer is a marker
+if and only if its reverse complement is also a marker.
+
+*******************************************************************************/
+
+#include "Kmer.hpp"
+#include "MemoryMappedVector.hpp"
+
+#include "algorithm.hpp"
+#include "cstdint.hpp"
+#include <limits>
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace shasta {
+    class SparseKmerTable;
+
+    // Return the k-mer corresponding to the KmerId stored in a marker.
+    // If sparseKmerTable is not 0, the KmerId is the index of the k-mer
+    // in the sparse k-mer table. Otherwise, it is the id
+    // of the k-mer, as computed by Kmer::id(k).
+    inline Kmer64 getMarkerKmer(KmerId, uint64_t k, const SparseKmerTable* sparseKmerTable);
+}
+
+
+
+class shasta::SparseKmerTable {
+public:
+
+    // Create a new, empty table.
+    // If name is empty, anonymous memory is used.
+    void createNew(const string& name, uint64_t pageSize);
+
+    // Access an existing table.
+    void accessExistingReadOnly(const string& name, uint64_t k);
+
+    void remove();
+
+    bool isOpen() const
+    {
+        return kmers.isOpen and directory.isOpen;
+    }
+
+    // Store the marker k-mers. The vector passed in does not need
+    // to be sorted and can contain duplicates.
+    // On return, it also contains the reverse complement of
+    // each k-mer and is sorted and deduplicated.
+    void store(uint64_t k, vector<KmerId64>&);
+
+    // The number of marker k-mers, including reverse complements.
+    uint64_t size() const
+    {
+        return kmers.size();
+    }
+
+    // Access the marker KmerId64, sorted.
+    const KmerId64* begin() const
+    {
+        return kmers.begin();
+    }
+    const KmerId64* end() const
+    {
+        return kmers.end();
+    }
+
+    // Return the index of a k-mer in the sorted vector of marker
+    // k-mers, or invalidIndex if the k-mer is not a marker.
+    // The index is the KmerId used for the k-mer in markers.
+    static const uint64_t invalidIndex = std::numeric_limits<uint64_t>::max();
+    uint64_t find(KmerId64 kmerId) const
+    {
+        const uint64_t directoryIndex = kmerId >> shift;
+        const KmerId64* b = kmers.begin() + directory[directoryIndex];
+        const KmerId64* e = kmers.begin() + directory[directoryIndex + 1];
+        const KmerId64* it = std::lower_bound(b, e, kmerId);
+        if(it == e or *it != kmerId) {
+            return invalidIndex;
+        }
+        return it - kmers.begin();
+    }
+
+    bool isMarker(KmerId64 kmerId) const
+    {
+        return find(kmerId) != invalidIndex;
+    }
+
+    // Return the KmerId64 or the k-mer for a given index.
+    KmerId64 getKmerId64(uint64_t index) const
+    {
+        return kmers[index];
+    }
+    Kmer64 getKmer(uint64_t index) const
+    {
+        return Kmer64(kmers[index], k);
+    }
+
+    // Return the index of the reverse complement of the k-mer
+    // with a given index.
+    uint64_t getReverseComplementIndex(uint64_t index) const;
+
+private:
+
+    // The length of the k-mers.
+    uint64_t k = 0;
+
+    // The KmerId64 of the marker k-mers, sorted.
+    MemoryMapped::Vector<KmerId64> kmers;
+
+    // Entry i of the directory contains the index in kmers
+    // of the first KmerId64 whose most significant bits are
+    // greater than or equal to i.
+    // Its size is 2^b+1, where b is the number of directory bits.
+    MemoryMapped::Vector<uint64_t> directory;
+
+    // The number of bits a KmerId64 is shifted right by
+    // to obtain its directory index. This equals 2k-b.
+    uint64_t shift = 0;
+
+    static string kmersName(const string& name);
+    static string directoryName(const string& name);
+};
+
+
+
+inline shasta::Kmer64 shasta::getMarkerKmer(
+    KmerId kmerId,
+    uint64_t k,
+    const SparseKmerTable* sparseKmerTable)
+{
+    if(sparseKmerTable) {
+        return sparseKmerTable->getKmer(kmerId);
+    } else {
+        return Kmer64(kmerId, k);
+    }
+}
+
+
+
+#endif
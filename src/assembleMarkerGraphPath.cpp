@@ -1,5 +1,6 @@
 #include "assembleMarkerGraphPath.hpp"
 #include "AssembledSegment.hpp"
+#include "SparseKmerTable.hpp"
 using namespace shasta;
 
 
@@ -8,11 +9,25 @@ void shasta::assembleMarkerGraphPath(
     uint64_t readRepresentation,
     uint64_t k,
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    const SparseKmerTable* sparseKmerTable,
     const MarkerGraph& markerGraph,
     const span<const MarkerGraph::EdgeId>& markerGraphPath,
     bool storeCoverageData,
-    AssembledSegment& assembledSegment)
+    AssembledSegment& assembledSegment,
+    const vector< vector< pair<Base, uint8_t> > >* edgeConsensus,
+    const vector<uint8_t>* edgeConsensusOverlappingBaseCount)
 {
+    if(edgeConsensus) {
+        SHASTA_ASSERT(edgeConsensusOverlappingBaseCount);
+        SHASTA_ASSERT(edgeConsensus->size() == markerGraphPath.size());
+        SHASTA_ASSERT(edgeConsensusOverlappingBaseCount->size() == markerGraphPath.size());
+    } else {
+        if(not markerGraph.edgeConsensus.isOpen() or
+            not markerGraph.edgeConsensusOverlappingBaseCount.isOpen) {
+            throw runtime_error("Consensus for marker graph edges is not available.");
+        }
+    }
+
     assembledSegment.clear();
     assembledSegment.k = k;
 
@@ -56,7 +71,7 @@ void shasta::assembleMarkerGraphPath(
         const MarkerId firstMarkerId = markerGraph.getVertexMarkerIds(assembledSegment.vertexIds[i])[0];
         const CompressedMarker& firstMarker = markers.begin()[firstMarkerId];
         const KmerId kmerId = firstMarker.kmerId;
-        const Kmer kmer(kmerId, k);
+        const Kmer64 kmer = getMarkerKmer(kmerId, k, sparseKmerTable);
 
         if(readRepresentation == 1) {
 
@@ -93,7 +108,9 @@ void shasta::assembleMarkerGraphPath(
     assembledSegment.edgeOverlappingBaseCounts.resize(assembledSegment.edgeCount);
     for(size_t i=0; i<assembledSegment.edgeCount; i++) {
 
-        const auto& storedConsensus = markerGraph.edgeConsensus[assembledSegment.edgeIds[i]];
+        const span<const pair<Base, uint8_t> > storedConsensus = edgeConsensus ?
+            span<const pair<Base, uint8_t> >((*edgeConsensus)[i].data(), (*edgeConsensus)[i].data() + (*edgeConsensus)[i].size()) :
+            makeSpanOfConst(markerGraph.edgeConsensus[assembledSegment.edgeIds[i]]);
         assembledSegment.edgeSequences[i].resize(storedConsensus.size());
         assembledSegment.edgeRepeatCounts[i].resize(storedConsensus.size());
         for(size_t j=0; j<storedConsensus.size(); j++) {
@@ -104,7 +121,8 @@ void shasta::assembleMarkerGraphPath(
                 assembledSegment.edgeRepeatCounts[i][j] = 1;
             }
         }
-        assembledSegment.edgeOverlappingBaseCounts[i] =
+        assembledSegment.edgeOverlappingBaseCounts[i] = edgeConsensusOverlappingBaseCount ?
+            (*edgeConsensusOverlappingBaseCount)[i] :
             markerGraph.edgeConsensusOverlappingBaseCount[assembledSegment.edgeIds[i]];
     }
 
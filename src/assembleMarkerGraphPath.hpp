@@ -5,18 +5,33 @@
 #include "MarkerGraph.hpp"
 #include "span.hpp"
 
+#include "utility.hpp"
+#include "vector.hpp"
+
 namespace shasta {
 
     class AssembledSegment;
-
+    class SparseKmerTable;
+
+    // The sparse k-mer table must be specified if it is in use,
+    // and is used to get the k-mers of the vertices of the path.
+    // The consensus of the marker graph edges of the path is normally
+    // obtained from markerGraph.edgeConsensus and
+    // markerGraph.edgeConsensusOverlappingBaseCount.
+    // If edgeConsensus and edgeConsensusOverlappingBaseCount are specified,
+    // they are used instead. They are indexed by position in the path
+    // and contain the same information that would be stored in the marker graph.
     void assembleMarkerGraphPath(
         uint64_t readRepresentation,
         uint64_t k,
         const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+        const SparseKmerTable*,
         const MarkerGraph&,
         const span<const MarkerGraph::EdgeId>& markerGraphPath,
         bool storeCoverageData,
-        AssembledSegment& assembledSegment);
+        AssembledSegment& assembledSegment,
+        const vector< vector< pair<Base, uint8_t> > >* edgeConsensus = 0,
+        const vector<uint8_t>* edgeConsensusOverlappingBaseCount = 0);
 
 }
 
@@ -73,66 +73,13 @@ void shasta::compress(const Alignment& alignment, string& s)
 void shasta::decompress(span<const char> s, Alignment& alignment)
 {
     alignment.clear();
-    uint32_t ordinal0 = 0;
-    uint32_t ordinal1 = 0;
-    
-    size_t pos = 0;
-    while (pos < s.size()) {
-        uint32_t streakSize;
-        int32_t skip0, skip1;
-
-        uint8_t formatIdentifier = compressAlignment::extractFormatIdentifier(s[pos]);
-        if (formatIdentifier == Format0::id) {
-            // Format0
-            Format0 const *f0 = reinterpret_cast<Format0*>(const_cast<char*>(&s[pos]));
-            pos += sizeof(Format0);
-            skip0 = f0->skip0;
-            skip1 = f0->skip1;
-            streakSize = f0->n();
-            
-        } else if (formatIdentifier == Format1::id) {
-            // Format1
-            Format1 const *f1 = reinterpret_cast<Format1*>(const_cast<char*>(&s[pos]));
-            pos += sizeof(Format1);
-            skip0 = f1->skip0;
-            skip1 = f1->skip1;
-            streakSize = f1->n();
-            
-        } else if (formatIdentifier == Format2::id) {
-            // Format2
-            Format2 const *f2 = reinterpret_cast<Format2*>(const_cast<char*>(&s[pos]));
-            pos += sizeof(Format2);
-            skip0 = f2->skip0;
-            skip1 = f2->skip1;
-            streakSize = f2->n();
-
-        } else if (formatIdentifier == Format3::id) {
-            // Format3
-            Format3 const *f3 = reinterpret_cast<Format3*>(const_cast<char*>(&s[pos]));
-            pos += sizeof(Format3);
-            skip0 = f3->skip0;
-            skip1 = f3->skip1;
-            streakSize = f3->n();
-
-        } else {
-            // Format4
-            Format4 const *f4 = reinterpret_cast<Format4*>(const_cast<char*>(&s[pos]));
-            pos += sizeof(Format4);
-            skip0 = f4->skip0;
-            skip1 = f4->skip1;
-            streakSize = f4->n();
-        }
 
-        // cout << "(Skip0, Skip1, N) = (" << skip0 << ", " << skip1 << ", " << streakSize << ")" << endl;
-       
-        ordinal0 += skip0;
-        ordinal1 += skip1;
-        for(uint32_t i = 0; i < streakSize; i++) {
-            alignment.ordinals.push_back(array<uint32_t, 2>({ordinal0+i, ordinal1+i}));
+    StreakDecoder decoder(s);
+    Streak streak;
+    while(decoder.next(streak)) {
+        for(uint32_t i = 0; i < streak.n; i++) {
+            alignment.ordinals.push_back(array<uint32_t, 2>({streak.ordinal0+i, streak.ordinal1+i}));
         }
-
-        ordinal0 += (streakSize-1);
-        ordinal1 += (streakSize-1);
     }
 }
 
@@ -70,6 +70,11 @@ that can be represented.                   0      -8     -512   -2^19   -2^31
 Maximum value of skip0 and skip1
 that can be represented                    3       7      511   2^19-1  2^31-1
 
+Code that only needs to loop once over the aligned marker pairs
+should use class StreakDecoder or class OrdinalPairDecoder,
+which decode the compressed bytes on the fly without
+allocating memory, instead of calling decompress.
+
 *******************************************************************************/
 
 // Shasta.
@@ -94,6 +99,10 @@ namespace shasta {
         class Format4;
 
         uint8_t extractFormatIdentifier(const char);
+
+        class Streak;
+        class StreakDecoder;
+        class OrdinalPairDecoder;
     }
 }
 
@@ -320,4 +329,147 @@ public:
 static_assert(sizeof(shasta::compressAlignment::Format4) == 16,
     "Unexpected size for shasta::compressAlignment::Format4");
 
+
+
+// A streak of a marker alignment, as decoded by StreakDecoder.
+// It consists of the n marker pairs (ordinal0+i, ordinal1+i), for i in [0, n).
+class shasta::compressAlignment::Streak {
+public:
+    uint32_t ordinal0;
+    uint32_t ordinal1;
+    uint32_t n;
+};
+
+
+
+// Streaming decoder that returns the streaks of a compressed alignment
+// one at a time, without allocating memory.
+// Usage:
+//     StreakDecoder decoder(compressedAlignment);
+//     Streak streak;
+//     while(decoder.next(streak)) {
+//         ...
+//     }
+class shasta::compressAlignment::StreakDecoder {
+public:
+    StreakDecoder(span<const char> s) :
+        p(s.begin()), end(s.end()) {}
+
+    // Decode the next streak.
+    // Returns false if there are no more streaks.
+    bool next(Streak& streak)
+    {
+        if(p == end) {
+            return false;
+        }
+
+        // Every odd 3-bit pattern is a valid identifier,
+        // so the least significant bits of the first byte
+        // always identify one of the five formats.
+        int32_t skip0;
+        int32_t skip1;
+        uint32_t n;
+        const uint8_t c = uint8_t(*p);
+        if((c & Format0::idMask) == Format0::id) {
+            const Format0& f = *reinterpret_cast<const Format0*>(p);
+            skip0 = f.skip0;
+            skip1 = f.skip1;
+            n = f.n();
+            p += sizeof(Format0);
+        } else {
+            switch(c & Format1::idMask) {
+            case Format1::id:
+                {
+                    const Format1& f = *reinterpret_cast<const Format1*>(p);
+                    skip0 = f.skip0;
+                    skip1 = f.skip1;
+                    n = f.n();
+                    p += sizeof(Format1);
+                }
+                break;
+            case Format2::id:
+                {
+                    const Format2& f = *reinterpret_cast<const Format2*>(p);
+                    skip0 = f.skip0;
+                    skip1 = f.skip1;
+                    n = f.n();
+                    p += sizeof(Format2);
+                }
+                break;
+            case Format3::id:
+                {
+                    const Format3& f = *reinterpret_cast<const Format3*>(p);
+                    skip0 = int32_t(f.skip0);
+                    skip1 = int32_t(f.skip1);
+                    n = f.n();
+                    p += sizeof(Format3);
+                }
+                break;
+            default:
+                {
+                    const Format4& f = *reinterpret_cast<const Format4*>(p);
+                    skip0 = f.skip0;
+                    skip1 = f.skip1;
+                    n = f.n();
+                    p += sizeof(Format4);
+                }
+                break;
+            }
+        }
+
+        // The skips are relative to the last pair of the previous streak.
+        streak.ordinal0 = uint32_t(int32_t(lastOrdinal0) + skip0);
+        streak.ordinal1 = uint32_t(int32_t(lastOrdinal1) + skip1);
+        streak.n = n;
+        lastOrdinal0 = streak.ordinal0 + (n - 1);
+        lastOrdinal1 = streak.ordinal1 + (n - 1);
+        return true;
+    }
+
+private:
+    const char* p;
+    const char* end;
+
+    // The last marker pair of the previous streak, or (0, 0)
+    // before the first streak.
+    uint32_t lastOrdinal0 = 0;
+    uint32_t lastOrdinal1 = 0;
+};
+
+
+
+// Streaming decoder that returns the marker pairs of a compressed alignment
+// one at a time, without allocating memory.
+// Usage:
+//     OrdinalPairDecoder decoder(compressedAlignment);
+//     array<uint32_t, 2> ordinals;
+//     while(decoder.next(ordinals)) {
+//         ...
+//     }
+class shasta::compressAlignment::OrdinalPairDecoder {
+public:
+    OrdinalPairDecoder(span<const char> s) : streakDecoder(s) {}
+
+    // Return the next marker pair.
+    // Returns false if there are no more pairs.
+    bool next(array<uint32_t, 2>& ordinals)
+    {
+        if(i == streak.n) {
+            if(not streakDecoder.next(streak)) {
+                return false;
+            }
+            i = 0;
+        }
+        ordinals[0] = streak.ordinal0 + i;
+        ordinals[1] = streak.ordinal1 + i;
+        ++i;
+        return true;
+    }
+
+private:
+    StreakDecoder streakDecoder;
+    Streak streak = {0, 0, 0};
+    uint32_t i = 0;
+};
+
 #endif
@@ -131,6 +131,32 @@ public:
         return id;
     }
 
+    // Store the set representative of id in its parent (lower 64 bits),
+    // and also in the parent of every entry on the path from id to its representative.
+    // This can only be used after all calls to unite are complete.
+    // At that point set representatives no longer change,
+    // and concurrent calls only replace a parent with another entry
+    // on the same path to the same representative.
+    // So, unlike `find`, a single pass over all ids is guaranteed
+    // to leave the representative in the parent of every entry.
+    // Only the lower 64 bits are accessed, using 64-bit atomics.
+    Uint linkToRepresentative(Uint id) {
+        Uint representative = id;
+        for (;;) {
+            const Uint p = loadParent(representative);
+            if (p == representative)
+                break;
+            representative = p;
+        }
+        while (id != representative) {
+            const Uint p = loadParent(id);
+            if (p != representative)
+                __atomic_store_n(parentPointer(id), representative, __ATOMIC_RELAXED);
+            id = p;
+        }
+        return representative;
+    }
+
     bool same(Uint id1, Uint id2) {
         for (;;) {
             id1 = find(id1);
@@ -185,6 +211,15 @@ public:
         return (Uint) mData[id];
     }
 
+    // Access to the parent (lower 64 bits) of an entry.
+    // This assumes a little endian platform.
+    Uint* parentPointer(Uint id) const {
+        return reinterpret_cast<Uint*>(mData + id);
+    }
+    Uint loadParent(Uint id) const {
+        return __atomic_load_n(parentPointer(id), __ATOMIC_RELAXED);
+    }
+
     // Use memory supplied by the caller, rather than an owned vector.
     // This provides more flexibility in allocating the memory.
     Aint* mData;
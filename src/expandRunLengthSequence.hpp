@@ -0,0 +1,106 @@
+#ifndef SHASTA_EXPAND_RUN_LENGTH_SEQUENCE_HPP
+#define SHASTA_EXPAND_RUN_LENGTH_SEQUENCE_HPP
+
+// Shasta.
+#include "LongBaseSequence.hpp"
+#include "SHASTA_ASSERT.hpp"
+#include "span.hpp"
+
+// Standard library.
+#include "algorithm.hpp"
+#include "cstdint.hpp"
+#include <cstring>
+#include "string.hpp"
+
+namespace shasta {
+
+    // Append to a string the raw sequence corresponding to a
+    // run-length sequence, optionally reverse complemented.
+    // This is equivalent to writing each base repeatCounts[i] times,
+    // but it decodes the bases one 64-base block at a time and
+    // writes each run with a single 8-byte store taken from a table
+    // of replicated characters (or memset for runs longer than 8).
+    // To allow the 8-byte stores, the string is temporarily
+    // extended by 8 bytes past the end of the sequence.
+    inline void appendRunLengthExpandedSequence(
+        const LongBaseSequenceView& sequence,
+        const span<const uint8_t>& repeatCounts,
+        bool reverseComplement,
+        string&);
+}
+
+
+
+inline void shasta::appendRunLengthExpandedSequence(
+    const LongBaseSequenceView& sequence,
+    const span<const uint8_t>& repeatCounts,
+    bool reverseComplement,
+    string& s)
+{
+    // Each entry contains 8 copies of the character for a base value.
+    static const uint64_t replicatedCharacters[4] = {
+        0x4141414141414141ULL,  // A
+        0x4343434343434343ULL,  // C
+        0x4747474747474747ULL,  // G
+        0x5454545454545454ULL   // T
+    };
+
+    const uint64_t baseCount = sequence.baseCount;
+    SHASTA_ASSERT(repeatCounts.size() == baseCount);
+
+    // Compute the raw length.
+    uint64_t rawLength = 0;
+    for(const uint8_t repeatCount: repeatCounts) {
+        rawLength += repeatCount;
+    }
+
+    const uint64_t oldSize = s.size();
+    s.resize(oldSize + rawLength + 8);
+    char* p = s.data() + oldSize;
+
+    // Write a run of repeatCount copies of a base.
+    auto writeRun = [&p](uint64_t value, uint8_t repeatCount)
+    {
+        const uint64_t word = replicatedCharacters[value];
+        if(repeatCount <= 8) {
+            std::memcpy(p, &word, 8);
+        } else {
+            std::memset(p, int(word & 0xff), repeatCount);
+        }
+        p += repeatCount;
+    };
+
+    if(not reverseComplement) {
+
+        // Loop over blocks of 64 bases.
+        // See LongBaseSequenceView for the representation.
+        for(uint64_t blockBegin=0; blockBegin<baseCount; blockBegin+=64) {
+            const uint64_t* words = sequence.begin + (blockBegin >> 5ULL);
+            uint64_t word0 = words[0];
+            uint64_t word1 = words[1];
+            const uint64_t blockEnd = min(baseCount, blockBegin + 64);
+            for(uint64_t i=blockBegin; i!=blockEnd; i++) {
+                const uint64_t value = ((word1 >> 62ULL) & 2ULL) | (word0 >> 63ULL);
+                word0 <<= 1ULL;
+                word1 <<= 1ULL;
+                writeRun(value, repeatCounts[i]);
+            }
+        }
+
+    } else {
+
+        // Same, but looping backward and complementing.
+        for(uint64_t i=baseCount; i!=0; ) {
+            --i;
+            const uint64_t* words = sequence.begin + ((i >> 6ULL) << 1ULL);
+            const uint64_t bitIndex = 63ULL - (i & 63ULL);
+            const uint64_t value = (((words[1] >> bitIndex) & 1ULL) << 1ULL) | ((words[0] >> bitIndex) & 1ULL);
+            writeRun(3ULL - value, repeatCounts[i]);
+        }
+    }
+
+    SHASTA_ASSERT(uint64_t(p - s.data()) == oldSize + rawLength);
+    s.resize(oldSize + rawLength);
+}
+
+#endif
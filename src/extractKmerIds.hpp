@@ -0,0 +1,141 @@
+#ifndef SHASTA_EXTRACT_KMER_IDS_HPP
+#define SHASTA_EXTRACT_KMER_IDS_HPP
+
+// Shasta.
+#include "Kmer.hpp"
+#include "LongBaseSequence.hpp"
+#include "SHASTA_ASSERT.hpp"
+
+// Standard library.
+#include "algorithm.hpp"
+#include <limits>
+#include "vector.hpp"
+
+namespace shasta {
+
+    // Compute the KmerIds of all k-mers of a sequence.
+    // On return, kmerIds[i] is the KmerId of the k-mer
+    // that begins at position i, the same as would be computed
+    // using Kmer::id(k), and reverseComplementedKmerIds[i]
+    // is the KmerId of its reverse complement.
+    // If the sequence is shorter than k, the vectors are returned empty.
+    // Id can be KmerId, or KmerId64 for the longer k-mers
+    // supported by the sparse k-mer table.
+    template<class Id> inline void extractKmerIds(
+        const LongBaseSequenceView&,
+        uint64_t k,
+        vector<Id>& kmerIds);
+    template<class Id> inline void extractKmerIds(
+        const LongBaseSequenceView&,
+        uint64_t k,
+        vector<Id>& kmerIds,
+        vector<Id>& reverseComplementedKmerIds);
+
+    template<class Id, bool computeReverseComplement> void extractKmerIdsTemplate(
+        const LongBaseSequenceView&,
+        uint64_t k,
+        vector<Id>& kmerIds,
+        vector<Id>* reverseComplementedKmerIds);
+}
+
+
+
+// A KmerId, as computed by ShortBaseSequence::id, consists of the
+// k bits of the MSB bit plane followed by the k bits of the LSB bit plane,
+// with the first base in the most significant position.
+// LongBaseSequenceView stores the same bit planes, 64 bases per pair of words,
+// so we can roll the KmerId along the sequence by shifting in one bit
+// from each bit plane, without extracting individual bases.
+// The reverse complement is rolled in the opposite direction,
+// complementing each base by flipping both of its bits.
+template<class Id, bool computeReverseComplement> inline void shasta::extractKmerIdsTemplate(
+    const LongBaseSequenceView& sequence,
+    uint64_t k,
+    vector<Id>& kmerIds,
+    vector<Id>* reverseComplementedKmerIds)
+{
+    SHASTA_ASSERT(k > 0);
+    SHASTA_ASSERT(2 * k <= uint64_t(std::numeric_limits<Id>::digits));
+
+    const uint64_t baseCount = sequence.baseCount;
+    if(baseCount < k) {
+        kmerIds.clear();
+        if(computeReverseComplement) {
+            reverseComplementedKmerIds->clear();
+        }
+        return;
+    }
+    const uint64_t kmerCount = baseCount + 1 - k;
+    kmerIds.resize(kmerCount);
+    Id* kmerIdPointer = kmerIds.data();
+    Id* reverseComplementedKmerIdPointer = 0;
+    if(computeReverseComplement) {
+        reverseComplementedKmerIds->resize(kmerCount);
+        reverseComplementedKmerIdPointer = reverseComplementedKmerIds->data();
+    }
+
+    const uint64_t mask = (1ULL << k) - 1ULL;
+    const uint64_t highShift = k - 1;
+
+    // The k bits of each of the two bit planes for the current k-mer
+    // and its reverse complement.
+    uint64_t lsb = 0;
+    uint64_t msb = 0;
+    uint64_t lsbRc = 0;
+    uint64_t msbRc = 0;
+
+    // Loop over blocks of 64 bases.
+    const uint64_t* word = sequence.begin;
+    for(uint64_t blockBegin=0; blockBegin<baseCount; blockBegin+=64, word+=2) {
+        uint64_t word0 = word[0];
+        uint64_t word1 = word[1];
+        const uint64_t blockEnd = min(baseCount, blockBegin + 64);
+
+        for(uint64_t position=blockBegin; position!=blockEnd; position++) {
+
+            // Shift in the bits for the base at this position.
+            const uint64_t bit0 = word0 >> 63;
+            const uint64_t bit1 = word1 >> 63;
+            word0 <<= 1;
+            word1 <<= 1;
+            lsb = ((lsb << 1) | bit0) & mask;
+            msb = ((msb << 1) | bit1) & mask;
+            if(computeReverseComplement) {
+                lsbRc = (lsbRc >> 1) | ((bit0 ^ 1ULL) << highShift);
+                msbRc = (msbRc >> 1) | ((bit1 ^ 1ULL) << highShift);
+            }
+
+            // If we have a complete k-mer, store it.
+            if(position >= highShift) {
+                const uint64_t kmerIndex = position - highShift;
+                kmerIdPointer[kmerIndex] = Id((msb << k) | lsb);
+                if(computeReverseComplement) {
+                    reverseComplementedKmerIdPointer[kmerIndex] = Id((msbRc << k) | lsbRc);
+                }
+            }
+        }
+    }
+}
+
+
+
+template<class Id> inline void shasta::extractKmerIds(
+    const LongBaseSequenceView& sequence,
+    uint64_t k,
+    vector<Id>& kmerIds)
+{
+    extractKmerIdsTemplate<Id, false>(sequence, k, kmerIds, 0);
+}
+
+
+
+template<class Id> inline void shasta::extractKmerIds(
+    const LongBaseSequenceView& sequence,
+    uint64_t k,
+    vector<Id>& kmerIds,
+    vector<Id>& reverseComplementedKmerIds)
+{
+    extractKmerIdsTemplate<Id, true>(sequence, k, kmerIds, &reverseComplementedKmerIds);
+}
+
+#endif
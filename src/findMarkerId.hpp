@@ -5,6 +5,7 @@
 #include "MemoryMappedVectorOfVectors.hpp"
 #include "ReadId.hpp"
 
+#include "algorithm.hpp"
 #include "cstdint.hpp"
 #include "tuple.hpp"
 #include "utility.hpp"
@@ -18,6 +19,27 @@ namespace shasta {
         MarkerId,
         const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers);
 
+    // Sampled reverse index of the markers toc.
+    // For each block of markerIdSampledTocBlockSize consecutive MarkerIds,
+    // markerIdSampledToc[b] is the OrientedReadId (as an integer)
+    // of the oriented read that contains
+    // MarkerId b * markerIdSampledTocBlockSize.
+    // This uses 4 bytes for every 256 markers (less than 0.4% of the
+    // space used by the markers) and restricts the search in the
+    // markers toc to the few oriented reads that overlap a block.
+    const uint64_t markerIdSampledTocShift = 8;
+    const uint64_t markerIdSampledTocBlockSize = 1ULL << markerIdSampledTocShift;
+    inline void createMarkerIdSampledToc(
+        const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+        MemoryMapped::Vector<OrientedReadId::Int>& markerIdSampledToc);
+
+    // Same as the above findMarkerId, but using the sampled toc.
+    // The result is identical.
+    inline pair<OrientedReadId, uint32_t> findMarkerId(
+        MarkerId,
+        const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+        const MemoryMapped::Vector<OrientedReadId::Int>& markerIdSampledToc);
+
 }
 
 
@@ -33,4 +55,61 @@ inline std::pair<shasta::OrientedReadId, uint32_t>
 }
 
 
+
+inline void shasta::createMarkerIdSampledToc(
+    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    MemoryMapped::Vector<OrientedReadId::Int>& markerIdSampledToc)
+{
+    const uint64_t markerCount = markers.totalSize();
+    const uint64_t blockCount =
+        (markerCount + markerIdSampledTocBlockSize - 1) >> markerIdSampledTocShift;
+    markerIdSampledToc.resize(blockCount);
+
+    // Loop over oriented reads. Each block is assigned to the
+    // oriented read that contains its first MarkerId.
+    // Oriented reads without markers never get a block.
+    const CompressedMarker* begin = markers.begin();
+    uint64_t b = 0;
+    for(uint64_t i=0; i<markers.size() and b<blockCount; i++) {
+        const uint64_t end = markers.end(i) - begin;
+        for(; b<blockCount and (b << markerIdSampledTocShift) < end; b++) {
+            markerIdSampledToc[b] = OrientedReadId::Int(i);
+        }
+    }
+    SHASTA_ASSERT(b == blockCount);
+}
+
+
+
+inline std::pair<shasta::OrientedReadId, uint32_t>
+    shasta::findMarkerId(
+    MarkerId markerId,
+    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    const MemoryMapped::Vector<OrientedReadId::Int>& markerIdSampledToc)
+{
+    // The oriented read that contains markerId is between the
+    // oriented reads that contain the first MarkerId of this block
+    // and of the next block.
+    const uint64_t b = markerId >> markerIdSampledTocShift;
+    SHASTA_ASSERT(b < markerIdSampledToc.size());
+    uint64_t first = markerIdSampledToc[b];
+    uint64_t last = (b + 1 < markerIdSampledToc.size()) ? markerIdSampledToc[b + 1] : markers.size() - 1;
+
+    // Find the last oriented read in this range that begins at or before markerId.
+    // Usually the range only contains one or two oriented reads.
+    const CompressedMarker* begin = markers.begin();
+    while(first < last) {
+        const uint64_t middle = (first + last + 1) / 2;
+        if(uint64_t(markers.begin(middle) - begin) <= markerId) {
+            first = middle;
+        } else {
+            last = middle - 1;
+        }
+    }
+    const uint64_t ordinal = markerId - uint64_t(markers.begin(first) - begin);
+    SHASTA_ASSERT(ordinal < markers.size(first));
+    return make_pair(OrientedReadId::fromValue(OrientedReadId::Int(first)), uint32_t(ordinal));
+}
+
+
 #endif
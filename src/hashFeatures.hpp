@@ -0,0 +1,109 @@
+#ifndef SHASTA_HASH_FEATURES_HPP
+#define SHASTA_HASH_FEATURES_HPP
+
+// Shasta.
+#include "Kmer.hpp"
+
+// Standard library.
+#include "vector.hpp"
+
+namespace shasta {
+
+    // Batched computation of the MurmurHash64A hashes of all features
+    // of an oriented read, where a feature is a sequence of m consecutive KmerIds.
+    // The hash of the feature that begins at position j is identical to
+    //     MurmurHash64A(kmerIds + j, int(m * sizeof(KmerId)), seed)
+    // but the work is organized differently:
+    // - MurmurHash64A processes its input in 8-byte blocks,
+    //   each consisting of two consecutive KmerIds, and the mixing
+    //   of each block does not depend on the seed or on the feature.
+    //   So the mixed blocks are computed once for each oriented read
+    //   and shared by all features and all seeds.
+    // - The features are then hashed together, one block at a time,
+    //   with an inner loop over features that has no dependencies
+    //   between iterations, so the compiler can pipeline or vectorize it.
+    // This assumes a little endian platform, like MurmurHash64A itself.
+    class FeatureHasher;
+}
+
+
+
+class shasta::FeatureHasher {
+public:
+
+    // Prepare to hash the features of a new sequence of KmerIds.
+    // This computes the mixed blocks and does not depend on m or the seed.
+    void setKmerIds(const KmerId* kmerIdsArgument, uint64_t kmerIdCountArgument)
+    {
+        kmerIds = kmerIdsArgument;
+        kmerIdCount = kmerIdCountArgument;
+        blocks.resize(kmerIdCount < 2 ? 0 : kmerIdCount - 1);
+        for(uint64_t i=0; i<blocks.size(); i++) {
+            uint64_t k = uint64_t(kmerIds[i]) | (uint64_t(kmerIds[i + 1]) << 32);
+            k *= M;
+            k ^= k >> r;
+            k *= M;
+            blocks[i] = k;
+        }
+    }
+
+    // Compute the hashes of all features of m consecutive KmerIds
+    // using the given seed. On return, hashes[j] is the hash
+    // of the feature that begins at position j.
+    // If there are fewer than m KmerIds, hashes is returned empty.
+    void computeHashes(uint64_t m, uint64_t seed, vector<uint64_t>& hashes) const
+    {
+        if(kmerIdCount < m) {
+            hashes.clear();
+            return;
+        }
+        const uint64_t featureCount = kmerIdCount - m + 1;
+        hashes.resize(featureCount);
+        uint64_t* h = hashes.data();
+
+        const uint64_t byteCount = m * sizeof(KmerId);
+        const uint64_t h0 = seed ^ (byteCount * M);
+        for(uint64_t j=0; j<featureCount; j++) {
+            h[j] = h0;
+        }
+
+        // Full 8-byte blocks.
+        const uint64_t blockCount = byteCount / 8;
+        for(uint64_t b=0; b<blockCount; b++) {
+            const uint64_t* featureBlocks = blocks.data() + 2 * b;
+            for(uint64_t j=0; j<featureCount; j++) {
+                h[j] = (h[j] ^ featureBlocks[j]) * M;
+            }
+        }
+
+        // If m is odd, the last KmerId is the 4-byte tail.
+        if(m & 1) {
+            const KmerId* tail = kmerIds + (m - 1);
+            for(uint64_t j=0; j<featureCount; j++) {
+                h[j] = (h[j] ^ uint64_t(tail[j])) * M;
+            }
+        }
+
+        // Finalization.
+        for(uint64_t j=0; j<featureCount; j++) {
+            uint64_t x = h[j];
+            x ^= x >> r;
+            x *= M;
+            x ^= x >> r;
+            h[j] = x;
+        }
+    }
+
+private:
+    static const uint64_t M = 0xc6a4a7935bd1e995ULL;
+    static const int r = 47;
+
+    const KmerId* kmerIds = 0;
+    uint64_t kmerIdCount = 0;
+
+    // The mixed 8-byte blocks.
+    // blocks[i] is obtained from kmerIds[i] and kmerIds[i+1].
+    vector<uint64_t> blocks;
+};
+
+#endif
@@ -285,6 +285,14 @@ void shasta::main::assemble(
         throw runtime_error("--Assembly.mode 2 requires --ReadGraph.strandSeparationMethod 2.");
     }
 
+    // Check minHashOptions.checkpointDirectory.
+    // It must be absolute because we change directory to the assembly directory.
+    if(not assemblerOptions.minHashOptions.checkpointDirectory.empty() and
+        assemblerOptions.minHashOptions.checkpointDirectory[0] != '/') {
+        throw runtime_error("Option --MinHash.checkpointDirectory must specify an absolute path. "
+            "A relative path is not accepted.");
+    }
+
     // Find absolute paths of the input files.
     // We will use them below after changing directory to the output directory.
     vector<string> inputFileAbsolutePaths;
@@ -545,6 +553,7 @@ void shasta::main::assemble(
             inputFileName,
             assemblerOptions.readsOptions.minReadLength,
             assemblerOptions.readsOptions.noCache,
+            assemblerOptions.readsOptions.streamingChunkSize,
             threadCount);
     }
 
@@ -591,21 +600,42 @@ void shasta::main::assemble(
 
 
     // Select the k-mers that will be used as markers.
+    const bool useSparseKmerTable = assemblerOptions.kmersOptions.sparseTable;
+    if(useSparseKmerTable and
+        (assemblerOptions.kmersOptions.generationMethod == 2 or
+        assemblerOptions.kmersOptions.generationMethod == 4)) {
+        throw runtime_error("--Kmers.sparseTable is not supported for "
+            "--Kmers.generationMethod " +
+            to_string(assemblerOptions.kmersOptions.generationMethod) + ".");
+    }
     switch(assemblerOptions.kmersOptions.generationMethod) {
     case 0:
-        assembler.randomlySelectKmers(
-            assemblerOptions.kmersOptions.k,
-            assemblerOptions.kmersOptions.probability, 231);
+        if(useSparseKmerTable) {
+            assembler.randomlySelectKmersSparse(
+                assemblerOptions.kmersOptions.k,
+                assemblerOptions.kmersOptions.probability, 231, threadCount);
+        } else {
+            assembler.randomlySelectKmers(
+                assemblerOptions.kmersOptions.k,
+                assemblerOptions.kmersOptions.probability, 231);
+        }
         break;
 
     case 1:
         // Randomly select the k-mers to be used as markers, but
         // excluding those that are globally overenriched in the input reads,
         // as measured by total frequency in all reads.
-        assembler.selectKmersBasedOnFrequency(
-            assemblerOptions.kmersOptions.k,
-            assemblerOptions.kmersOptions.probability, 231,
-            assemblerOptions.kmersOptions.enrichmentThreshold, threadCount);
+        if(useSparseKmerTable) {
+            assembler.selectKmersBasedOnFrequencySparse(
+                assemblerOptions.kmersOptions.k,
+                assemblerOptions.kmersOptions.probability, 231,
+                assemblerOptions.kmersOptions.enrichmentThreshold, threadCount);
+        } else {
+            assembler.selectKmersBasedOnFrequency(
+                assemblerOptions.kmersOptions.k,
+                assemblerOptions.kmersOptions.probability, 231,
+                assemblerOptions.kmersOptions.enrichmentThreshold, threadCount);
+        }
         break;
 
     case 2:
@@ -624,9 +654,15 @@ void shasta::main::assemble(
             throw runtime_error("Option --Kmers.file must specify an absolute path. "
                 "A relative path is not accepted.");
         }
-        assembler.readKmersFromFile(
-            assemblerOptions.kmersOptions.k,
-            assemblerOptions.kmersOptions.file);
+        if(useSparseKmerTable) {
+            assembler.readKmersFromFileSparse(
+                assemblerOptions.kmersOptions.k,
+                assemblerOptions.kmersOptions.file);
+        } else {
+            assembler.readKmersFromFile(
+                assemblerOptions.kmersOptions.k,
+                assemblerOptions.kmersOptions.file);
+        }
         break;
 
     case 4:
@@ -689,6 +725,8 @@ void shasta::main::assemble(
             assemblerOptions.minHashOptions.minBucketSize,
             assemblerOptions.minHashOptions.maxBucketSize,
             assemblerOptions.minHashOptions.minFrequency,
+            assemblerOptions.minHashOptions.hashAllIterationsInOnePass,
+            assemblerOptions.minHashOptions.checkpointDirectory,
             threadCount);
     }
 
@@ -864,6 +902,7 @@ void shasta::main::mode0Assembly(
                 assemblerOptions.markerGraphOptions.allowDuplicateMarkers,
                 assemblerOptions.markerGraphOptions.peakFinderMinAreaFraction,
                 assemblerOptions.markerGraphOptions.peakFinderAreaStartIndex,
+                        assemblerOptions.markerGraphOptions.externalSortBufferGigabytes,
                 threadCount);
             assembler.findMarkerGraphReverseComplementVertices(threadCount);
             assembler.createMarkerGraphEdges(threadCount);
@@ -872,7 +911,8 @@ void shasta::main::mode0Assembly(
                 assemblerOptions.markerGraphOptions.lowCoverageThreshold,
                 assemblerOptions.markerGraphOptions.highCoverageThreshold,
                 assemblerOptions.markerGraphOptions.maxDistance,
-                assemblerOptions.markerGraphOptions.edgeMarkerSkipThreshold);
+                assemblerOptions.markerGraphOptions.edgeMarkerSkipThreshold,
+                threadCount);
             assembler.pruneMarkerGraphStrongSubgraph(
                 assemblerOptions.markerGraphOptions.pruneIterationCount);
             assembler.createAssemblyGraphEdges();
@@ -917,6 +957,7 @@ void shasta::main::mode0Assembly(
         assemblerOptions.markerGraphOptions.allowDuplicateMarkers,
         assemblerOptions.markerGraphOptions.peakFinderMinAreaFraction,
         assemblerOptions.markerGraphOptions.peakFinderAreaStartIndex,
+        assemblerOptions.markerGraphOptions.externalSortBufferGigabytes,
         threadCount);
 
     // Find the reverse complement of each marker graph vertex.
@@ -942,7 +983,8 @@ void shasta::main::mode0Assembly(
         assemblerOptions.markerGraphOptions.lowCoverageThreshold,
         assemblerOptions.markerGraphOptions.highCoverageThreshold,
         assemblerOptions.markerGraphOptions.maxDistance,
-        assemblerOptions.markerGraphOptions.edgeMarkerSkipThreshold);
+        assemblerOptions.markerGraphOptions.edgeMarkerSkipThreshold,
+        threadCount);
     if(assemblerOptions.markerGraphOptions.reverseTransitiveReduction) {
         assembler.reverseTransitiveReduction(
             assemblerOptions.markerGraphOptions.lowCoverageThreshold,
@@ -1016,24 +1058,39 @@ void shasta::main::mode0Assembly(
     }
 
     // Compute consensus sequence for marker graph edges to be used for assembly.
-    assembler.assembleMarkerGraphEdges(
-        threadCount,
-        assemblerOptions.assemblyOptions.markerGraphEdgeLengthThresholdForConsensus,
-        assemblerOptions.assemblyOptions.storeCoverageData or
-        assemblerOptions.assemblyOptions.storeCoverageDataCsvLengthThreshold>0,
-        false
-        );
+    // If lazyEdgeConsensus is set, this is done later, during assembly.
+    const bool lazyEdgeConsensus = assemblerOptions.assemblyOptions.lazyEdgeConsensus;
+    if(lazyEdgeConsensus) {
+        if(assemblerOptions.assemblyOptions.storeCoverageData or
+            assemblerOptions.assemblyOptions.storeCoverageDataCsvLengthThreshold>0) {
+            throw runtime_error("--Assembly.lazyEdgeConsensus cannot be used together with "
+                "--Assembly.storeCoverageData or --Assembly.storeCoverageDataCsvLengthThreshold.");
+        }
+    } else {
+        assembler.assembleMarkerGraphEdges(
+            threadCount,
+            assemblerOptions.assemblyOptions.markerGraphEdgeLengthThresholdForConsensus,
+            assemblerOptions.assemblyOptions.edgeConsensusMajorityFraction,
+            assemblerOptions.assemblyOptions.storeCoverageData or
+            assemblerOptions.assemblyOptions.storeCoverageDataCsvLengthThreshold>0,
+            false
+            );
+    }
 
     // Use the assembly graph for global assembly.
     assembler.assemble(
         threadCount,
-        assemblerOptions.assemblyOptions.storeCoverageDataCsvLengthThreshold);
+        assemblerOptions.assemblyOptions.storeCoverageDataCsvLengthThreshold,
+        lazyEdgeConsensus,
+        assemblerOptions.assemblyOptions.markerGraphEdgeLengthThresholdForConsensus,
+        assemblerOptions.assemblyOptions.edgeConsensusMajorityFraction);
     // assembler.findAssemblyGraphBubbles();
     assembler.computeAssemblyStatistics();
-    assembler.writeGfa1("Assembly.gfa");
-    assembler.writeGfa1BothStrands("Assembly-BothStrands.gfa");
+    const string outputSuffix = assemblerOptions.assemblyOptions.bgzipOutput ? ".gz" : "";
+    assembler.writeGfa1("Assembly.gfa" + outputSuffix, threadCount);
+    assembler.writeGfa1BothStrands("Assembly-BothStrands.gfa" + outputSuffix, threadCount);
     assembler.writeGfa1BothStrandsNoSequence("Assembly-BothStrands-NoSequence.gfa");
-    assembler.writeFasta("Assembly.fasta");
+    assembler.writeFasta("Assembly.fasta" + outputSuffix, threadCount);
 
     // If requested, write out the oriented reads that were used to assemble
     // each assembled segment.
@@ -1059,6 +1116,7 @@ void shasta::main::mode2Assembly(
         assemblerOptions.markerGraphOptions.allowDuplicateMarkers,
         assemblerOptions.markerGraphOptions.peakFinderMinAreaFraction,
         assemblerOptions.markerGraphOptions.peakFinderAreaStartIndex,
+        assemblerOptions.markerGraphOptions.externalSortBufferGigabytes,
         threadCount);
     assembler.findMarkerGraphReverseComplementVertices(threadCount);
 
@@ -1094,6 +1152,7 @@ void shasta::main::mode2Assembly(
     assembler.assembleMarkerGraphEdges(
         threadCount,
         assemblerOptions.assemblyOptions.markerGraphEdgeLengthThresholdForConsensus,
+        assemblerOptions.assemblyOptions.edgeConsensusMajorityFraction,
         assemblerOptions.assemblyOptions.storeCoverageData or
         assemblerOptions.assemblyOptions.storeCoverageDataCsvLengthThreshold>0,
         true
@@ -1126,6 +1185,7 @@ void shasta::main::mode3Assembly(
         assemblerOptions.markerGraphOptions.allowDuplicateMarkers,
         assemblerOptions.markerGraphOptions.peakFinderMinAreaFraction,
         assemblerOptions.markerGraphOptions.peakFinderAreaStartIndex,
+        assemblerOptions.markerGraphOptions.externalSortBufferGigabytes,
         threadCount);
     assembler.findMarkerGraphReverseComplementVertices(threadCount);
 
@@ -1154,6 +1214,7 @@ void shasta::main::mode3Assembly(
     assembler.assembleMarkerGraphEdges(
         threadCount,
         assemblerOptions.assemblyOptions.markerGraphEdgeLengthThresholdForConsensus,
+        assemblerOptions.assemblyOptions.edgeConsensusMajorityFraction,
         assemblerOptions.assemblyOptions.storeCoverageData or
         assemblerOptions.assemblyOptions.storeCoverageDataCsvLengthThreshold>0,
         true